@@ -9,32 +9,48 @@
 #include <gst/gst.h>
 
 #include <gst/video/video-format.h>
+#include <gst/video/video-info.h>
+#include <gst/video/video-frame.h>
+#include <gst/video/gstvideometa.h>
+#include <gst/video/video-converter.h>
 #include <gst/audio/audio-format.h>
+#include <gst/audio/audio-info.h>
+#include <gst/audio/audio-converter.h>
+#include <gst/audio/audio-enumtypes.h>
+#include <gst/audio/audio-buffer.h>
+#include <gst/audio/gstaudiometa.h>
+
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
+#include <rcutils/types/uint8_array.h>
 
 #include <sensor_msgs/msg/image.hpp>
+#include <sensor_msgs/msg/compressed_image.hpp>
 #include <sensor_msgs/image_encodings.hpp>
 #include <audio_msgs/msg/audio.hpp>
+#include <audio_msgs/msg/compressed_audio.hpp>
+#include <audio_msgs/msg/compact_audio.hpp>
+#include <audio_msgs/msg/audio_info.hpp>
+#include <video_msgs/msg/encoded_video.hpp>
 
-#define GST_BRIDGE_GST_VIDEO_FORMAT_LIST "{ GRAY8, GRAY16_LE, RGB, BGR, RGBA, BGRA }"
-#define GST_BRIDGE_GST_AUDIO_FORMAT_LIST "{ S8, U8, S16LE, U16LE, S32LE, U32LE, F32LE, F64LE }"    // only well behaved formats
-
-// The following audio formats are theoretically ok, but might be more throuble than they're worth.
-// 
-// these formats need endian conversion on popular platforms
-//     S16BE, U16BE, S24_32BE, U24_32BE, S32BE, U32BE, S24BE, U24BE, S20BE, U20BE, S18BE, U18BE, F32BE, F64BE
-// these formats have odd packing and need thorough testing
-//     S24_32LE, U24_32LE, S24LE, U24LE, S20LE, U20LE, S18LE, U18LE, 
+// the video format list is generated from the image format table, see getImageMsgCaps()
+// audio messages carry samples with the same packing as the caps, step is the packed frame size (eg 3 bytes per channel for S24LE)
+#define GST_BRIDGE_GST_AUDIO_FORMAT_LIST "{ S8, U8, S16LE, U16LE, S32LE, U32LE, F32LE, F64LE, S16BE, U16BE, S32BE, U32BE, F32BE, F64BE, " \
+  "S24LE, U24LE, S24_32LE, U24_32LE, S20LE, U20LE, S18LE, U18LE, S24BE, U24BE, S24_32BE, U24_32BE, S20BE, U20BE, S18BE, U18BE }"
 
 
-#define ROS_IMAGE_MSG_CAPS                            \
-  "video/x-raw, "                                     \
-  "format = " GST_BRIDGE_GST_VIDEO_FORMAT_LIST ", "   \
+#define ROS_IMAGE_MSG_CAPS_FIELDS                     \
   "framerate = " GST_VIDEO_FPS_RANGE ", "             \
   "width = " GST_VIDEO_SIZE_RANGE ", "                \
   "height = " GST_VIDEO_SIZE_RANGE " "
 
+// raw video formats rosimagesink converts into the ros-encoding format, the table formats go through unchanged
+#define ROS_IMAGE_CONVERT_CAPS                        \
+  "video/x-raw, "                                     \
+  "format = (string) { xRGB, xBGR, RGBx, BGRx, ARGB, ABGR, YV12, NV21, Y42B, Y444, v210, GRAY10_LE32 }, " \
+  ROS_IMAGE_MSG_CAPS_FIELDS
+
 #define ROS_AUDIO_MSG_CAPS                            \
   "audio/x-raw, "                                     \
   "format = " GST_BRIDGE_GST_AUDIO_FORMAT_LIST ", "   \
@@ -42,15 +58,43 @@
   "channels = " GST_AUDIO_CHANNELS_RANGE ","          \
   "layout = interleaved"
 
-//support rpicamsrc compressed feeds over DDS?
+// rosaudiosink and rosaudiosrc also carry planar audio, described by GstAudioMeta
+#define ROS_AUDIO_MSG_ANY_LAYOUT_CAPS                 \
+  "audio/x-raw, "                                     \
+  "format = " GST_BRIDGE_GST_AUDIO_FORMAT_LIST ", "   \
+  "rate = " GST_AUDIO_RATE_RANGE ", "                 \
+  "channels = " GST_AUDIO_CHANNELS_RANGE ","          \
+  "layout = { interleaved, non-interleaved }"
+
+// still image codecs carried by sensor_msgs/CompressedImage, see compressed_image_format_to_caps()
+#define ROS_COMPRESSED_IMAGE_MSG_CAPS                 \
+  "image/jpeg; "                                      \
+  "image/png"
+
+// encoded video carried by video_msgs/EncodedVideo, one access unit per message
 #define H264_CAPS                                     \
   "video/x-h264, "                                    \
   "width = " GST_VIDEO_SIZE_RANGE ", "                \
   "height = " GST_VIDEO_SIZE_RANGE ", "               \
   "framerate = " GST_VIDEO_FPS_RANGE ", "             \
   "stream-format = (string) byte-stream, "            \
-  "alignment = (string) nal, "                        \
-  "profile = (string) { constrained-baseline, baseline, main, high }"
+  "alignment = (string) au"
+
+#define H265_CAPS                                     \
+  "video/x-h265, "                                    \
+  "width = " GST_VIDEO_SIZE_RANGE ", "                \
+  "height = " GST_VIDEO_SIZE_RANGE ", "               \
+  "framerate = " GST_VIDEO_FPS_RANGE ", "             \
+  "stream-format = (string) byte-stream, "            \
+  "alignment = (string) au"
+
+#define ROS_ENCODED_VIDEO_MSG_CAPS H264_CAPS "; " H265_CAPS
+
+// compressed audio carried by audio_msgs/CompressedAudio, one packet per message
+#define ROS_COMPRESSED_AUDIO_MSG_CAPS                 \
+  "audio/x-opus, "                                    \
+  "rate = " GST_AUDIO_RATE_RANGE ", "                 \
+  "channels = " GST_AUDIO_CHANNELS_RANGE
 
 // XXX support source from "text/plain" for pocketsphinx
 // XXX support sink to "text/x-raw,{ (string)pango-markup, (string)utf8 }" for textoverlay
@@ -64,14 +108,215 @@ namespace gst_bridge
 //raw sampling of the clocks seems to be stable within about 10uS
 GstClockTimeDiff sample_clock_offset(GstClock* gst_clock, rclcpp::Time stream_start);
 
+/*
+ * One row of the image format table,
+ * describes how a sensor_msgs encoding is laid out and which raw video format carries it unchanged
+ */
+struct image_format_info
+{
+  const char * encoding;    // sensor_msgs::image_encodings value
+  GstVideoFormat format;    // GST_VIDEO_FORMAT_UNKNOWN if no raw video format carries it unchanged
+  guint channels;
+  guint bit_depth;          // bits per channel
+  guint pixel_stride;       // bytes per pixel in the first plane
+  guint n_planes;
+  gint endianness;          // byte order of format, 0 if the channels are single bytes or there is no format,
+                            // then the byte order is decided by the message's is_bigendian
+  const char * bayer;       // video/x-bayer format, 16 bit formats take an le/be suffix
+};
+
+// hashed lookups into the table, nullptr if the encoding or format isn't listed
+const image_format_info * getImageFormatInfo(const std::string & encoding);
+const image_format_info * getImageFormatInfo(GstVideoFormat format);
+// bayer caps format name, eg "rggb" or "rggb16le", nullptr if it isn't listed
+const image_format_info * getImageFormatInfoFromBayer(const std::string & bayer);
+
+// raw video and bayer caps covering every format in the table, for pad templates
+GstCaps * getImageMsgCaps();
+
 // convert between ROS and GST types
 GstVideoFormat getGstVideoFormat(const std::string & encoding);
 GstAudioFormat getGstAudioFormat(const std::string & encoding);
+// the encoding with its byte order taken from is_bigendian, for publishers that only name the sample type
+GstAudioFormat getGstAudioFormat(const std::string & encoding, gboolean is_bigendian);
+// the same sample type in the other byte order, or format itself when the byte order doesn't apply
+GstAudioFormat audio_format_with_endianness(GstAudioFormat format, gint endianness);
+// "interleaved" or "non-interleaved" as in caps, FALSE for anything else
+gboolean getGstAudioLayout(const std::string & layout, GstAudioLayout * audio_layout);
 
 std::string getRosEncoding(GstVideoFormat);
 std::string getRosEncoding(GstAudioFormat);
 
 audio_msgs::msg::Audio gst_audio_info_to_audio_msg(GstAudioInfo * audio_info);
+gboolean audio_msg_to_gst_audio_info(const audio_msgs::msg::Audio & msg, GstAudioInfo * audio_info);
+sensor_msgs::msg::Image gst_video_info_to_image_msg(GstVideoInfo * video_info);
+
+/*
+ * Bayer mosaics have no raw video format, they are described by the grey format with the same layout.
+ * These parse and build either video/x-raw or video/x-bayer caps, and return the ROS encoding alongside.
+ */
+gboolean video_info_from_caps(GstVideoInfo * video_info, std::string * encoding, GstCaps * caps);
+gboolean image_msg_to_video_info(const std::string & encoding, guint width, guint height, gboolean is_bigendian, GstVideoInfo * video_info);
+// the _LE or _BE twin of a 16 bit format, unchanged if there is none
+GstVideoFormat video_format_with_endianness(GstVideoFormat format, gint endianness);
+// true if a message needs its 16 bit samples swapped to fit the frame format, eg 16UC1 from a big endian publisher
+gboolean image_msg_needs_byteswap(GstVideoInfo * video_info, gboolean is_bigendian);
+
+/*
+ * Raw video in image messages:
+ * planes are stored one after another with no gaps, plane 0 rows are msg.step bytes apart,
+ * rows of the chroma planes of planar formats are tightly packed.
+ * i420 carries ceil(width/2) bytes per U and V row, nv12 carries 2*ceil(width/2) bytes per UV row.
+ */
+gsize image_msg_plane_layout(GstVideoInfo * video_info, guint step, gsize offset[GST_VIDEO_MAX_PLANES], gint stride[GST_VIDEO_MAX_PLANES]);
+// rewrite the offsets and strides of a GstVideoInfo to the message layout, so frames can be mapped onto msg.data
+void set_image_msg_layout(GstVideoInfo * video_info, guint step);
+// plane 0 stride of a buffer, from its GstVideoMeta if upstream padded rows differently to the caps
+gint video_buffer_stride(GstVideoInfo * video_info, GstBuffer * buf);
+// true if the message layout is the default GstVideoInfo layout, so frames can move as one block
+gboolean image_msg_layout_matches(GstVideoInfo * video_info, guint step);
+// plane by plane copies between a mapped video frame (honouring GstVideoMeta) and the message layout
+gboolean copy_video_frame_to_msg_data(GstVideoInfo * video_info, GstBuffer * buf, guint8 * data, guint step);
+gboolean copy_msg_data_to_video_frame(GstVideoInfo * video_info, const guint8 * data, guint step, GstBuffer * buf);
+gboolean copy_msg_data_to_video_frame_swapped(GstVideoInfo * video_info, const guint8 * data, guint step, GstBuffer * buf);
+// size msg.data for the frame in the message layout and copy it in, msg.step must already be set
+gboolean fill_image_msg_data(sensor_msgs::msg::Image & msg, GstVideoInfo * video_info, GstBuffer * buf);
+
+/*
+ * Row conversions:
+ * encodings with no raw video format of their own cross the bridge in a related format, converted row by row.
+ * 32FC1 metres is carried as host order GRAY16 millimetres, clamped to the 16 bit range,
+ * a zero pixel is invalid in 16UC1, it converts to and from NaN in 32FC1.
+ * 32FC1 in the other byte order is swapped before it is scaled, and is only received.
+ * rgb16 and bgr16 are carried as RGBA64 and BGRA64 with opaque alpha,
+ * in the byte order of the message, or of the negotiated format when that differs.
+ * GRAY10_LE32 has no encoding of its own, it is published as mono16 with the 10 bits scaled to 16.
+ * A row exists for each message byte order it handles, is_bigendian picks between them.
+ */
+struct image_row_conversion
+{
+  const char * encoding;
+  GstVideoFormat format;
+  guint msg_pixel_stride;   // bytes per pixel in the message
+  gint msg_endianness;      // G_LITTLE_ENDIAN or G_BIG_ENDIAN, the byte order of the message data
+  void (*to_msg)(const guint8 * frame_row, guint8 * msg_row, guint width);
+  void (*from_msg)(const guint8 * msg_row, guint8 * frame_row, guint width);  // nullptr if only published
+};
+
+// the conversion between an encoding in a byte order and a format, nullptr if they don't convert
+const image_row_conversion * getImageRowConversion(const std::string & encoding, GstVideoFormat format, gboolean is_bigendian);
+// the conversion that carries a received encoding in a byte order, nullptr if it has none
+const image_row_conversion * getImageRowConversion(const std::string & encoding, gboolean is_bigendian);
+// the conversion publishing a format that has no ROS encoding, nullptr if it has none
+const image_row_conversion * getImageRowConversion(GstVideoFormat format);
+gboolean convert_video_frame_to_msg_data(const image_row_conversion * conv, GstVideoInfo * video_info, GstBuffer * buf, guint8 * data, guint step);
+gboolean convert_msg_data_to_video_frame(const image_row_conversion * conv, GstVideoInfo * video_info, const guint8 * data, guint step, GstBuffer * buf);
+// a frame into a message sized from the caps, through converter into convert_info if there is one, else through conv,
+// else copied in the message layout. convert_buf wraps msg.data for the converter and is kept while the caps hold
+gboolean image_buffer_to_msg_data(GstVideoConverter * converter, GstVideoInfo * convert_info, GstBuffer ** convert_buf,
+  const image_row_conversion * conv, GstVideoInfo * video_info, GstBuffer * buf, sensor_msgs::msg::Image & msg);
+
+// copy the payload of a buffer into a message built from the caps info above
+void fill_audio_msg_data(audio_msgs::msg::Audio & msg, GstBuffer * buf, uint64_t * msg_seq_num);
+// number the message from the buffer offsets, or continue the count when upstream doesn't provide them
+void set_audio_msg_seq_num(audio_msgs::msg::Audio & msg, GstBuffer * buf, uint64_t * msg_seq_num);
+void set_audio_msg_seq_num(audio_msgs::msg::CompactAudio & msg, GstBuffer * buf, uint64_t * msg_seq_num);
+
+/*
+ * Compact audio:
+ * audio_msgs/CompactAudio names the sample format with a FORMAT_ number instead of an encoding string,
+ * and leaves frame_id and the encoding string to an AudioInfo message published once per stream.
+ */
+// the FORMAT_ number of a sample format, FORMAT_UNKNOWN if it has none
+uint8_t getCompactAudioFormat(GstAudioFormat format);
+GstAudioFormat getGstAudioFormat(uint8_t compact_format);
+// the fixed fields of a compact message, frames and seq_num are left at zero
+audio_msgs::msg::CompactAudio gst_audio_info_to_compact_audio_msg(GstAudioInfo * audio_info);
+audio_msgs::msg::AudioInfo gst_audio_info_to_audio_info_msg(GstAudioInfo * audio_info);
+gboolean compact_audio_msg_to_gst_audio_info(const audio_msgs::msg::CompactAudio & msg, GstAudioInfo * audio_info);
+
+/*
+ * Sample format and layout conversion between the formats the bridge carries.
+ * GstAudioConverter unpacks, converts and packs with ORC kernels, so samples are converted
+ * straight from one buffer into the other. Dither is applied when the conversion drops bits.
+ * Conversions that only change the byte order or the layout skip the converter and use the kernels during the copy.
+ *
+ * Planar audio messages store the channel planes one after another, each frames * bps bytes.
+ */
+void audio_info_with_format(GstAudioInfo * audio_info, GstAudioFormat format, GstAudioLayout layout, GstAudioInfo * out_info);
+GstAudioConverter * audio_converter_new(GstAudioInfo * in_info, GstAudioInfo * out_info, GstAudioDitherMethod dither);
+// plane pointers into message data, one plane for interleaved audio, one per channel otherwise
+std::vector<gpointer> audio_msg_planes(GstAudioInfo * audio_info, const guint8 * data, gsize frames);
+// the same into an existing vector, reusing its storage
+void audio_msg_planes(GstAudioInfo * audio_info, const guint8 * data, gsize frames, std::vector<gpointer> * planes);
+// converter may be NULL when in_info and out_info have the same format and layout, the planes are then copied
+gboolean audio_convert_samples(GstAudioConverter * converter, GstAudioInfo * in_info, GstAudioInfo * out_info,
+  gpointer * in, gpointer * out, gsize frames);
+// a mapped buffer converted straight into message data sized for its frames, msg_planes is scratch that keeps its storage
+gboolean audio_buffer_to_msg_data(GstAudioConverter * converter, GstAudioInfo * in_info, GstAudioInfo * msg_info,
+  GstAudioBuffer * audio_buf, std::vector<uint8_t> & data, std::vector<gpointer> * msg_planes);
+
+/*
+ * Channel selection, for taking a few channels out of a large array.
+ * A channel list is comma separated channel numbers or ranges, eg "0,1,8-11".
+ */
+gboolean parse_channel_list(const std::string & list, std::vector<guint> * channels);
+// the same stream with only the listed channels, their positions come along with them
+void audio_info_with_channels(GstAudioInfo * audio_info, const std::vector<guint> & channels, GstAudioInfo * out_info);
+// one pass over interleaved frames, channel k is written to dst[k] with its samples dst_stride[k] apart
+void audio_gather_channels(GstAudioInfo * in_info, const guint8 * in, const std::vector<guint> & channels,
+  guint8 * const * dst, const guint * dst_stride, gsize frames);
+
+// describe the contents of a message as caps, for sources that don't negotiate with a publisher
+GstCaps * image_msg_to_caps(const sensor_msgs::msg::Image & msg);
+GstCaps * image_msg_to_caps(const std::string & encoding, guint width, guint height, gboolean is_bigendian);
+
+/*
+ * sensor_msgs/CompressedImage names its codec in the format string,
+ * plain "jpeg" or "png", or image_transport's longer "bgr8; jpeg compressed bgr8"
+ */
+// the format string published for encoded caps, "" if CompressedImage can't carry them
+std::string getCompressedImageFormat(GstCaps * caps);
+// caps for a received format string, empty caps if the codec isn't known or it is a compressedDepth format
+GstCaps * compressed_image_format_to_caps(const std::string & format);
+
+/*
+ * Encoded video:
+ * byte-stream H.264 and H.265 separate NAL units with 00 00 01 or 00 00 00 01 start codes.
+ * A decoder can only start from a keyframe that follows the parameter sets, SPS and PPS, and VPS for H.265.
+ */
+// offset and size of each NAL unit in a byte-stream buffer, start codes excluded
+std::vector<std::pair<gsize, gsize>> byte_stream_nal_units(const guint8 * data, gsize size);
+// the NAL unit type from the header, the header layout differs between H.264 and H.265
+guint nal_unit_type(const guint8 * nal, gboolean h265);
+gboolean is_parameter_set_nal(guint type, gboolean h265);
+
+// serialize a message for writing straight into a bag, returns nullptr on failure
+std::shared_ptr<rcutils_uint8_array_t> serialize_msg(const sensor_msgs::msg::Image & msg);
+std::shared_ptr<rcutils_uint8_array_t> serialize_msg(const audio_msgs::msg::Audio & msg);
+
+
+/*
+ * Smooth jittery message stamps onto a regular frame period
+ * drivers often stamp images on arrival, this removes the arrival jitter
+ * without straying further than max_deviation from the original stamps
+ */
+struct timestamp_filter
+{
+  GstClockTime max_deviation;   // largest correction applied to a stamp (ns)
+  gdouble gain;                 // filter gain for the period and phase estimates, (0, 1]
+  guint settle_count;           // intervals observed before the period estimate is trusted
+
+  gdouble period;               // estimated frame period (ns), zero when unknown
+  GstClockTime last_in;         // last raw stamp
+  GstClockTime last_out;        // last smoothed stamp
+  guint count;                  // intervals observed since reset
+};
+
+void timestamp_filter_init(timestamp_filter * filter, GstClockTime max_deviation, gdouble gain, guint settle_count);
+void timestamp_filter_reset(timestamp_filter * filter);
+GstClockTime timestamp_filter_update(timestamp_filter * filter, GstClockTime stamp);
+gboolean timestamp_filter_get_framerate(timestamp_filter * filter, gint * fps_n, gint * fps_d);
 
 /*
 // convert between GST and CV
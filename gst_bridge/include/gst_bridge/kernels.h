@@ -0,0 +1,81 @@
+/*
+(BSD License) to go with ROS2
+
+*/
+
+#ifndef GST_BRIDGE__KERNELS_H_
+#define GST_BRIDGE__KERNELS_H_
+
+#include <glib.h>
+
+/*
+ * Per-sample conversion loops used when a format can't cross the bridge unchanged.
+ * These are plain counted loops over restrict pointers with branchless bodies,
+ * kernels.cpp is built with the vectorizer enabled so the compiler emits SIMD for them.
+ * Samples are in host byte order, except in the _swapped variants where the message side is in the other one.
+ */
+
+namespace gst_bridge
+{
+
+// 32FC1 metres to 16UC1 millimetres, rounded, clamped to [0, 65535], NaN and negative give 0 (invalid)
+void depth_m_to_mm(const float * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+
+// depth_m_to_mm from metres in the other byte order, each word is swapped before it is scaled
+void depth_m_to_mm_swapped(const guint32 * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+
+// 16UC1 millimetres to 32FC1 metres, 0 (invalid) gives NaN
+void depth_mm_to_m(const guint16 * __restrict__ src, float * __restrict__ dst, gsize n);
+
+// GRAY10_LE32 rows (three 10 bit pixels to a 32 bit word) to 16 bit, the 10 bits are replicated into the full range
+void unpack_gray10_le32_to_16(const guint32 * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+
+// 16 bit RGBA to RGB dropping alpha, and RGB to RGBA with opaque alpha, channel order is kept
+void rgba64_to_rgb48(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+void rgb48_to_rgba64(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+void rgba64_to_rgb48_swapped(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+void rgb48_to_rgba64_swapped(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+
+// reverse the byte order of each n-byte word while copying, for endian conversion of audio samples
+void byteswap_copy_16(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n);
+void byteswap_copy_24(const guint8 * __restrict__ src, guint8 * __restrict__ dst, gsize n);
+void byteswap_copy_32(const guint32 * __restrict__ src, guint32 * __restrict__ dst, gsize n);
+void byteswap_copy_64(const guint64 * __restrict__ src, guint64 * __restrict__ dst, gsize n);
+
+// packed 3-byte little-endian S24 samples to S32 (shifted to the top) or S24_32 (sign extended), and back
+void unpack_s24le_to_s32(const guint8 * __restrict__ src, gint32 * __restrict__ dst, gsize n);
+void unpack_s24le_to_s24_32(const guint8 * __restrict__ src, gint32 * __restrict__ dst, gsize n);
+void pack_s24_32_to_s24le(const gint32 * __restrict__ src, guint8 * __restrict__ dst, gsize n);
+
+// gather channel planes into interleaved frames, and scatter them back, for 1, 2, 4 and 8 byte samples,
+// the _bytes variants move bps-byte samples of any packing
+void interleave_8(const guint8 * const * src, guint8 * __restrict__ dst, guint channels, gsize frames);
+void interleave_16(const guint16 * const * src, guint16 * __restrict__ dst, guint channels, gsize frames);
+void interleave_32(const guint32 * const * src, guint32 * __restrict__ dst, guint channels, gsize frames);
+void interleave_64(const guint64 * const * src, guint64 * __restrict__ dst, guint channels, gsize frames);
+void deinterleave_8(const guint8 * __restrict__ src, guint8 * const * dst, guint channels, gsize frames);
+void deinterleave_16(const guint16 * __restrict__ src, guint16 * const * dst, guint channels, gsize frames);
+void deinterleave_32(const guint32 * __restrict__ src, guint32 * const * dst, guint channels, gsize frames);
+void deinterleave_64(const guint64 * __restrict__ src, guint64 * const * dst, guint channels, gsize frames);
+void interleave_bytes(const guint8 * const * src, guint8 * __restrict__ dst, guint bps, guint channels, gsize frames);
+void deinterleave_bytes(const guint8 * __restrict__ src, guint8 * const * dst, guint bps, guint channels, gsize frames);
+
+/*
+ * Copy the n channels listed in src_channel out of interleaved frames in one pass over the source,
+ * channel k goes to dst[k] with its samples dst_stride[k] apart (1 for a plane, the channel count of an interleaved output).
+ * The _bytes variant moves bps-byte samples of any packing.
+ */
+void gather_channels_8(const guint8 * src, guint src_channels, const guint * src_channel,
+  guint8 * const * dst, const guint * dst_stride, guint n, gsize frames);
+void gather_channels_16(const guint16 * src, guint src_channels, const guint * src_channel,
+  guint16 * const * dst, const guint * dst_stride, guint n, gsize frames);
+void gather_channels_32(const guint32 * src, guint src_channels, const guint * src_channel,
+  guint32 * const * dst, const guint * dst_stride, guint n, gsize frames);
+void gather_channels_64(const guint64 * src, guint src_channels, const guint * src_channel,
+  guint64 * const * dst, const guint * dst_stride, guint n, gsize frames);
+void gather_channels_bytes(const guint8 * src, guint bps, guint src_channels, const guint * src_channel,
+  guint8 * const * dst, const guint * dst_stride, guint n, gsize frames);
+
+}  // namespace gst_bridge
+
+#endif  // GST_BRIDGE__KERNELS_H_
@@ -28,6 +28,8 @@
 //include ROS and ROS message formats
 #include <rclcpp/rclcpp.hpp>
 #include <audio_msgs/msg/audio.hpp>
+#include <string>
+#include <vector>
 
 
 G_BEGIN_DECLS
@@ -39,6 +41,19 @@ G_BEGIN_DECLS
 #define GST_IS_ROSAUDIOSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSAUDIOSINK))
 
 typedef struct _Rosaudiosink Rosaudiosink;
+typedef struct _RosaudiosinkChannelTopic RosaudiosinkChannelTopic;
+
+// a group of caps channels published on a topic of its own
+struct _RosaudiosinkChannelTopic
+{
+  std::string topic;
+  std::vector<guint> channels;
+  bool best_effort;
+  rclcpp::Publisher<audio_msgs::msg::Audio>::SharedPtr pub;
+  GstAudioInfo in_info;   // the group's channels in the caps format and layout
+  GstAudioInfo msg_info;  // the group's channels in the published layout
+  audio_msgs::msg::Audio msg;  // filled from the caps, reused for every buffer
+};
 typedef struct _RosaudiosinkClass RosaudiosinkClass;
 
 struct _Rosaudiosink
@@ -54,6 +69,28 @@ struct _Rosaudiosink
 
   GstAudioInfo audio_info;
   uint64_t msg_seq_num;
+
+  gchar* layout;
+  GstAudioDitherMethod dither;
+  GstAudioConverter * converter;  // converts into msg_info when ros-encoding or ros-layout differ from the caps
+  GstAudioInfo msg_info;          // sample format of the published messages
+
+  gchar* channel_topics;
+  std::vector<RosaudiosinkChannelTopic> channel_groups;  // publish these instead of ros-topic when set
+
+  gboolean compact;  // publish CompactAudio, with the stream described once by AudioInfo on <ros-topic>/info
+  rclcpp::Publisher<audio_msgs::msg::CompactAudio>::SharedPtr compact_pub;
+  rclcpp::Publisher<audio_msgs::msg::AudioInfo>::SharedPtr info_pub;
+
+  // filled from the caps, render only sets the stamp, seq_num and data, and the data keeps its storage
+  audio_msgs::msg::Audio::SharedPtr msg;
+  audio_msgs::msg::CompactAudio::SharedPtr compact_msg;
+  // scratch space for plane pointers and channel gathers, kept between buffers
+  std::vector<gpointer> msg_planes;
+  std::vector<gpointer> in_planes;
+  std::vector<guint> gather_channels;
+  std::vector<guint8 *> gather_dst;
+  std::vector<guint> gather_stride;
 };
 
 struct _RosaudiosinkClass
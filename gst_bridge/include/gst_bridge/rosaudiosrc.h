@@ -28,9 +28,10 @@
 //include ROS and ROS message formats
 #include <rclcpp/rclcpp.hpp>
 #include <audio_msgs/msg/audio.hpp>
-#include <queue>  // std::queue
-#include <mutex>  // std::mutex, std::unique_lock
-#include <condition_variable> // std::condition_variable
+#include <audio_msgs/msg/compact_audio.hpp>
+#include <audio_msgs/msg/audio_info.hpp>
+#include <memory>  // std::shared_ptr
+#include <vector>  // std::vector
 
 G_BEGIN_DECLS
 
@@ -42,6 +43,16 @@ G_BEGIN_DECLS
 
 typedef struct _Rosaudiosrc Rosaudiosrc;
 typedef struct _RosaudiosrcClass RosaudiosrcClass;
+typedef struct _RosaudiosrcMsg RosaudiosrcMsg;
+
+// a received Audio or CompactAudio message, with the sample format it carries
+struct _RosaudiosrcMsg
+{
+  std::shared_ptr<const void> msg;    // keeps the message holding the data alive
+  const std::vector<uint8_t> * data;
+  builtin_interfaces::msg::Time stamp;
+  GstAudioInfo info;
+};
 
 struct _Rosaudiosrc
 {
@@ -53,15 +64,24 @@ struct _Rosaudiosrc
 
   bool msg_init;
 
-  // XXX this is too much boilerplate.
-  size_t msg_queue_max;
-  std::queue<audio_msgs::msg::Audio::ConstSharedPtr> msg_queue;
-  std::mutex msg_queue_mtx;
-  std::condition_variable msg_queue_cv;
+  RosBaseSrcMsgQueue<RosaudiosrcMsg> msg_queue;
 
   rclcpp::Subscription<audio_msgs::msg::Audio>::SharedPtr sub;
 
-  GstAudioInfo audio_info;
+  gboolean compact;  // subscribe to CompactAudio, and to its AudioInfo on <ros-topic>/info
+  rclcpp::Subscription<audio_msgs::msg::CompactAudio>::SharedPtr compact_sub;
+  rclcpp::Subscription<audio_msgs::msg::AudioInfo>::SharedPtr info_sub;
+
+  GstAudioInfo audio_info;        // sample format on the src pad
+  GstAudioInfo msg_info;          // sample format of the subscribed messages
+  GstAudioInfo sel_info;          // msg_info narrowed to the channel-list selection
+
+  gchar* channel_list;
+  std::vector<guint> channels;    // selected message channels, empty takes them all
+  std::vector<guint8> gather_buf; // selected channels waiting for a format conversion
+  gchar* layout;
+  GstAudioDitherMethod dither;
+  GstAudioConverter * converter;  // converts msg_info into audio_info when ros-encoding or ros-layout differ from the messages
   uint64_t msg_seq_num;
 };
 
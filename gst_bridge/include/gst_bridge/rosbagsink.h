@@ -0,0 +1,98 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ROSBAGSINK_H_
+#define _GST_ROSBAGSINK_H_
+
+#include <gst/base/gstbasesink.h>
+#include <gst_bridge/gst_bridge.h>
+#include <gst_bridge/rosbasesink.h>
+
+//include ROS and ROS message formats
+#include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/msg/image.hpp>
+#include <audio_msgs/msg/audio.hpp>
+#include <rosbag2_cpp/writers/sequential_writer.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ROSBAGSINK   (rosbagsink_get_type())
+#define GST_ROSBAGSINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ROSBAGSINK,Rosbagsink))
+#define GST_ROSBAGSINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ROSBAGSINK,RosbagsinkClass))
+#define GST_IS_ROSBAGSINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ROSBAGSINK))
+#define GST_IS_ROSBAGSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSBAGSINK))
+
+typedef struct _Rosbagsink Rosbagsink;
+typedef struct _RosbagsinkClass RosbagsinkClass;
+
+// a buffer waiting for the I/O thread, with the stamp render() gave it
+struct rosbagsink_item
+{
+  GstBuffer* buf;
+  rclcpp::Time stamp;
+};
+
+struct _Rosbagsink
+{
+  RosBaseSink parent;
+
+  gchar* bag_uri;
+  gchar* storage_id;
+  gchar* topic;
+  gchar* frame_id;
+  guint64 max_cache_size;
+  guint max_queue;
+
+  std::unique_ptr<rosbag2_cpp::writers::SequentialWriter> writer;
+  gboolean topic_created;
+  gboolean is_audio;
+
+  GstVideoInfo video_info;
+  gchar* encoding;    // ROS encoding of the video caps, bayer isn't recoverable from video_info
+  GstAudioInfo audio_info;
+  uint64_t msg_seq_num;
+
+  // render() queues buffers, the I/O thread serializes and writes them in batches
+  std::thread io_thread;
+  std::mutex queue_mtx;
+  std::condition_variable queue_cv;
+  std::deque<rosbagsink_item> queue;
+  bool io_busy;     // the I/O thread holds a batch outside the queue
+  bool io_running;
+  GstFlowReturn io_flow;  // latched by the I/O thread when a write fails, returned by the next render
+};
+
+struct _RosbagsinkClass
+{
+  RosBaseSinkClass parent_class;
+
+  // stick member function pointers here
+  // along with member function pointers for signal handlers
+};
+
+GType rosbagsink_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,78 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ROSBAGSRC_H_
+#define _GST_ROSBAGSRC_H_
+
+#include <gst/base/gstbasesrc.h>
+#include <gst_bridge/gst_bridge.h>
+
+//include ROS and ROS message formats
+#include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/msg/image.hpp>
+#include <audio_msgs/msg/audio.hpp>
+#include <rosbag2_cpp/readers/sequential_reader.hpp>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ROSBAGSRC   (rosbagsrc_get_type())
+#define GST_ROSBAGSRC(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ROSBAGSRC,Rosbagsrc))
+#define GST_ROSBAGSRC_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ROSBAGSRC,RosbagsrcClass))
+#define GST_IS_ROSBAGSRC(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ROSBAGSRC))
+#define GST_IS_ROSBAGSRC_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSBAGSRC))
+
+typedef struct _Rosbagsrc Rosbagsrc;
+typedef struct _RosbagsrcClass RosbagsrcClass;
+
+struct _Rosbagsrc
+{
+  GstBaseSrc parent;
+  gchar* bag_uri;
+  gchar* storage_id;
+  gchar* topic;
+
+  std::unique_ptr<rosbag2_cpp::readers::SequentialReader> reader;
+  gchar* topic_type;
+  GstClockTime duration;
+  gboolean duration_scanned;  //the topic is read through for its duration on the first duration query
+
+  rcl_time_point_value_t stamp_origin;  //header stamp of the first message, PTS zero
+  rcl_time_point_value_t bag_origin;    //bag receive time of the first message, for seeking
+
+  // the next message to push, held over from caps discovery and seeking
+  sensor_msgs::msg::Image::SharedPtr pending_image;
+  audio_msgs::msg::Audio::SharedPtr pending_audio;
+
+  GstCaps* caps;
+  guint64 trickmode_count;
+};
+
+struct _RosbagsrcClass
+{
+  GstBaseSrcClass parent_class;
+
+  // stick member function pointers here
+  // along with member function pointers for signal handlers
+};
+
+GType rosbagsrc_get_type (void);
+
+G_END_DECLS
+
+#endif
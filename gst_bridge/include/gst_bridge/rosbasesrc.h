@@ -25,6 +25,11 @@
 
 //include ROS and ROS message formats
 #include <rclcpp/rclcpp.hpp>
+#include <memory>  // std::shared_ptr
+#include <vector>  // std::vector
+#include <queue>  // std::queue
+#include <mutex>  // std::mutex, std::unique_lock
+#include <condition_variable> // std::condition_variable
 
 G_BEGIN_DECLS
 
@@ -56,6 +61,9 @@ struct _RosBaseSrc
   rclcpp::Time stream_start;
   rcl_time_point_value_t stream_start_prop; //uint64_t, equiv to GST_TYPE_CLOCK_TIME
   GstClockTimeDiff ros_clock_offset;
+
+  gboolean is_live;
+  rcl_time_point_value_t msg_stamp_origin;  //stamp at running time zero when not live
 };
 
 struct _RosBaseSrcClass
@@ -83,6 +91,146 @@ struct _RosBaseSrcClass
 
 GType rosbasesrc_get_type (void);
 
+/*
+ * translate a ROS message stamp into a buffer PTS
+ * live sources map the stamp through the clock offset sampled at PLAYING,
+ * non-live sources count from ros-start-time, or from the first message stamp
+ */
+GstClockTime rosbasesrc_msg_stamp_to_pts (RosBaseSrc * src, rcl_time_point_value_t stamp);
+
 G_END_DECLS
 
+
+/*
+ * messages wait here between the subscription callback and create()
+ * when live a full queue drops the oldest message,
+ * otherwise it blocks the executor and reliable QoS carries the backpressure upstream
+ */
+template <typename MsgT>
+struct RosBaseSrcMsgQueue
+{
+  size_t max;
+  std::queue<MsgT> msgs;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool flushing;  //release a subscription callback blocked on a full queue
+
+  explicit RosBaseSrcMsgQueue (size_t max_msgs) : max(max_msgs), flushing(false) {}
+};
+
+/*
+ * the subscription QoS the queue expects,
+ * reliable keep-all when not live so a full queue pushes back on the publisher instead of dropping
+ */
+rclcpp::QoS rosbasesrc_sub_qos (RosBaseSrc * src);
+
+/*
+ * copy message data into a buffer downstream provided
+ * a buffer that can't hold the message is an error
+ */
+GstFlowReturn rosbasesrc_fill_buffer (RosBaseSrc * src, const std::vector<uint8_t> & data, GstBuffer * buf);
+
+
+// call before subscribing
+template <typename MsgT>
+void rosbasesrc_queue_open (RosBaseSrcMsgQueue<MsgT> * queue)
+{
+  std::unique_lock<std::mutex> lck(queue->mtx);
+  queue->flushing = false;
+}
+
+// call after unsubscribing, empties the queue and releases a callback blocked on it
+template <typename MsgT>
+void rosbasesrc_queue_close (RosBaseSrcMsgQueue<MsgT> * queue)
+{
+  std::unique_lock<std::mutex> lck(queue->mtx);
+  queue->msgs = std::queue<MsgT>();
+  queue->flushing = true;
+  queue->cv.notify_all();
+}
+
+/*
+ * called from the subscription callback
+ * returns the number of older messages dropped to make room
+ */
+template <typename MsgT>
+size_t rosbasesrc_queue_push (RosBaseSrc * src, RosBaseSrcMsgQueue<MsgT> * queue, const MsgT & msg)
+{
+  size_t dropped = 0;
+
+  std::unique_lock<std::mutex> lck(queue->mtx);
+  if(!src->is_live)
+  {
+    while((queue->msgs.size() >= queue->max) && !queue->flushing)
+    {
+      queue->cv.wait(lck);
+    }
+    if(queue->flushing)
+      return 0;
+  }
+  queue->msgs.push(msg);
+  while(queue->msgs.size() > queue->max)
+  {
+    queue->msgs.pop();
+    dropped++;
+    RCLCPP_WARN(src->logger, "dropping message");
+  }
+  queue->cv.notify_all();
+  return dropped;
+}
+
+// wait for a message and leave it queued, getcaps uses this to learn the format
+template <typename MsgT>
+MsgT rosbasesrc_queue_peek (RosBaseSrcMsgQueue<MsgT> * queue)
+{
+  std::unique_lock<std::mutex> lck(queue->mtx);
+  while(queue->msgs.empty())
+  {
+    queue->cv.wait(lck);
+  }
+  return queue->msgs.front();
+}
+
+// wait for a message and take it, waking a subscription waiting on a full queue
+template <typename MsgT>
+MsgT rosbasesrc_queue_pop (RosBaseSrcMsgQueue<MsgT> * queue)
+{
+  std::unique_lock<std::mutex> lck(queue->mtx);
+  while(queue->msgs.empty())
+  {
+    queue->cv.wait(lck);
+  }
+  MsgT msg = queue->msgs.front();
+  queue->msgs.pop();
+  queue->cv.notify_all();
+  return msg;
+}
+
+// the buffer holds a reference to the message it wraps
+template <typename MsgT>
+void rosbasesrc_release_msg (gpointer data)
+{
+  delete static_cast<std::shared_ptr<const MsgT>*>(data);
+}
+
+// hand the message memory downstream without a copy
+template <typename MsgT>
+GstBuffer * rosbasesrc_wrap_msg_data (const std::shared_ptr<const MsgT> & msg, const std::vector<uint8_t> & data)
+{
+  return gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+      (gpointer) data.data(), data.size(), 0, data.size(),
+      new std::shared_ptr<const MsgT>(msg), rosbasesrc_release_msg<MsgT>);
+}
+
+// wrap the message data, or copy it if downstream provided the buffer
+template <typename MsgT>
+GstFlowReturn rosbasesrc_msg_data_to_buffer (RosBaseSrc * src, const std::shared_ptr<const MsgT> & msg,
+    const std::vector<uint8_t> & data, GstBuffer ** buf)
+{
+  if(*buf != NULL)
+    return rosbasesrc_fill_buffer(src, data, *buf);
+  *buf = rosbasesrc_wrap_msg_data(msg, data);
+  return GST_FLOW_OK;
+}
+
 #endif
@@ -0,0 +1,71 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ROSCOMPRESSEDAUDIOSINK_H_
+#define _GST_ROSCOMPRESSEDAUDIOSINK_H_
+
+#include <gst/base/gstbasesink.h>
+#include <gst_bridge/gst_bridge.h>
+#include <gst_bridge/rosbasesink.h>
+
+//include ROS and ROS message formats
+#include <rclcpp/rclcpp.hpp>
+#include <audio_msgs/msg/compressed_audio.hpp>
+
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ROSCOMPRESSEDAUDIOSINK   (roscompressedaudiosink_get_type())
+#define GST_ROSCOMPRESSEDAUDIOSINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ROSCOMPRESSEDAUDIOSINK,Roscompressedaudiosink))
+#define GST_ROSCOMPRESSEDAUDIOSINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ROSCOMPRESSEDAUDIOSINK,RoscompressedaudiosinkClass))
+#define GST_IS_ROSCOMPRESSEDAUDIOSINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ROSCOMPRESSEDAUDIOSINK))
+#define GST_IS_ROSCOMPRESSEDAUDIOSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSCOMPRESSEDAUDIOSINK))
+
+typedef struct _Roscompressedaudiosink Roscompressedaudiosink;
+typedef struct _RoscompressedaudiosinkClass RoscompressedaudiosinkClass;
+
+struct _Roscompressedaudiosink
+{
+  RosBaseSink parent;
+
+  gchar* pub_topic;
+  gchar* frame_id;
+
+  rclcpp::Publisher<audio_msgs::msg::CompressedAudio>::SharedPtr pub;
+
+  gchar* caps;        //negotiated caps string, with the codec headers, sent in every message
+  gint rate;
+  gint channels;
+  uint64_t msg_seq_num;
+  uint64_t sample_offset;  //sample-rate intervals published so far
+};
+
+struct _RoscompressedaudiosinkClass
+{
+  RosBaseSinkClass parent_class;
+
+  // stick member function pointers here
+  // along with member function pointers for signal handlers
+};
+
+GType roscompressedaudiosink_get_type (void);
+
+G_END_DECLS
+
+#endif
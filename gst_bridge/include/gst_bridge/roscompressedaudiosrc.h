@@ -0,0 +1,73 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ROSCOMPRESSEDAUDIOSRC_H_
+#define _GST_ROSCOMPRESSEDAUDIOSRC_H_
+
+#include <gst/base/gstbasesrc.h>
+#include <gst_bridge/gst_bridge.h>
+#include <gst_bridge/rosbasesrc.h>
+
+//include ROS and ROS message formats
+#include <rclcpp/rclcpp.hpp>
+#include <audio_msgs/msg/compressed_audio.hpp>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ROSCOMPRESSEDAUDIOSRC   (roscompressedaudiosrc_get_type())
+#define GST_ROSCOMPRESSEDAUDIOSRC(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ROSCOMPRESSEDAUDIOSRC,Roscompressedaudiosrc))
+#define GST_ROSCOMPRESSEDAUDIOSRC_CAST(obj)        ((Roscompressedaudiosrc*)obj)
+#define GST_ROSCOMPRESSEDAUDIOSRC_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ROSCOMPRESSEDAUDIOSRC,RoscompressedaudiosrcClass))
+#define GST_ROSCOMPRESSEDAUDIOSRC_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_ROSCOMPRESSEDAUDIOSRC, RoscompressedaudiosrcClass))
+#define GST_IS_ROSCOMPRESSEDAUDIOSRC(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ROSCOMPRESSEDAUDIOSRC))
+#define GST_IS_ROSCOMPRESSEDAUDIOSRC_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSCOMPRESSEDAUDIOSRC))
+
+typedef struct _Roscompressedaudiosrc Roscompressedaudiosrc;
+typedef struct _RoscompressedaudiosrcClass RoscompressedaudiosrcClass;
+
+struct _Roscompressedaudiosrc
+{
+  RosBaseSrc parent;
+  gchar* sub_topic;
+  gchar* frame_id;
+  gchar* caps;  //caps string of the first message
+  gboolean have_seq_num;
+  uint64_t last_seq_num;  //a gap in the packet count marks a discontinuity
+  gchar* init_caps;
+
+  bool msg_init;
+
+  RosBaseSrcMsgQueue<audio_msgs::msg::CompressedAudio::ConstSharedPtr> msg_queue;
+
+  rclcpp::Subscription<audio_msgs::msg::CompressedAudio>::SharedPtr sub;
+};
+
+struct _RoscompressedaudiosrcClass
+{
+  RosBaseSrcClass parent_class;
+
+  // stick member function pointers here
+  // along with member function pointers for signal handlers
+};
+
+GType roscompressedaudiosrc_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,77 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ROSENCODEDVIDEOSINK_H_
+#define _GST_ROSENCODEDVIDEOSINK_H_
+
+#include <gst/base/gstbasesink.h>
+#include <gst_bridge/gst_bridge.h>
+#include <gst_bridge/rosbasesink.h>
+
+//include ROS and ROS message formats
+#include <rclcpp/rclcpp.hpp>
+#include <video_msgs/msg/encoded_video.hpp>
+
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ROSENCODEDVIDEOSINK   (rosencodedvideosink_get_type())
+#define GST_ROSENCODEDVIDEOSINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ROSENCODEDVIDEOSINK,Rosencodedvideosink))
+#define GST_ROSENCODEDVIDEOSINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ROSENCODEDVIDEOSINK,RosencodedvideosinkClass))
+#define GST_IS_ROSENCODEDVIDEOSINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ROSENCODEDVIDEOSINK))
+#define GST_IS_ROSENCODEDVIDEOSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSENCODEDVIDEOSINK))
+
+typedef struct _Rosencodedvideosink Rosencodedvideosink;
+typedef struct _RosencodedvideosinkClass RosencodedvideosinkClass;
+
+struct _Rosencodedvideosink
+{
+  RosBaseSink parent;
+
+  gchar* pub_topic;
+  gchar* frame_id;
+
+  rclcpp::Publisher<video_msgs::msg::EncodedVideo>::SharedPtr pub;
+  rclcpp::Publisher<video_msgs::msg::EncodedVideo>::SharedPtr keyframe_pub;  //latches the latest keyframe on <pub_topic>/keyframe
+
+  gchar* caps;        //negotiated caps string, sent in every message
+  gboolean h265;
+  uint64_t msg_seq_num;
+
+  gboolean resend_keyframe;  //latch each keyframe for late subscribers
+  gboolean force_keyframe;   //ask upstream for a new keyframe when a subscriber joins
+  size_t subscriber_count;
+
+  std::vector<guint8> param_sets[3];  //latest VPS/SPS/PPS, or SPS/PPS for H.264, with their start codes
+  video_msgs::msg::EncodedVideo::SharedPtr keyframe_msg;  //latest keyframe with the parameter sets in front
+};
+
+struct _RosencodedvideosinkClass
+{
+  RosBaseSinkClass parent_class;
+
+  // stick member function pointers here
+  // along with member function pointers for signal handlers
+};
+
+GType rosencodedvideosink_get_type (void);
+
+G_END_DECLS
+
+#endif
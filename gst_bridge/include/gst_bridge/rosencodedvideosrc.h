@@ -0,0 +1,79 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ROSENCODEDVIDEOSRC_H_
+#define _GST_ROSENCODEDVIDEOSRC_H_
+
+#include <gst/base/gstbasesrc.h>
+#include <gst_bridge/gst_bridge.h>
+#include <gst_bridge/rosbasesrc.h>
+
+//include ROS and ROS message formats
+#include <rclcpp/rclcpp.hpp>
+#include <video_msgs/msg/encoded_video.hpp>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ROSENCODEDVIDEOSRC   (rosencodedvideosrc_get_type())
+#define GST_ROSENCODEDVIDEOSRC(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ROSENCODEDVIDEOSRC,Rosencodedvideosrc))
+#define GST_ROSENCODEDVIDEOSRC_CAST(obj)        ((Rosencodedvideosrc*)obj)
+#define GST_ROSENCODEDVIDEOSRC_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ROSENCODEDVIDEOSRC,RosencodedvideosrcClass))
+#define GST_ROSENCODEDVIDEOSRC_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_ROSENCODEDVIDEOSRC, RosencodedvideosrcClass))
+#define GST_IS_ROSENCODEDVIDEOSRC(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ROSENCODEDVIDEOSRC))
+#define GST_IS_ROSENCODEDVIDEOSRC_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSENCODEDVIDEOSRC))
+
+typedef struct _Rosencodedvideosrc Rosencodedvideosrc;
+typedef struct _RosencodedvideosrcClass RosencodedvideosrcClass;
+
+struct _Rosencodedvideosrc
+{
+  RosBaseSrc parent;
+  gchar* sub_topic;
+  gchar* frame_id;
+  gchar* caps;  //caps string of the first message
+  gchar* init_caps;
+
+  gboolean wait_for_keyframe;  //drop delta units until a decoder can start
+  gboolean skip_started;
+  uint64_t start_seq_num;  //started from <ros-topic>/keyframe, the main topic may still deliver access units up to this one
+  gboolean have_seq_num;
+  uint64_t last_seq_num;  //a gap in the access unit count means a frame was lost
+  gboolean resync;  //drop delta units after a gap until the next keyframe
+
+  bool msg_init;
+
+  RosBaseSrcMsgQueue<video_msgs::msg::EncodedVideo::ConstSharedPtr> msg_queue;
+
+  rclcpp::Subscription<video_msgs::msg::EncodedVideo>::SharedPtr sub;
+  rclcpp::Subscription<video_msgs::msg::EncodedVideo>::SharedPtr keyframe_sub;
+};
+
+struct _RosencodedvideosrcClass
+{
+  RosBaseSrcClass parent_class;
+
+  // stick member function pointers here
+  // along with member function pointers for signal handlers
+};
+
+GType rosencodedvideosrc_get_type (void);
+
+G_END_DECLS
+
+#endif
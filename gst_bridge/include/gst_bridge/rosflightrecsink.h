@@ -0,0 +1,151 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_ROSFLIGHTRECSINK_H_
+#define _GST_ROSFLIGHTRECSINK_H_
+
+#include <gst/base/gstbasesink.h>
+#include <gst_bridge/gst_bridge.h>
+#include <gst_bridge/rosbasesink.h>
+
+//include ROS and ROS message formats
+#include <rclcpp/rclcpp.hpp>
+#include <sensor_msgs/msg/image.hpp>
+#include <audio_msgs/msg/audio.hpp>
+#include <std_srvs/srv/trigger.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_ROSFLIGHTRECSINK   (rosflightrecsink_get_type())
+#define GST_ROSFLIGHTRECSINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_ROSFLIGHTRECSINK,Rosflightrecsink))
+#define GST_ROSFLIGHTRECSINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_ROSFLIGHTRECSINK,RosflightrecsinkClass))
+#define GST_IS_ROSFLIGHTRECSINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_ROSFLIGHTRECSINK))
+#define GST_IS_ROSFLIGHTRECSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_ROSFLIGHTRECSINK))
+
+typedef struct _Rosflightrecsink Rosflightrecsink;
+typedef struct _RosflightrecsinkClass RosflightrecsinkClass;
+
+/*
+ * layout of the ring file:
+ *   one ring header, index_slots record descriptors, then data_size bytes of payload
+ * records are never split across the end of the payload area,
+ * positions are monotonic byte counts, so (head - pos) > data_size means overwritten
+ */
+struct rosflightrec_ring_header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t data_size;
+  uint64_t index_slots;
+  std::atomic<uint64_t> head;      // monotonic position of the next payload byte
+  std::atomic<uint64_t> next_seq;  // sequence number of the next record
+};
+
+struct rosflightrec_record
+{
+  std::atomic<uint64_t> lock;  // seqlock, odd while the writer is filling the slot
+  uint64_t seq;
+  uint64_t pos;                // monotonic position of the payload
+  uint64_t size;
+  int64_t stamp;               // ROS time of the message, ns
+  uint64_t offset;             // GST_BUFFER_OFFSET, sample count for audio
+};
+
+// the range of records a dump should contain, fixed when the service is called
+struct rosflightrec_snapshot
+{
+  uint64_t first_seq;
+  uint64_t end_seq;
+  int64_t start_stamp;
+  rcl_clock_type_t clock_type;
+  gboolean is_audio;
+  GstVideoInfo video_info;
+  gchar* encoding;
+  GstAudioInfo audio_info;
+  gchar* caps_str;
+  gchar* location;
+};
+
+struct _Rosflightrecsink
+{
+  RosBaseSink parent;
+
+  gchar* ring_location;
+  guint64 ring_size;
+  guint index_slots;
+  GstClockTime duration;
+  gchar* service_name;
+  gchar* dump_location;
+  gchar* dump_format;
+  gchar* storage_id;
+  gchar* topic;
+  gchar* frame_id;
+
+  // the mmap'd ring, written only from render()
+  int ring_fd;
+  size_t ring_map_size;
+  guint8* ring_map;
+  rosflightrec_ring_header* ring;
+  rosflightrec_record* records;
+  guint8* ring_data;
+
+  // caps of the records since caps_first_seq, guarded by info_mtx
+  std::mutex info_mtx;
+  gboolean is_audio;
+  GstVideoInfo video_info;
+  gchar* encoding;  // ROS encoding of the video caps, bayer isn't recoverable from video_info
+  GstAudioInfo audio_info;
+  guint step;   // row step of plane 0 in the image message layout
+  gchar* caps_str;
+  uint64_t caps_first_seq;
+
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr service;
+
+  // the dump thread copies records out of the ring while render keeps writing
+  std::thread dump_thread;
+  std::mutex dump_mtx;
+  std::condition_variable dump_cv;
+  rosflightrec_snapshot snapshot;
+  bool dump_pending;
+  bool dump_running;
+
+  // while a dump holds the ring, render drops buffers instead of overwriting records from hold_seq on
+  std::atomic<bool> hold;
+  std::atomic<uint64_t> hold_seq;
+  std::atomic<uint64_t> held_drops;
+};
+
+struct _RosflightrecsinkClass
+{
+  RosBaseSinkClass parent_class;
+
+  // stick member function pointers here
+  // along with member function pointers for signal handlers
+};
+
+GType rosflightrecsink_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -21,6 +21,7 @@
 #define _GST_ROSIMAGESINK_H_
 
 #include <gst/video/video-format.h>
+#include <gst/video/video-converter.h>
 #include <gst/base/gstbasesink.h>
 #include <gst_bridge/gst_bridge.h>
 #include <gst_bridge/rosbasesink.h>
@@ -57,6 +58,16 @@ struct _Rosimagesink
   
   size_t step;   //bytes per pixel
   gint endianness;
+  GstVideoInfo video_info;  //plane layout of the negotiated caps
+  const gst_bridge::image_row_conversion * row_conversion; //row by row into ros-encoding, eg GRAY16 millimetres to 32FC1 metres
+  gboolean keep_row_padding;  //publish plane 0 with the upstream stride instead of repacking rows
+
+  guint convert_threads;         //row bands the converter splits each frame into, 0 for one per core
+  GstVideoConverter * converter; //converts straight into msg.data when ros-encoding differs from the caps
+  GstVideoInfo convert_info;     //ros-encoding format in the message layout
+  GstBuffer * convert_buf;       //msg.data wrapped as the converter output, kept while the caps hold
+
+  sensor_msgs::msg::Image::SharedPtr msg;  //filled from the caps, render only sets the stamp and the data
 };
 
 struct _RosimagesinkClass
@@ -28,9 +28,6 @@
 //include ROS and ROS message formats
 #include <rclcpp/rclcpp.hpp>
 #include <sensor_msgs/msg/image.hpp>
-#include <queue>  // std::queue
-#include <mutex>  // std::mutex, std::unique_lock
-#include <condition_variable> // std::condition_variable
 
 G_BEGIN_DECLS
 
@@ -55,11 +52,7 @@ struct _Rosimagesrc
 
   bool msg_init;
 
-  // XXX this is too much boilerplate.
-  size_t msg_queue_max;
-  std::queue<sensor_msgs::msg::Image::ConstSharedPtr> msg_queue;
-  std::mutex msg_queue_mtx;
-  std::condition_variable msg_queue_cv;
+  RosBaseSrcMsgQueue<sensor_msgs::msg::Image::ConstSharedPtr> msg_queue;
 
   rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr sub;
   
@@ -68,6 +61,12 @@ struct _Rosimagesrc
   GstVideoFormat format;
   size_t step;   //bytes per pixel
   gint endianness;
+
+  gboolean use_video_meta;  //downstream reads strides from GstVideoMeta, padded messages go out without a copy
+
+  gboolean smooth_timestamps;
+  gst_bridge::timestamp_filter ts_filter;
+  gboolean ts_filter_settled;
 };
 
 struct _RosimagesrcClass
@@ -1,4 +1,11 @@
 #include <gst_bridge/gst_bridge.h>
+#include <gst_bridge/kernels.h>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include <rosidl_typesupport_cpp/message_type_support.hpp>
+#include <rmw/rmw.h>
 
 namespace gst_bridge
 {
@@ -11,27 +18,195 @@ GstClockTimeDiff sample_clock_offset(GstClock* gst_clock, rclcpp::Time stream_st
 }
 
 
+namespace enc = sensor_msgs::image_encodings;
+
+/*
+ * Every sensor_msgs image encoding, and the raw video format that carries it byte-for-byte.
+ * Only fully transparent mappings get a GstVideoFormat,
+ * the rest are listed so their layout is still known.
+ * When several encodings share a format, the first one listed is used for GST to ROS.
+ * Big endian twins follow their little endian row, so ROS to GST defaults to the little endian format.
+ * Multi-byte rows without a format have endianness 0, their byte order is the message's is_bigendian.
+ */
+static const image_format_info image_formats[] =
+{
+  // encoding               format                      ch  bits  stride  planes  endianness       bayer
+  {enc::MONO8,              GST_VIDEO_FORMAT_GRAY8,      1,  8,    1,      1,      0,               nullptr},
+  {enc::MONO16,             GST_VIDEO_FORMAT_GRAY16_LE,  1,  16,   2,      1,      G_LITTLE_ENDIAN, nullptr},
+  {enc::MONO16,             GST_VIDEO_FORMAT_GRAY16_BE,  1,  16,   2,      1,      G_BIG_ENDIAN,    nullptr},
+  {enc::RGB8,               GST_VIDEO_FORMAT_RGB,        3,  8,    3,      1,      0,               nullptr},
+  {enc::BGR8,               GST_VIDEO_FORMAT_BGR,        3,  8,    3,      1,      0,               nullptr},
+  {enc::RGBA8,              GST_VIDEO_FORMAT_RGBA,       4,  8,    4,      1,      0,               nullptr},
+  {enc::BGRA8,              GST_VIDEO_FORMAT_BGRA,       4,  8,    4,      1,      0,               nullptr},
+  {enc::RGB16,              GST_VIDEO_FORMAT_UNKNOWN,    3,  16,   6,      1,      0,               nullptr},
+  {enc::BGR16,              GST_VIDEO_FORMAT_UNKNOWN,    3,  16,   6,      1,      0,               nullptr},
+#if GST_CHECK_VERSION(1, 20, 0)
+  {enc::RGBA16,             GST_VIDEO_FORMAT_RGBA64_LE,  4,  16,   8,      1,      G_LITTLE_ENDIAN, nullptr},
+  {enc::RGBA16,             GST_VIDEO_FORMAT_RGBA64_BE,  4,  16,   8,      1,      G_BIG_ENDIAN,    nullptr},
+  {enc::BGRA16,             GST_VIDEO_FORMAT_BGRA64_LE,  4,  16,   8,      1,      G_LITTLE_ENDIAN, nullptr},
+  {enc::BGRA16,             GST_VIDEO_FORMAT_BGRA64_BE,  4,  16,   8,      1,      G_BIG_ENDIAN,    nullptr},
+#else
+  {enc::RGBA16,             GST_VIDEO_FORMAT_UNKNOWN,    4,  16,   8,      1,      0,               nullptr},
+  {enc::BGRA16,             GST_VIDEO_FORMAT_UNKNOWN,    4,  16,   8,      1,      0,               nullptr},
+#endif
+
+  // packed 4:2:2, ROS yuv422 is UYVY byte order, newer sensor_msgs name YUY2 yuv422_yuy2
+  {enc::YUV422,             GST_VIDEO_FORMAT_UYVY,       2,  8,    2,      1,      0,               nullptr},
+  {"yuv422_yuy2",           GST_VIDEO_FORMAT_YUY2,       2,  8,    2,      1,      0,               nullptr},
+
+  // planar 4:2:0 has no sensor_msgs encoding, these follow the plane layout of image_msg_plane_layout()
+  // channels and stride describe the luma plane
+  {"nv12",                  GST_VIDEO_FORMAT_NV12,       1,  8,    1,      2,      0,               nullptr},
+  {"i420",                  GST_VIDEO_FORMAT_I420,       1,  8,    1,      3,      0,               nullptr},
+
+  // bayer mosaics are single channel, they don't have a video/x-raw format
+  {enc::BAYER_RGGB8,        GST_VIDEO_FORMAT_UNKNOWN,    1,  8,    1,      1,      0,               "rggb"},
+  {enc::BAYER_BGGR8,        GST_VIDEO_FORMAT_UNKNOWN,    1,  8,    1,      1,      0,               "bggr"},
+  {enc::BAYER_GBRG8,        GST_VIDEO_FORMAT_UNKNOWN,    1,  8,    1,      1,      0,               "gbrg"},
+  {enc::BAYER_GRBG8,        GST_VIDEO_FORMAT_UNKNOWN,    1,  8,    1,      1,      0,               "grbg"},
+  {enc::BAYER_RGGB16,       GST_VIDEO_FORMAT_UNKNOWN,    1,  16,   2,      1,      0,               "rggb16"},
+  {enc::BAYER_BGGR16,       GST_VIDEO_FORMAT_UNKNOWN,    1,  16,   2,      1,      0,               "bggr16"},
+  {enc::BAYER_GBRG16,       GST_VIDEO_FORMAT_UNKNOWN,    1,  16,   2,      1,      0,               "gbrg16"},
+  {enc::BAYER_GRBG16,       GST_VIDEO_FORMAT_UNKNOWN,    1,  16,   2,      1,      0,               "grbg16"},
+
+  // OpenCV matrix types, the channel order is not defined
+  {enc::TYPE_8UC1,          GST_VIDEO_FORMAT_GRAY8,      1,  8,    1,      1,      0,               nullptr},
+  {enc::TYPE_8UC2,          GST_VIDEO_FORMAT_UNKNOWN,    2,  8,    2,      1,      0,               nullptr},
+  {enc::TYPE_8UC3,          GST_VIDEO_FORMAT_UNKNOWN,    3,  8,    3,      1,      0,               nullptr},
+  {enc::TYPE_8UC4,          GST_VIDEO_FORMAT_UNKNOWN,    4,  8,    4,      1,      0,               nullptr},
+  {enc::TYPE_8SC1,          GST_VIDEO_FORMAT_UNKNOWN,    1,  8,    1,      1,      0,               nullptr},
+  {enc::TYPE_8SC2,          GST_VIDEO_FORMAT_UNKNOWN,    2,  8,    2,      1,      0,               nullptr},
+  {enc::TYPE_8SC3,          GST_VIDEO_FORMAT_UNKNOWN,    3,  8,    3,      1,      0,               nullptr},
+  {enc::TYPE_8SC4,          GST_VIDEO_FORMAT_UNKNOWN,    4,  8,    4,      1,      0,               nullptr},
+  {enc::TYPE_16UC1,         GST_VIDEO_FORMAT_GRAY16_LE,  1,  16,   2,      1,      G_LITTLE_ENDIAN, nullptr},
+  {enc::TYPE_16UC2,         GST_VIDEO_FORMAT_UNKNOWN,    2,  16,   4,      1,      0,               nullptr},
+  {enc::TYPE_16UC3,         GST_VIDEO_FORMAT_UNKNOWN,    3,  16,   6,      1,      0,               nullptr},
+  {enc::TYPE_16UC4,         GST_VIDEO_FORMAT_UNKNOWN,    4,  16,   8,      1,      0,               nullptr},
+  {enc::TYPE_16SC1,         GST_VIDEO_FORMAT_UNKNOWN,    1,  16,   2,      1,      0,               nullptr},
+  {enc::TYPE_16SC2,         GST_VIDEO_FORMAT_UNKNOWN,    2,  16,   4,      1,      0,               nullptr},
+  {enc::TYPE_16SC3,         GST_VIDEO_FORMAT_UNKNOWN,    3,  16,   6,      1,      0,               nullptr},
+  {enc::TYPE_16SC4,         GST_VIDEO_FORMAT_UNKNOWN,    4,  16,   8,      1,      0,               nullptr},
+  {enc::TYPE_32SC1,         GST_VIDEO_FORMAT_UNKNOWN,    1,  32,   4,      1,      0,               nullptr},
+  {enc::TYPE_32SC2,         GST_VIDEO_FORMAT_UNKNOWN,    2,  32,   8,      1,      0,               nullptr},
+  {enc::TYPE_32SC3,         GST_VIDEO_FORMAT_UNKNOWN,    3,  32,   12,     1,      0,               nullptr},
+  {enc::TYPE_32SC4,         GST_VIDEO_FORMAT_UNKNOWN,    4,  32,   16,     1,      0,               nullptr},
+  {enc::TYPE_32FC1,         GST_VIDEO_FORMAT_UNKNOWN,    1,  32,   4,      1,      0,               nullptr},
+  {enc::TYPE_32FC2,         GST_VIDEO_FORMAT_UNKNOWN,    2,  32,   8,      1,      0,               nullptr},
+  {enc::TYPE_32FC3,         GST_VIDEO_FORMAT_UNKNOWN,    3,  32,   12,     1,      0,               nullptr},
+  {enc::TYPE_32FC4,         GST_VIDEO_FORMAT_UNKNOWN,    4,  32,   16,     1,      0,               nullptr},
+  {enc::TYPE_64FC1,         GST_VIDEO_FORMAT_UNKNOWN,    1,  64,   8,      1,      0,               nullptr},
+  {enc::TYPE_64FC2,         GST_VIDEO_FORMAT_UNKNOWN,    2,  64,   16,     1,      0,               nullptr},
+  {enc::TYPE_64FC3,         GST_VIDEO_FORMAT_UNKNOWN,    3,  64,   24,     1,      0,               nullptr},
+  {enc::TYPE_64FC4,         GST_VIDEO_FORMAT_UNKNOWN,    4,  64,   32,     1,      0,               nullptr},
+};
+
+// both indexes are built once, on first use
+static const std::unordered_map<std::string, const image_format_info *> & image_formats_by_encoding()
+{
+  static const std::unordered_map<std::string, const image_format_info *> index = []{
+    std::unordered_map<std::string, const image_format_info *> map;
+    for(const image_format_info & info : image_formats)
+      map.emplace(info.encoding, &info);
+    return map;
+  }();
+  return index;
+}
+
+static const std::unordered_map<GstVideoFormat, const image_format_info *> & image_formats_by_format()
+{
+  static const std::unordered_map<GstVideoFormat, const image_format_info *> index = []{
+    std::unordered_map<GstVideoFormat, const image_format_info *> map;
+    for(const image_format_info & info : image_formats)
+      if(info.format != GST_VIDEO_FORMAT_UNKNOWN)
+        map.emplace(info.format, &info);  // emplace keeps the first encoding listed
+    return map;
+  }();
+  return index;
+}
+
+// 8 bit names are used as-is, 16 bit names are listed with both byte order suffixes
+static const std::unordered_map<std::string, const image_format_info *> & image_formats_by_bayer()
+{
+  static const std::unordered_map<std::string, const image_format_info *> index = []{
+    std::unordered_map<std::string, const image_format_info *> map;
+    for(const image_format_info & info : image_formats)
+    {
+      if(!info.bayer)
+        continue;
+      if(info.bit_depth > 8)
+      {
+        map.emplace(std::string(info.bayer) + "le", &info);
+        map.emplace(std::string(info.bayer) + "be", &info);
+      }
+      else
+        map.emplace(info.bayer, &info);
+    }
+    return map;
+  }();
+  return index;
+}
+
+const image_format_info * getImageFormatInfo(const std::string & encoding)
+{
+  auto it = image_formats_by_encoding().find(encoding);
+  return (it == image_formats_by_encoding().end()) ? nullptr : it->second;
+}
+
+const image_format_info * getImageFormatInfo(GstVideoFormat format)
+{
+  auto it = image_formats_by_format().find(format);
+  return (it == image_formats_by_format().end()) ? nullptr : it->second;
+}
+
+const image_format_info * getImageFormatInfoFromBayer(const std::string & bayer)
+{
+  auto it = image_formats_by_bayer().find(bayer);
+  return (it == image_formats_by_bayer().end()) ? nullptr : it->second;
+}
+
+/*
+ * Generate the pad template caps from the table,
+ * so a new row is all it takes for the elements to accept a format
+ */
+GstCaps * getImageMsgCaps()
+{
+  static const std::string caps_str = []{
+    std::string formats;
+    std::string bayer_formats;
+    for(const image_format_info & info : image_formats)
+    {
+      if(info.bayer)
+      {
+        bayer_formats += bayer_formats.empty() ? "{ " : ", ";
+        bayer_formats += info.bayer;
+        if(info.bit_depth > 8)
+          bayer_formats += std::string("le, ") + info.bayer + "be";
+      }
+      // list each format once, in table order so negotiation prefers the common ones
+      if((info.format == GST_VIDEO_FORMAT_UNKNOWN) || (getImageFormatInfo(info.format) != &info))
+        continue;
+      formats += formats.empty() ? "{ " : ", ";
+      formats += gst_video_format_to_string(info.format);
+    }
+    formats += " }";
+    bayer_formats += " }";
+    return std::string("video/x-raw, format = (string) ") + formats + ", " ROS_IMAGE_MSG_CAPS_FIELDS "; "
+      "video/x-bayer, format = (string) " + bayer_formats + ", " ROS_IMAGE_MSG_CAPS_FIELDS;
+  }();
+  return gst_caps_from_string(caps_str.c_str());
+}
+
 // convert between ROS and GST types, only fully transparent mappings
 GstVideoFormat getGstVideoFormat(const std::string & encoding)
 {
-  if (encoding == sensor_msgs::image_encodings::MONO8)  {return GST_VIDEO_FORMAT_GRAY8;}
-  if (encoding == sensor_msgs::image_encodings::MONO16) {return GST_VIDEO_FORMAT_GRAY16_LE;}
-  if (encoding == sensor_msgs::image_encodings::RGB8)   {return GST_VIDEO_FORMAT_RGB;}
-  if (encoding == sensor_msgs::image_encodings::BGR8)   {return GST_VIDEO_FORMAT_BGR;}
-  if (encoding == sensor_msgs::image_encodings::RGBA8)  {return GST_VIDEO_FORMAT_RGBA;}
-  if (encoding == sensor_msgs::image_encodings::BGRA8)  {return GST_VIDEO_FORMAT_BGRA;}
-  return GST_VIDEO_FORMAT_UNKNOWN;
+  const image_format_info * info = getImageFormatInfo(encoding);
+  return info ? info->format : GST_VIDEO_FORMAT_UNKNOWN;
 }
 
 std::string getRosEncoding(GstVideoFormat format)
 {
-  if (format == GST_VIDEO_FORMAT_GRAY8)     {return sensor_msgs::image_encodings::MONO8;}
-  if (format == GST_VIDEO_FORMAT_GRAY16_LE) {return sensor_msgs::image_encodings::MONO16;}
-  if (format == GST_VIDEO_FORMAT_RGB)       {return sensor_msgs::image_encodings::RGB8;}
-  if (format == GST_VIDEO_FORMAT_BGR)       {return sensor_msgs::image_encodings::BGR8;}
-  if (format == GST_VIDEO_FORMAT_RGBA)      {return sensor_msgs::image_encodings::RGBA8;}
-  if (format == GST_VIDEO_FORMAT_BGRA)      {return sensor_msgs::image_encodings::BGRA8;}
-  return "unknown";
+  const image_format_info * info = getImageFormatInfo(format);
+  return info ? info->encoding : "unknown";
 }
 
 
@@ -39,11 +214,108 @@ GstAudioFormat getGstAudioFormat(const std::string & encoding)
 {
   return gst_audio_format_from_string(encoding.c_str());
 }
+
+GstAudioFormat getGstAudioFormat(const std::string & encoding, gboolean is_bigendian)
+{
+  return audio_format_with_endianness(getGstAudioFormat(encoding), is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN);
+}
+
+GstAudioFormat audio_format_with_endianness(GstAudioFormat format, gint endianness)
+{
+  const GstAudioFormatInfo * finfo;
+
+  if(format == GST_AUDIO_FORMAT_UNKNOWN)
+    return format;
+  finfo = gst_audio_format_get_info(format);
+  if((GST_AUDIO_FORMAT_INFO_WIDTH(finfo) <= 8) || (GST_AUDIO_FORMAT_INFO_ENDIANNESS(finfo) == endianness))
+    return format;
+
+  if(GST_AUDIO_FORMAT_INFO_IS_FLOAT(finfo))
+  {
+    if(GST_AUDIO_FORMAT_INFO_WIDTH(finfo) == 32)
+      return (endianness == G_BIG_ENDIAN) ? GST_AUDIO_FORMAT_F32BE : GST_AUDIO_FORMAT_F32LE;
+    return (endianness == G_BIG_ENDIAN) ? GST_AUDIO_FORMAT_F64BE : GST_AUDIO_FORMAT_F64LE;
+  }
+  return gst_audio_format_build_integer(GST_AUDIO_FORMAT_INFO_IS_SIGNED(finfo), endianness,
+    GST_AUDIO_FORMAT_INFO_WIDTH(finfo), GST_AUDIO_FORMAT_INFO_DEPTH(finfo));
+}
+
+gboolean getGstAudioLayout(const std::string & layout, GstAudioLayout * audio_layout)
+{
+  if(layout == "interleaved")
+    *audio_layout = GST_AUDIO_LAYOUT_INTERLEAVED;
+  else if(layout == "non-interleaved")
+    *audio_layout = GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+  else
+    return FALSE;
+  return TRUE;
+}
+
 std::string getRosEncoding(GstAudioFormat format)
 {
   return std::string(gst_audio_format_to_string(format));
 }
 
+// CompactAudio FORMAT_ numbers, they are part of the message definition and must not change
+struct compact_audio_format
+{
+  uint8_t compact_format;
+  GstAudioFormat format;
+};
+
+static const compact_audio_format compact_audio_formats[] = {
+  {audio_msgs::msg::CompactAudio::FORMAT_S8, GST_AUDIO_FORMAT_S8},
+  {audio_msgs::msg::CompactAudio::FORMAT_U8, GST_AUDIO_FORMAT_U8},
+  {audio_msgs::msg::CompactAudio::FORMAT_S16LE, GST_AUDIO_FORMAT_S16LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S16BE, GST_AUDIO_FORMAT_S16BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U16LE, GST_AUDIO_FORMAT_U16LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U16BE, GST_AUDIO_FORMAT_U16BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S24_32LE, GST_AUDIO_FORMAT_S24_32LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S24_32BE, GST_AUDIO_FORMAT_S24_32BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U24_32LE, GST_AUDIO_FORMAT_U24_32LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U24_32BE, GST_AUDIO_FORMAT_U24_32BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S32LE, GST_AUDIO_FORMAT_S32LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S32BE, GST_AUDIO_FORMAT_S32BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U32LE, GST_AUDIO_FORMAT_U32LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U32BE, GST_AUDIO_FORMAT_U32BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S24LE, GST_AUDIO_FORMAT_S24LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S24BE, GST_AUDIO_FORMAT_S24BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U24LE, GST_AUDIO_FORMAT_U24LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U24BE, GST_AUDIO_FORMAT_U24BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S20LE, GST_AUDIO_FORMAT_S20LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S20BE, GST_AUDIO_FORMAT_S20BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U20LE, GST_AUDIO_FORMAT_U20LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U20BE, GST_AUDIO_FORMAT_U20BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S18LE, GST_AUDIO_FORMAT_S18LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_S18BE, GST_AUDIO_FORMAT_S18BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U18LE, GST_AUDIO_FORMAT_U18LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_U18BE, GST_AUDIO_FORMAT_U18BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_F32LE, GST_AUDIO_FORMAT_F32LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_F32BE, GST_AUDIO_FORMAT_F32BE},
+  {audio_msgs::msg::CompactAudio::FORMAT_F64LE, GST_AUDIO_FORMAT_F64LE},
+  {audio_msgs::msg::CompactAudio::FORMAT_F64BE, GST_AUDIO_FORMAT_F64BE},
+};
+
+uint8_t getCompactAudioFormat(GstAudioFormat format)
+{
+  for(const auto & entry : compact_audio_formats)
+  {
+    if(entry.format == format)
+      return entry.compact_format;
+  }
+  return audio_msgs::msg::CompactAudio::FORMAT_UNKNOWN;
+}
+
+GstAudioFormat getGstAudioFormat(uint8_t compact_format)
+{
+  for(const auto & entry : compact_audio_formats)
+  {
+    if(entry.compact_format == compact_format)
+      return entry.format;
+  }
+  return GST_AUDIO_FORMAT_UNKNOWN;
+}
+
 /*
  * Unpack a GstAudioInfo struct into ROS audio message metadata fields
  * this sets frames to zero, and does not fill the header.
@@ -62,6 +334,1063 @@ audio_msgs::msg::Audio gst_audio_info_to_audio_msg(GstAudioInfo * audio_info)
   return msg;
 }
 
+audio_msgs::msg::CompactAudio gst_audio_info_to_compact_audio_msg(GstAudioInfo * audio_info)
+{
+  audio_msgs::msg::CompactAudio msg = audio_msgs::msg::CompactAudio();
+  msg.channels = GST_AUDIO_INFO_CHANNELS(audio_info);
+  msg.sample_rate = GST_AUDIO_INFO_RATE(audio_info);
+  msg.format = getCompactAudioFormat(GST_AUDIO_INFO_FORMAT(audio_info));
+  msg.layout = (GST_AUDIO_INFO_LAYOUT(audio_info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED) ?
+    audio_msgs::msg::CompactAudio::LAYOUT_NON_INTERLEAVED : audio_msgs::msg::CompactAudio::LAYOUT_INTERLEAVED;
+  msg.frames = 0;
+  return msg;
+}
+
+// the stream description, without the header
+audio_msgs::msg::AudioInfo gst_audio_info_to_audio_info_msg(GstAudioInfo * audio_info)
+{
+  audio_msgs::msg::AudioInfo msg = audio_msgs::msg::AudioInfo();
+  msg.channels = GST_AUDIO_INFO_CHANNELS(audio_info);
+  msg.sample_rate = GST_AUDIO_INFO_RATE(audio_info);
+  msg.encoding = getRosEncoding(GST_AUDIO_INFO_FORMAT(audio_info));
+  msg.format = getCompactAudioFormat(GST_AUDIO_INFO_FORMAT(audio_info));
+  msg.is_bigendian = (GST_AUDIO_INFO_ENDIANNESS(audio_info) == G_BIG_ENDIAN);
+  msg.layout = (GST_AUDIO_INFO_LAYOUT(audio_info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED) ?
+    audio_msgs::msg::CompactAudio::LAYOUT_NON_INTERLEAVED : audio_msgs::msg::CompactAudio::LAYOUT_INTERLEAVED;
+  msg.step = GST_AUDIO_INFO_BPF(audio_info);
+  return msg;
+}
+
+/*
+ * bytes in one row of a plane, and rows in the plane, without padding
+ * taken from the first component stored in the plane
+ */
+static guint image_msg_plane_row_bytes(GstVideoInfo * video_info, guint plane)
+{
+  const GstVideoFormatInfo * finfo = video_info->finfo;
+  for(guint comp = 0; comp < GST_VIDEO_FORMAT_INFO_N_COMPONENTS(finfo); comp++)
+  {
+    if(GST_VIDEO_FORMAT_INFO_PLANE(finfo, comp) == plane)
+      return GST_VIDEO_FORMAT_INFO_SCALE_WIDTH(finfo, comp, GST_VIDEO_INFO_WIDTH(video_info))
+        * GST_VIDEO_FORMAT_INFO_PSTRIDE(finfo, comp);
+  }
+  return 0;
+}
+
+static guint image_msg_plane_rows(GstVideoInfo * video_info, guint plane)
+{
+  const GstVideoFormatInfo * finfo = video_info->finfo;
+  for(guint comp = 0; comp < GST_VIDEO_FORMAT_INFO_N_COMPONENTS(finfo); comp++)
+  {
+    if(GST_VIDEO_FORMAT_INFO_PLANE(finfo, comp) == plane)
+      return GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(finfo, comp, GST_VIDEO_INFO_HEIGHT(video_info));
+  }
+  return 0;
+}
+
+/*
+ * Unpack a GstVideoInfo struct into ROS image message metadata fields
+ * rows are assumed to be tightly packed, this does not fill the header.
+ */
+sensor_msgs::msg::Image gst_video_info_to_image_msg(GstVideoInfo * video_info)
+{
+  sensor_msgs::msg::Image msg = sensor_msgs::msg::Image();
+  msg.width = GST_VIDEO_INFO_WIDTH(video_info);
+  msg.height = GST_VIDEO_INFO_HEIGHT(video_info);
+  msg.encoding = getRosEncoding(GST_VIDEO_INFO_FORMAT(video_info));
+  msg.is_bigendian = !GST_VIDEO_FORMAT_INFO_IS_LE(video_info->finfo);
+  msg.step = image_msg_plane_row_bytes(video_info, 0);  //full row step size in bytes
+  return msg;
+}
+
+/*
+ * The _LE or _BE twin of a video format with multi-byte components,
+ * the format itself if it has none, so the caller byteswaps instead
+ */
+GstVideoFormat video_format_with_endianness(GstVideoFormat format, gint endianness)
+{
+  const GstVideoFormatInfo * finfo;
+  std::string name;
+  GstVideoFormat twin;
+
+  if(format == GST_VIDEO_FORMAT_UNKNOWN)
+    return format;
+  finfo = gst_video_format_get_info(format);
+  if(GST_VIDEO_FORMAT_INFO_BITS(finfo) <= 8)
+    return format;
+
+  name = gst_video_format_to_string(format);
+  if(g_str_has_suffix(name.c_str(), "_LE") && (endianness == G_BIG_ENDIAN))
+    name.replace(name.size() - 2, 2, "BE");
+  else if(g_str_has_suffix(name.c_str(), "_BE") && (endianness == G_LITTLE_ENDIAN))
+    name.replace(name.size() - 2, 2, "LE");
+  else
+    return format;
+  twin = gst_video_format_from_string(name.c_str());
+  return (twin == GST_VIDEO_FORMAT_UNKNOWN) ? format : twin;
+}
+
+// true if the 16 bit samples of a message are in the other byte order to the frame format
+gboolean image_msg_needs_byteswap(GstVideoInfo * video_info, gboolean is_bigendian)
+{
+  if(GST_VIDEO_FORMAT_INFO_BITS(video_info->finfo) != 16)
+    return FALSE;
+  return (is_bigendian ? TRUE : FALSE) == (GST_VIDEO_FORMAT_INFO_IS_LE(video_info->finfo) ? TRUE : FALSE);
+}
+
+/*
+ * Describe an encoding as a GstVideoInfo,
+ * bayer mosaics take the grey format of the same layout so sizes and strides stay valid
+ */
+gboolean image_msg_to_video_info(const std::string & encoding, guint width, guint height, gboolean is_bigendian, GstVideoInfo * video_info)
+{
+  const image_format_info * info = getImageFormatInfo(encoding);
+  GstVideoFormat format;
+
+  if(!info)
+    return FALSE;
+  if(info->bayer)
+    format = (info->bit_depth > 8) ?
+      (is_bigendian ? GST_VIDEO_FORMAT_GRAY16_BE : GST_VIDEO_FORMAT_GRAY16_LE) : GST_VIDEO_FORMAT_GRAY8;
+  else if(info->format == GST_VIDEO_FORMAT_UNKNOWN && getImageRowConversion(encoding, is_bigendian))
+    format = getImageRowConversion(encoding, is_bigendian)->format;  // converted by convert_msg_data_to_video_frame
+  else
+    format = video_format_with_endianness(info->format, is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN);
+  if(format == GST_VIDEO_FORMAT_UNKNOWN)
+    return FALSE;
+
+  gst_video_info_init(video_info);
+  gst_video_info_set_format(video_info, format, width, height);
+  return TRUE;
+}
+
+/*
+ * gst_video_info_from_caps, extended to video/x-bayer
+ * the ROS encoding is returned as well, since bayer can't be recovered from the grey format
+ */
+gboolean video_info_from_caps(GstVideoInfo * video_info, std::string * encoding, GstCaps * caps)
+{
+  GstStructure * structure = gst_caps_get_structure(caps, 0);
+
+  if(gst_structure_has_name(structure, "video/x-bayer"))
+  {
+    const gchar * bayer = gst_structure_get_string(structure, "format");
+    const image_format_info * info = bayer ? getImageFormatInfoFromBayer(bayer) : nullptr;
+    gint width, height, fps_n, fps_d;
+
+    if(!info || !gst_structure_get_int(structure, "width", &width) || !gst_structure_get_int(structure, "height", &height))
+      return FALSE;
+    if(!image_msg_to_video_info(info->encoding, width, height,
+        (info->bit_depth > 8) && g_str_has_suffix(bayer, "be"), video_info))
+      return FALSE;
+    if(gst_structure_get_fraction(structure, "framerate", &fps_n, &fps_d))
+    {
+      GST_VIDEO_INFO_FPS_N(video_info) = fps_n;
+      GST_VIDEO_INFO_FPS_D(video_info) = fps_d;
+    }
+    *encoding = info->encoding;
+    return TRUE;
+  }
+
+  if(!gst_video_info_from_caps(video_info, caps))
+    return FALSE;
+  *encoding = getRosEncoding(GST_VIDEO_INFO_FORMAT(video_info));
+  if(!getImageFormatInfo(GST_VIDEO_INFO_FORMAT(video_info)) && getImageRowConversion(GST_VIDEO_INFO_FORMAT(video_info)))
+    *encoding = getImageRowConversion(GST_VIDEO_INFO_FORMAT(video_info))->encoding;
+  return TRUE;
+}
+
+/*
+ * Copy an interleaved audio buffer into the message, count the frames,
+ * and carry the sequence number from the buffer offsets when upstream provides them
+ */
+void fill_audio_msg_data(audio_msgs::msg::Audio & msg, GstBuffer * buf, uint64_t * msg_seq_num)
+{
+  GstMapInfo info;
+
+  gst_buffer_map (buf, &info, GST_MAP_READ);
+  msg.data.assign(info.data, info.data+info.size);
+  msg.frames = (msg.step > 0) ? info.size/msg.step : 0;
+  gst_buffer_unmap (buf, &info);
+
+  set_audio_msg_seq_num(msg, buf, msg_seq_num);
+}
+
+template<typename MsgT>
+static void set_audio_msg_seq_num_impl(MsgT & msg, GstBuffer * buf, uint64_t * msg_seq_num)
+{
+  if(GST_BUFFER_OFFSET_IS_VALID(buf))
+  {
+    msg.seq_num = GST_BUFFER_OFFSET(buf);
+    if(GST_BUFFER_OFFSET_END_IS_VALID(buf))
+      *msg_seq_num = GST_BUFFER_OFFSET_END(buf);
+    else
+      *msg_seq_num = GST_BUFFER_OFFSET(buf) + msg.frames;
+  }
+  else
+  {
+    msg.seq_num = *msg_seq_num;
+    *msg_seq_num += msg.frames;
+  }
+}
+
+void set_audio_msg_seq_num(audio_msgs::msg::Audio & msg, GstBuffer * buf, uint64_t * msg_seq_num)
+{
+  set_audio_msg_seq_num_impl(msg, buf, msg_seq_num);
+}
+
+void set_audio_msg_seq_num(audio_msgs::msg::CompactAudio & msg, GstBuffer * buf, uint64_t * msg_seq_num)
+{
+  set_audio_msg_seq_num_impl(msg, buf, msg_seq_num);
+}
+
+// the same stream in another sample format and layout
+void audio_info_with_format(GstAudioInfo * audio_info, GstAudioFormat format, GstAudioLayout layout, GstAudioInfo * out_info)
+{
+  gst_audio_info_init(out_info);
+  gst_audio_info_set_format(out_info, format, GST_AUDIO_INFO_RATE(audio_info), GST_AUDIO_INFO_CHANNELS(audio_info),
+    audio_info->position);
+  out_info->layout = layout;
+}
+
+GstAudioConverter * audio_converter_new(GstAudioInfo * in_info, GstAudioInfo * out_info, GstAudioDitherMethod dither)
+{
+  return gst_audio_converter_new (GST_AUDIO_CONVERTER_FLAG_NONE, in_info, out_info,
+    gst_structure_new ("GstAudioConverter",
+      GST_AUDIO_CONVERTER_OPT_DITHER_METHOD, GST_TYPE_AUDIO_DITHER_METHOD, dither,
+      GST_AUDIO_CONVERTER_OPT_NOISE_SHAPING_METHOD, GST_TYPE_AUDIO_NOISE_SHAPING_METHOD, GST_AUDIO_NOISE_SHAPING_NONE,
+      NULL));
+}
+
+std::vector<gpointer> audio_msg_planes(GstAudioInfo * audio_info, const guint8 * data, gsize frames)
+{
+  std::vector<gpointer> planes;
+  audio_msg_planes(audio_info, data, frames, &planes);
+  return planes;
+}
+
+void audio_msg_planes(GstAudioInfo * audio_info, const guint8 * data, gsize frames, std::vector<gpointer> * planes)
+{
+  planes->clear();
+  if(GST_AUDIO_INFO_LAYOUT(audio_info) == GST_AUDIO_LAYOUT_INTERLEAVED)
+  {
+    planes->push_back((gpointer) data);
+    return;
+  }
+  for(gint c = 0; c < GST_AUDIO_INFO_CHANNELS(audio_info); c++)
+  {
+    planes->push_back((gpointer) (data + c * frames * GST_AUDIO_INFO_BPS(audio_info)));
+  }
+}
+
+// same format, so a plane is just moved between the layouts, packed widths are moved byte-wise
+static gboolean audio_change_layout(GstAudioInfo * in_info, gpointer * in, gpointer * out, gsize frames)
+{
+  guint channels = GST_AUDIO_INFO_CHANNELS(in_info);
+  guint bps = GST_AUDIO_INFO_BPS(in_info);
+  gboolean to_interleaved = (GST_AUDIO_INFO_LAYOUT(in_info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED);
+
+  switch(GST_AUDIO_INFO_WIDTH(in_info))
+  {
+    case 8:
+      if(to_interleaved) interleave_8((const guint8 * const *) in, (guint8 *) out[0], channels, frames);
+      else deinterleave_8((const guint8 *) in[0], (guint8 * const *) out, channels, frames);
+      return TRUE;
+    case 16:
+      if(to_interleaved) interleave_16((const guint16 * const *) in, (guint16 *) out[0], channels, frames);
+      else deinterleave_16((const guint16 *) in[0], (guint16 * const *) out, channels, frames);
+      return TRUE;
+    case 32:
+      if(to_interleaved) interleave_32((const guint32 * const *) in, (guint32 *) out[0], channels, frames);
+      else deinterleave_32((const guint32 *) in[0], (guint32 * const *) out, channels, frames);
+      return TRUE;
+    case 64:
+      if(to_interleaved) interleave_64((const guint64 * const *) in, (guint64 *) out[0], channels, frames);
+      else deinterleave_64((const guint64 *) in[0], (guint64 * const *) out, channels, frames);
+      return TRUE;
+    default:
+      if(bps == 0)
+        return FALSE;
+      if(to_interleaved) interleave_bytes((const guint8 * const *) in, (guint8 *) out[0], bps, channels, frames);
+      else deinterleave_bytes((const guint8 *) in[0], (guint8 * const *) out, bps, channels, frames);
+      return TRUE;
+  }
+}
+
+// same layout, the sample conversion is applied plane by plane, returns FALSE when there is no kernel for it
+static gboolean audio_convert_plane(GstAudioInfo * in_info, GstAudioInfo * out_info, const guint8 * in_data, guint8 * out_data, gsize samples)
+{
+  GstAudioFormat in_format = GST_AUDIO_INFO_FORMAT(in_info);
+  GstAudioFormat out_format = GST_AUDIO_INFO_FORMAT(out_info);
+
+  if(in_format == out_format)
+  {
+    memcpy(out_data, in_data, samples * GST_AUDIO_INFO_BPS(in_info));
+    return TRUE;
+  }
+
+  // same samples in the other byte order, message data and mapped buffers are aligned for whole samples
+  if(audio_format_with_endianness(in_format, GST_AUDIO_INFO_ENDIANNESS(out_info)) == out_format)
+  {
+    switch(GST_AUDIO_INFO_WIDTH(in_info))
+    {
+      case 16:
+        byteswap_copy_16((const guint16 *) in_data, (guint16 *) out_data, samples);
+        return TRUE;
+      case 24:
+        byteswap_copy_24(in_data, out_data, samples);
+        return TRUE;
+      case 32:
+        byteswap_copy_32((const guint32 *) in_data, (guint32 *) out_data, samples);
+        return TRUE;
+      case 64:
+        byteswap_copy_64((const guint64 *) in_data, (guint64 *) out_data, samples);
+        return TRUE;
+      default:
+        break;
+    }
+  }
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  // lossless S24LE unpacking and packing, the narrowing conversions go through the converter for dither
+  if((in_format == GST_AUDIO_FORMAT_S24LE) && (out_format == GST_AUDIO_FORMAT_S32LE))
+  {
+    unpack_s24le_to_s32(in_data, (gint32 *) out_data, samples);
+    return TRUE;
+  }
+  if((in_format == GST_AUDIO_FORMAT_S24LE) && (out_format == GST_AUDIO_FORMAT_S24_32LE))
+  {
+    unpack_s24le_to_s24_32(in_data, (gint32 *) out_data, samples);
+    return TRUE;
+  }
+  if((in_format == GST_AUDIO_FORMAT_S24_32LE) && (out_format == GST_AUDIO_FORMAT_S24LE))
+  {
+    pack_s24_32_to_s24le((const gint32 *) in_data, out_data, samples);
+    return TRUE;
+  }
+#endif
+
+  return FALSE;
+}
+
+gboolean audio_convert_samples(GstAudioConverter * converter, GstAudioInfo * in_info, GstAudioInfo * out_info,
+  gpointer * in, gpointer * out, gsize frames)
+{
+  if(GST_AUDIO_INFO_LAYOUT(in_info) == GST_AUDIO_INFO_LAYOUT(out_info))
+  {
+    gboolean interleaved = (GST_AUDIO_INFO_LAYOUT(in_info) == GST_AUDIO_LAYOUT_INTERLEAVED);
+    gint n_planes = interleaved ? 1 : GST_AUDIO_INFO_CHANNELS(in_info);
+    gsize samples = interleaved ? frames * GST_AUDIO_INFO_CHANNELS(in_info) : frames;
+    gint p;
+
+    for(p = 0; p < n_planes; p++)
+    {
+      if(!audio_convert_plane(in_info, out_info, (const guint8 *) in[p], (guint8 *) out[p], samples))
+        break;
+    }
+    // the kernels either handle every plane or none of them
+    if(p == n_planes)
+      return TRUE;
+  }
+  else if(GST_AUDIO_INFO_FORMAT(in_info) == GST_AUDIO_INFO_FORMAT(out_info))
+  {
+    if(audio_change_layout(in_info, in, out, frames))
+      return TRUE;
+  }
+
+  if(!converter)
+    return FALSE;
+  return gst_audio_converter_samples (converter, GST_AUDIO_CONVERTER_FLAG_NONE, in, frames, out, frames);
+}
+
+gboolean audio_buffer_to_msg_data(GstAudioConverter * converter, GstAudioInfo * in_info, GstAudioInfo * msg_info,
+  GstAudioBuffer * audio_buf, std::vector<uint8_t> & data, std::vector<gpointer> * msg_planes)
+{
+  gsize frames = audio_buf->n_samples;
+
+  data.resize(frames * GST_AUDIO_INFO_BPF(msg_info));
+  audio_msg_planes(msg_info, data.data(), frames, msg_planes);
+  return audio_convert_samples(converter, in_info, msg_info, audio_buf->planes, msg_planes->data(), frames);
+}
+
+gboolean parse_channel_list(const std::string & list, std::vector<guint> * channels)
+{
+  gchar ** items = g_strsplit(list.c_str(), ",", -1);
+  gboolean ok = TRUE;
+
+  channels->clear();
+  for(gchar ** item = items; ok && *item; item++)
+  {
+    guint64 first, last;
+    gchar * end;
+
+    first = g_ascii_strtoull(*item, &end, 10);
+    last = first;
+    if(*end == '-')
+      last = g_ascii_strtoull(end + 1, &end, 10);
+    ok = (end != *item) && (*end == '\0') && (first <= last);
+    for(guint64 c = first; ok && (c <= last); c++)
+      channels->push_back((guint) c);
+  }
+  g_strfreev(items);
+  return ok && !channels->empty();
+}
+
+void audio_info_with_channels(GstAudioInfo * audio_info, const std::vector<guint> & channels, GstAudioInfo * out_info)
+{
+  GstAudioChannelPosition position[64];
+  guint64 taken = 0;
+  gboolean positioned = !GST_AUDIO_INFO_IS_UNPOSITIONED(audio_info) && (channels.size() <= 64);
+
+  // a channel listed twice would repeat its position, so the selection goes unpositioned
+  for(guint k = 0; positioned && (k < channels.size()); k++)
+  {
+    position[k] = audio_info->position[channels[k]];
+    positioned = !(taken & (G_GUINT64_CONSTANT(1) << channels[k]));
+    taken |= G_GUINT64_CONSTANT(1) << channels[k];
+  }
+  if(positioned && (channels.size() == 1))
+    position[0] = GST_AUDIO_CHANNEL_POSITION_MONO;
+
+  gst_audio_info_init(out_info);
+  gst_audio_info_set_format(out_info, GST_AUDIO_INFO_FORMAT(audio_info), GST_AUDIO_INFO_RATE(audio_info), channels.size(),
+    positioned ? position : NULL);
+  out_info->layout = audio_info->layout;
+}
+
+void audio_gather_channels(GstAudioInfo * in_info, const guint8 * in, const std::vector<guint> & channels,
+  guint8 * const * dst, const guint * dst_stride, gsize frames)
+{
+  guint in_channels = GST_AUDIO_INFO_CHANNELS(in_info);
+  guint n = channels.size();
+
+  // the sample width is all that matters, so the word sized kernels cover every format that isn't packed
+  switch(GST_AUDIO_INFO_WIDTH(in_info))
+  {
+    case 8:
+      gather_channels_8(in, in_channels, channels.data(), dst, dst_stride, n, frames);
+      break;
+    case 16:
+      gather_channels_16((const guint16 *) in, in_channels, channels.data(), (guint16 * const *) dst, dst_stride, n, frames);
+      break;
+    case 32:
+      gather_channels_32((const guint32 *) in, in_channels, channels.data(), (guint32 * const *) dst, dst_stride, n, frames);
+      break;
+    case 64:
+      gather_channels_64((const guint64 *) in, in_channels, channels.data(), (guint64 * const *) dst, dst_stride, n, frames);
+      break;
+    default:
+      gather_channels_bytes(in, GST_AUDIO_INFO_BPS(in_info), in_channels, channels.data(), dst, dst_stride, n, frames);
+      break;
+  }
+}
+
+/*
+ * Work out where each plane sits in an image message, returns the size of the frame
+ */
+gsize image_msg_plane_layout(GstVideoInfo * video_info, guint step, gsize offset[GST_VIDEO_MAX_PLANES], gint stride[GST_VIDEO_MAX_PLANES])
+{
+  gsize size = 0;
+  for(guint plane = 0; plane < GST_VIDEO_INFO_N_PLANES(video_info); plane++)
+  {
+    offset[plane] = size;
+    stride[plane] = (plane == 0) ? step : image_msg_plane_row_bytes(video_info, plane);
+    size += (gsize) stride[plane] * image_msg_plane_rows(video_info, plane);
+  }
+  return size;
+}
+
+void set_image_msg_layout(GstVideoInfo * video_info, guint step)
+{
+  video_info->size = image_msg_plane_layout(video_info, step, video_info->offset, video_info->stride);
+}
+
+gint video_buffer_stride(GstVideoInfo * video_info, GstBuffer * buf)
+{
+  GstVideoMeta * meta = gst_buffer_get_video_meta(buf);
+  return meta ? meta->stride[0] : GST_VIDEO_INFO_PLANE_STRIDE(video_info, 0);
+}
+
+gboolean image_msg_layout_matches(GstVideoInfo * video_info, guint step)
+{
+  gsize offset[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+  gsize size = image_msg_plane_layout(video_info, step, offset, stride);
+
+  for(guint plane = 0; plane < GST_VIDEO_INFO_N_PLANES(video_info); plane++)
+  {
+    if((offset[plane] != GST_VIDEO_INFO_PLANE_OFFSET(video_info, plane)) ||
+      (stride[plane] != GST_VIDEO_INFO_PLANE_STRIDE(video_info, plane)))
+      return FALSE;
+  }
+  return size == GST_VIDEO_INFO_SIZE(video_info);
+}
+
+/*
+ * copy rows between two plane layouts, whole planes go in one memcpy when the strides agree
+ * the padding after the last row is not copied, it may not exist in the source
+ */
+static void copy_plane(guint8 * dest, gint dest_stride, const guint8 * src, gint src_stride, guint row_bytes, guint rows)
+{
+  if(rows == 0)
+    return;
+
+  if(dest_stride == src_stride)
+  {
+    memcpy(dest, src, (gsize) dest_stride * (rows - 1) + row_bytes);
+    return;
+  }
+
+  for(guint row = 0; row < rows; row++)
+    memcpy(dest + (gsize) row * dest_stride, src + (gsize) row * src_stride, row_bytes);
+}
+
+gboolean copy_video_frame_to_msg_data(GstVideoInfo * video_info, GstBuffer * buf, guint8 * data, guint step)
+{
+  GstVideoFrame frame;
+  gsize offset[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+
+  if(!gst_video_frame_map(&frame, video_info, buf, GST_MAP_READ))
+    return FALSE;
+
+  image_msg_plane_layout(video_info, step, offset, stride);
+  for(guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&frame); plane++)
+  {
+    copy_plane(data + offset[plane], stride[plane],
+      (const guint8 *) GST_VIDEO_FRAME_PLANE_DATA(&frame, plane), GST_VIDEO_FRAME_PLANE_STRIDE(&frame, plane),
+      image_msg_plane_row_bytes(video_info, plane), image_msg_plane_rows(video_info, plane));
+  }
+
+  gst_video_frame_unmap(&frame);
+  return TRUE;
+}
+
+gboolean copy_msg_data_to_video_frame(GstVideoInfo * video_info, const guint8 * data, guint step, GstBuffer * buf)
+{
+  GstVideoFrame frame;
+  gsize offset[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+
+  if(!gst_video_frame_map(&frame, video_info, buf, GST_MAP_WRITE))
+    return FALSE;
+
+  image_msg_plane_layout(video_info, step, offset, stride);
+  for(guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&frame); plane++)
+  {
+    copy_plane((guint8 *) GST_VIDEO_FRAME_PLANE_DATA(&frame, plane), GST_VIDEO_FRAME_PLANE_STRIDE(&frame, plane),
+      data + offset[plane], stride[plane],
+      image_msg_plane_row_bytes(video_info, plane), image_msg_plane_rows(video_info, plane));
+  }
+
+  gst_video_frame_unmap(&frame);
+  return TRUE;
+}
+
+// copy_msg_data_to_video_frame, reversing the byte order of each 16 bit sample
+gboolean copy_msg_data_to_video_frame_swapped(GstVideoInfo * video_info, const guint8 * data, guint step, GstBuffer * buf)
+{
+  GstVideoFrame frame;
+  gsize offset[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+
+  if(!gst_video_frame_map(&frame, video_info, buf, GST_MAP_WRITE))
+    return FALSE;
+
+  image_msg_plane_layout(video_info, step, offset, stride);
+  for(guint plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&frame); plane++)
+  {
+    guint8 * dst = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA(&frame, plane);
+    gsize row_bytes = image_msg_plane_row_bytes(video_info, plane);
+    for(guint row = 0; row < image_msg_plane_rows(video_info, plane); row++)
+    {
+      byteswap_copy_16((const guint16 *) (data + offset[plane] + row * stride[plane]),
+        (guint16 *) (dst + row * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, plane)), row_bytes / 2);
+    }
+  }
+
+  gst_video_frame_unmap(&frame);
+  return TRUE;
+}
+
+// row kernels with the pointer types of the conversion table
+static void depth_row_to_msg(const guint8 * frame_row, guint8 * msg_row, guint width)
+{
+  depth_mm_to_m((const guint16 *) frame_row, (float *) msg_row, width);
+}
+
+static void depth_row_from_msg(const guint8 * msg_row, guint8 * frame_row, guint width)
+{
+  depth_m_to_mm((const float *) msg_row, (guint16 *) frame_row, width);
+}
+
+static void depth_row_from_msg_swapped(const guint8 * msg_row, guint8 * frame_row, guint width)
+{
+  depth_m_to_mm_swapped((const guint32 *) msg_row, (guint16 *) frame_row, width);
+}
+
+static void rgb16_row_to_msg(const guint8 * frame_row, guint8 * msg_row, guint width)
+{
+  rgba64_to_rgb48((const guint16 *) frame_row, (guint16 *) msg_row, width);
+}
+
+static void rgb16_row_from_msg(const guint8 * msg_row, guint8 * frame_row, guint width)
+{
+  rgb48_to_rgba64((const guint16 *) msg_row, (guint16 *) frame_row, width);
+}
+
+static void rgb16_row_to_msg_swapped(const guint8 * frame_row, guint8 * msg_row, guint width)
+{
+  rgba64_to_rgb48_swapped((const guint16 *) frame_row, (guint16 *) msg_row, width);
+}
+
+static void rgb16_row_from_msg_swapped(const guint8 * msg_row, guint8 * frame_row, guint width)
+{
+  rgb48_to_rgba64_swapped((const guint16 *) msg_row, (guint16 *) frame_row, width);
+}
+
+static void gray10_row_to_msg(const guint8 * frame_row, guint8 * msg_row, guint width)
+{
+  unpack_gray10_le32_to_16((const guint32 *) frame_row, (guint16 *) msg_row, width);
+}
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define GST_BRIDGE_GRAY16_NATIVE GST_VIDEO_FORMAT_GRAY16_LE
+#define GST_BRIDGE_OTHER_ENDIAN G_BIG_ENDIAN
+#else
+#define GST_BRIDGE_GRAY16_NATIVE GST_VIDEO_FORMAT_GRAY16_BE
+#define GST_BRIDGE_OTHER_ENDIAN G_LITTLE_ENDIAN
+#endif
+
+/*
+ * Encodings and formats that convert row by row, see gst_bridge.h
+ * the first row listed for an encoding and message byte order carries it from ROS to GST
+ */
+static const image_row_conversion image_row_conversions[] =
+{
+  // encoding        format                        msg stride  msg endianness           to_msg                     from_msg
+  {enc::TYPE_32FC1,  GST_BRIDGE_GRAY16_NATIVE,     4,          G_BYTE_ORDER,            depth_row_to_msg,          depth_row_from_msg},
+  {enc::TYPE_32FC1,  GST_BRIDGE_GRAY16_NATIVE,     4,          GST_BRIDGE_OTHER_ENDIAN, nullptr,                   depth_row_from_msg_swapped},
+#if GST_CHECK_VERSION(1, 20, 0)
+  {enc::RGB16,       GST_VIDEO_FORMAT_RGBA64_LE,   6,          G_LITTLE_ENDIAN,         rgb16_row_to_msg,          rgb16_row_from_msg},
+  {enc::RGB16,       GST_VIDEO_FORMAT_RGBA64_BE,   6,          G_BIG_ENDIAN,            rgb16_row_to_msg,          rgb16_row_from_msg},
+  {enc::RGB16,       GST_VIDEO_FORMAT_RGBA64_LE,   6,          G_BIG_ENDIAN,            rgb16_row_to_msg_swapped,  rgb16_row_from_msg_swapped},
+  {enc::RGB16,       GST_VIDEO_FORMAT_RGBA64_BE,   6,          G_LITTLE_ENDIAN,         rgb16_row_to_msg_swapped,  rgb16_row_from_msg_swapped},
+  {enc::BGR16,       GST_VIDEO_FORMAT_BGRA64_LE,   6,          G_LITTLE_ENDIAN,         rgb16_row_to_msg,          rgb16_row_from_msg},
+  {enc::BGR16,       GST_VIDEO_FORMAT_BGRA64_BE,   6,          G_BIG_ENDIAN,            rgb16_row_to_msg,          rgb16_row_from_msg},
+  {enc::BGR16,       GST_VIDEO_FORMAT_BGRA64_LE,   6,          G_BIG_ENDIAN,            rgb16_row_to_msg_swapped,  rgb16_row_from_msg_swapped},
+  {enc::BGR16,       GST_VIDEO_FORMAT_BGRA64_BE,   6,          G_LITTLE_ENDIAN,         rgb16_row_to_msg_swapped,  rgb16_row_from_msg_swapped},
+#endif
+  {enc::MONO16,      GST_VIDEO_FORMAT_GRAY10_LE32, 2,          G_BYTE_ORDER,            gray10_row_to_msg,         nullptr},
+};
+
+static gboolean row_conversion_is_bigendian(const image_row_conversion & conv)
+{
+  return conv.msg_endianness == G_BIG_ENDIAN;
+}
+
+const image_row_conversion * getImageRowConversion(const std::string & encoding, GstVideoFormat format, gboolean is_bigendian)
+{
+  for(const image_row_conversion & conv : image_row_conversions)
+    if((conv.format == format) && (encoding == conv.encoding) && (row_conversion_is_bigendian(conv) == !!is_bigendian))
+      return &conv;
+  return nullptr;
+}
+
+const image_row_conversion * getImageRowConversion(const std::string & encoding, gboolean is_bigendian)
+{
+  for(const image_row_conversion & conv : image_row_conversions)
+    if(conv.from_msg && (encoding == conv.encoding) && (row_conversion_is_bigendian(conv) == !!is_bigendian))
+      return &conv;
+  return nullptr;
+}
+
+const image_row_conversion * getImageRowConversion(GstVideoFormat format)
+{
+  for(const image_row_conversion & conv : image_row_conversions)
+    if(conv.format == format)
+      return &conv;
+  return nullptr;
+}
+
+// the frame to the message, one kernel call per row
+gboolean convert_video_frame_to_msg_data(const image_row_conversion * conv, GstVideoInfo * video_info, GstBuffer * buf, guint8 * data, guint step)
+{
+  GstVideoFrame frame;
+  guint width = GST_VIDEO_INFO_WIDTH(video_info);
+
+  if(!gst_video_frame_map(&frame, video_info, buf, GST_MAP_READ))
+    return FALSE;
+
+  for(guint row = 0; row < (guint) GST_VIDEO_INFO_HEIGHT(video_info); row++)
+  {
+    conv->to_msg((const guint8 *) GST_VIDEO_FRAME_PLANE_DATA(&frame, 0) + row * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0),
+      data + row * step, width);
+  }
+
+  gst_video_frame_unmap(&frame);
+  return TRUE;
+}
+
+// the message to the frame, one kernel call per row
+gboolean convert_msg_data_to_video_frame(const image_row_conversion * conv, GstVideoInfo * video_info, const guint8 * data, guint step, GstBuffer * buf)
+{
+  GstVideoFrame frame;
+  guint width = GST_VIDEO_INFO_WIDTH(video_info);
+
+  if(!conv->from_msg || !gst_video_frame_map(&frame, video_info, buf, GST_MAP_WRITE))
+    return FALSE;
+
+  for(guint row = 0; row < (guint) GST_VIDEO_INFO_HEIGHT(video_info); row++)
+  {
+    conv->from_msg(data + row * step,
+      (guint8 *) GST_VIDEO_FRAME_PLANE_DATA(&frame, 0) + row * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0), width);
+  }
+
+  gst_video_frame_unmap(&frame);
+  return TRUE;
+}
+
+/*
+ * Copy a raw video frame into the message, plane by plane
+ * msg.step must already be set, usually by gst_video_info_to_image_msg
+ */
+gboolean fill_image_msg_data(sensor_msgs::msg::Image & msg, GstVideoInfo * video_info, GstBuffer * buf)
+{
+  gsize offset[GST_VIDEO_MAX_PLANES];
+  gint stride[GST_VIDEO_MAX_PLANES];
+
+  msg.data.resize(image_msg_plane_layout(video_info, msg.step, offset, stride));
+  return copy_video_frame_to_msg_data(video_info, buf, msg.data.data(), msg.step);
+}
+
+/*
+ * One frame into the message the way rosimagesink renders it, msg.step must already be set.
+ * The converter writes into msg.data through convert_buf, which wraps it on the first frame,
+ * the size is fixed by the caps so the storage stays put until the caller drops the wrapper.
+ */
+gboolean image_buffer_to_msg_data(GstVideoConverter * converter, GstVideoInfo * convert_info, GstBuffer ** convert_buf,
+  const image_row_conversion * conv, GstVideoInfo * video_info, GstBuffer * buf, sensor_msgs::msg::Image & msg)
+{
+  if(converter)
+  {
+    GstVideoFrame in_frame, out_frame;
+    gboolean ret = FALSE;
+
+    if(!*convert_buf)
+    {
+      msg.data.resize(GST_VIDEO_INFO_SIZE(convert_info));
+      *convert_buf = gst_buffer_new_wrapped_full ((GstMemoryFlags) 0, msg.data.data(), msg.data.size(), 0, msg.data.size(), NULL, NULL);
+    }
+
+    if(gst_video_frame_map(&in_frame, video_info, buf, GST_MAP_READ))
+    {
+      if(gst_video_frame_map(&out_frame, convert_info, *convert_buf, GST_MAP_WRITE))
+      {
+        gst_video_converter_frame(converter, &in_frame, &out_frame);
+        gst_video_frame_unmap(&out_frame);
+        ret = TRUE;
+      }
+      gst_video_frame_unmap(&in_frame);
+    }
+    return ret;
+  }
+
+  if(conv)
+  {
+    msg.data.resize(msg.step * msg.height);
+    return convert_video_frame_to_msg_data(conv, video_info, buf, msg.data.data(), msg.step);
+  }
+
+  return fill_image_msg_data(msg, video_info, buf);
+}
+
+/*
+ * Build raw video caps from the metadata of an image message
+ * framerate is not known from a single message and is left for fixation
+ */
+GstCaps * image_msg_to_caps(const sensor_msgs::msg::Image & msg)
+{
+  return image_msg_to_caps(msg.encoding, msg.width, msg.height, msg.is_bigendian);
+}
+
+GstCaps * image_msg_to_caps(const std::string & encoding, guint width, guint height, gboolean is_bigendian)
+{
+  const image_format_info * info = getImageFormatInfo(encoding);
+  if(!info)
+    return gst_caps_new_empty();
+
+  if(info->bayer)
+  {
+    std::string bayer = info->bayer;
+    if(info->bit_depth > 8)
+      bayer += is_bigendian ? "be" : "le";
+    return gst_caps_new_simple ("video/x-bayer",
+        "format", G_TYPE_STRING, bayer.c_str(),
+        "height", G_TYPE_INT, height,
+        "width", G_TYPE_INT, width,
+        NULL);
+  }
+
+  GstVideoInfo video_info;
+  if(!image_msg_to_video_info(encoding, width, height, is_bigendian, &video_info))
+    return gst_caps_new_empty();
+
+  return gst_caps_new_simple ("video/x-raw",
+      "format", G_TYPE_STRING, GST_VIDEO_INFO_NAME(&video_info),
+      "height", G_TYPE_INT, height,
+      "width", G_TYPE_INT, width,
+      NULL);
+}
+
+// codec names in CompressedImage format strings, and the caps of their encoded frames
+static const struct
+{
+  const char * format;
+  const char * media_type;
+} compressed_image_formats[] =
+{
+  {"jpeg",  "image/jpeg"},
+  {"png",   "image/png"},
+};
+
+std::string getCompressedImageFormat(GstCaps * caps)
+{
+  GstStructure * structure = gst_caps_get_structure(caps, 0);
+
+  for(const auto & entry : compressed_image_formats)
+    if(gst_structure_has_name(structure, entry.media_type))
+      return entry.format;
+  return "";
+}
+
+GstCaps * compressed_image_format_to_caps(const std::string & format)
+{
+  gchar * lower = g_ascii_strdown(format.c_str(), -1);
+  GstCaps * caps = nullptr;
+
+  // compressed_depth_image_transport prefixes its PNG with a depth quantization header, it isn't a plain image/png
+  if(strstr(lower, "compresseddepth"))
+  {
+    g_free(lower);
+    return gst_caps_new_empty();
+  }
+
+  for(const auto & entry : compressed_image_formats)
+  {
+    if(strstr(lower, entry.format))
+    {
+      caps = gst_caps_new_empty_simple(entry.media_type);
+      break;
+    }
+  }
+  g_free(lower);
+  return caps ? caps : gst_caps_new_empty();
+}
+
+std::vector<std::pair<gsize, gsize>> byte_stream_nal_units(const guint8 * data, gsize size)
+{
+  std::vector<std::pair<gsize, gsize>> units;
+  gsize start = 0;
+  gboolean in_unit = FALSE;
+
+  for(gsize i = 0; i + 2 < size; i++)
+  {
+    if((data[i] != 0) || (data[i + 1] != 0) || (data[i + 2] != 1))
+      continue;
+    if(in_unit)
+    {
+      // the zero before a four byte start code belongs to the start code
+      gsize end = ((i > start) && (data[i - 1] == 0)) ? i - 1 : i;
+      units.emplace_back(start, end - start);
+    }
+    start = i + 3;
+    in_unit = TRUE;
+    i += 2;
+  }
+  if(in_unit && (start < size))
+    units.emplace_back(start, size - start);
+  return units;
+}
+
+guint nal_unit_type(const guint8 * nal, gboolean h265)
+{
+  return h265 ? ((nal[0] >> 1) & 0x3f) : (nal[0] & 0x1f);
+}
+
+gboolean is_parameter_set_nal(guint type, gboolean h265)
+{
+  if(h265)
+    return (type >= 32) && (type <= 34);  // VPS, SPS, PPS
+  return (type == 7) || (type == 8);      // SPS, PPS
+}
+
+/*
+ * Pack ROS audio message metadata into a GstAudioInfo struct
+ * the inverse of gst_audio_info_to_audio_msg
+ */
+gboolean audio_msg_to_gst_audio_info(const audio_msgs::msg::Audio & msg, GstAudioInfo * audio_info)
+{
+  GstAudioFormat format = getGstAudioFormat(msg.encoding, msg.is_bigendian);
+  if(format == GST_AUDIO_FORMAT_UNKNOWN)
+    return FALSE;
+
+  gst_audio_info_init(audio_info);
+  gst_audio_info_set_format(audio_info, format, msg.sample_rate, msg.channels, NULL);
+  if(msg.layout == audio_msgs::msg::Audio::LAYOUT_NON_INTERLEAVED)
+    audio_info->layout = GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+
+  return ((uint32_t)GST_AUDIO_INFO_BPF(audio_info) == msg.step);
+}
+
+gboolean compact_audio_msg_to_gst_audio_info(const audio_msgs::msg::CompactAudio & msg, GstAudioInfo * audio_info)
+{
+  GstAudioFormat format = getGstAudioFormat(msg.format);
+  if((format == GST_AUDIO_FORMAT_UNKNOWN) || (msg.channels == 0))
+    return FALSE;
+
+  gst_audio_info_init(audio_info);
+  gst_audio_info_set_format(audio_info, format, msg.sample_rate, msg.channels, NULL);
+  if(msg.layout == audio_msgs::msg::CompactAudio::LAYOUT_NON_INTERLEAVED)
+    audio_info->layout = GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+
+  return TRUE;
+}
+
+// headroom for the CDR header and the non-data message fields
+#define GST_BRIDGE_SERIALIZED_OVERHEAD 256
+
+/*
+ * Serialize into a buffer sized for the payload up front,
+ * the rmw layer would otherwise grow it a few times for every large image
+ */
+template<typename MsgT>
+static std::shared_ptr<rcutils_uint8_array_t> serialize_msg_impl(const MsgT & msg)
+{
+  auto serialized = std::shared_ptr<rcutils_uint8_array_t>(
+    new rcutils_uint8_array_t,
+    [](rcutils_uint8_array_t * array) {
+      rcutils_uint8_array_fini(array);
+      delete array;
+    });
+  *serialized = rcutils_get_zero_initialized_uint8_array();
+  rcutils_allocator_t allocator = rcutils_get_default_allocator();
+
+  if(RCUTILS_RET_OK != rcutils_uint8_array_init(serialized.get(),
+      msg.data.size() + GST_BRIDGE_SERIALIZED_OVERHEAD, &allocator))
+    return nullptr;
+
+  if(RMW_RET_OK != rmw_serialize(&msg,
+      rosidl_typesupport_cpp::get_message_type_support_handle<MsgT>(),
+      serialized.get()))
+    return nullptr;
+
+  return serialized;
+}
+
+std::shared_ptr<rcutils_uint8_array_t> serialize_msg(const sensor_msgs::msg::Image & msg)
+{
+  return serialize_msg_impl(msg);
+}
+
+std::shared_ptr<rcutils_uint8_array_t> serialize_msg(const audio_msgs::msg::Audio & msg)
+{
+  return serialize_msg_impl(msg);
+}
+
+
+void timestamp_filter_init(timestamp_filter * filter, GstClockTime max_deviation, gdouble gain, guint settle_count)
+{
+  filter->max_deviation = max_deviation;
+  filter->gain = CLAMP(gain, 0.0, 1.0);
+  filter->settle_count = settle_count;
+  timestamp_filter_reset(filter);
+}
+
+void timestamp_filter_reset(timestamp_filter * filter)
+{
+  filter->period = 0.0;
+  filter->last_in = GST_CLOCK_TIME_NONE;
+  filter->last_out = GST_CLOCK_TIME_NONE;
+  filter->count = 0;
+}
+
+/*
+ * Track the frame period from single-frame intervals, predict the next stamp from the last output,
+ * then pull the prediction toward the raw stamp.
+ * Gaps from dropped frames are absorbed by predicting a whole number of periods ahead.
+ * Stamps are returned unchanged until the period estimate settles.
+ */
+GstClockTime timestamp_filter_update(timestamp_filter * filter, GstClockTime stamp)
+{
+  if(!GST_CLOCK_TIME_IS_VALID(stamp))
+    return stamp;
+
+  if(!GST_CLOCK_TIME_IS_VALID(filter->last_in) || (stamp <= filter->last_in))
+  {
+    // first stamp, or the source went backwards; start over
+    timestamp_filter_reset(filter);
+    filter->last_in = stamp;
+    filter->last_out = stamp;
+    return stamp;
+  }
+
+  gdouble interval = (gdouble)(stamp - filter->last_in);
+  filter->last_in = stamp;
+
+  gdouble frames = 1.0;
+  if(filter->period <= 0.0)
+  {
+    filter->period = interval;
+  }
+  else
+  {
+    frames = MAX(1.0, std::round(interval / filter->period));
+    if(frames == 1.0)
+      filter->period += filter->gain * (interval - filter->period);
+  }
+  filter->count++;
+
+  if(filter->count < filter->settle_count)
+  {
+    filter->last_out = stamp;
+    return stamp;
+  }
+
+  gdouble predicted = (gdouble)filter->last_out + frames * filter->period;
+  gdouble smoothed = predicted + filter->gain * ((gdouble)stamp - predicted);
+
+  // keep the output monotonic and within max_deviation of the stamp, in integer nanoseconds
+  // since doubles can't step a stamp by 1ns; if the two bounds cross, eg max_deviation was lowered, the stamp wins
+  GstClockTime lower = (stamp > filter->max_deviation) ? stamp - filter->max_deviation : 0;
+  GstClockTime upper = stamp + filter->max_deviation;
+  lower = MAX(lower, filter->last_out + 1);
+  if(lower > upper)
+  {
+    timestamp_filter_reset(filter);
+    filter->last_in = stamp;
+    filter->last_out = stamp;
+    return stamp;
+  }
+
+  GstClockTime out = (GstClockTime)MAX(smoothed, 0.0);
+  out = CLAMP(out, lower, upper);
+  filter->last_out = out;
+  return out;
+}
+
+/*
+ * report the estimated frame rate once the period has settled
+ */
+gboolean timestamp_filter_get_framerate(timestamp_filter * filter, gint * fps_n, gint * fps_d)
+{
+  if((filter->count < filter->settle_count) || (filter->period <= 0.0))
+    return FALSE;
+
+  gst_util_double_to_fraction((gdouble)GST_SECOND / filter->period, fps_n, fps_d);
+  return TRUE;
+}
+
 
 }  //namespace gst_bridge
 
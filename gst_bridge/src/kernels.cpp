@@ -0,0 +1,322 @@
+#include <gst_bridge/kernels.h>
+#include <cstring>
+#include <limits>
+
+namespace gst_bridge
+{
+
+static inline guint16 m_to_mm(float m)
+{
+  float mm = m * 1000.0f + 0.5f;
+  mm = (mm >= 0.0f) ? mm : 0.0f;          // also catches NaN
+  mm = (mm <= 65535.0f) ? mm : 65535.0f;  // also catches +inf
+  return (guint16) mm;
+}
+
+void depth_m_to_mm(const float * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[i] = m_to_mm(src[i]);
+  }
+}
+
+void depth_m_to_mm_swapped(const guint32 * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    guint32 w = GUINT32_SWAP_LE_BE(src[i]);
+    float m;
+    memcpy(&m, &w, sizeof(m));
+    dst[i] = m_to_mm(m);
+  }
+}
+
+void depth_mm_to_m(const guint16 * __restrict__ src, float * __restrict__ dst, gsize n)
+{
+  const float invalid = std::numeric_limits<float>::quiet_NaN();
+  for(gsize i = 0; i < n; i++)
+  {
+    // convert unconditionally, so the select doesn't guard the multiply and the loop stays branch free
+    float m = src[i] * 0.001f;
+    dst[i] = (m > 0.0f) ? m : invalid;
+  }
+}
+
+static inline guint16 gray10_to_16(guint32 v)
+{
+  return (guint16) ((v << 6) | (v >> 4));
+}
+
+void unpack_gray10_le32_to_16(const guint32 * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  gsize words = n / 3;
+  for(gsize i = 0; i < words; i++)
+  {
+    guint32 w = src[i];
+    dst[3*i] = gray10_to_16(w & 0x3ff);
+    dst[3*i + 1] = gray10_to_16((w >> 10) & 0x3ff);
+    dst[3*i + 2] = gray10_to_16((w >> 20) & 0x3ff);
+  }
+  // the last word of a row may be partly filled
+  for(gsize j = 0; j < n - 3*words; j++)
+  {
+    dst[3*words + j] = gray10_to_16((src[words] >> (10*j)) & 0x3ff);
+  }
+}
+
+void rgba64_to_rgb48(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[3*i] = src[4*i];
+    dst[3*i + 1] = src[4*i + 1];
+    dst[3*i + 2] = src[4*i + 2];
+  }
+}
+
+void rgb48_to_rgba64(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[4*i] = src[3*i];
+    dst[4*i + 1] = src[3*i + 1];
+    dst[4*i + 2] = src[3*i + 2];
+    dst[4*i + 3] = 0xffff;
+  }
+}
+
+void rgba64_to_rgb48_swapped(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[3*i] = GUINT16_SWAP_LE_BE(src[4*i]);
+    dst[3*i + 1] = GUINT16_SWAP_LE_BE(src[4*i + 1]);
+    dst[3*i + 2] = GUINT16_SWAP_LE_BE(src[4*i + 2]);
+  }
+}
+
+void rgb48_to_rgba64_swapped(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[4*i] = GUINT16_SWAP_LE_BE(src[3*i]);
+    dst[4*i + 1] = GUINT16_SWAP_LE_BE(src[3*i + 1]);
+    dst[4*i + 2] = GUINT16_SWAP_LE_BE(src[3*i + 2]);
+    dst[4*i + 3] = 0xffff;
+  }
+}
+
+void byteswap_copy_16(const guint16 * __restrict__ src, guint16 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[i] = GUINT16_SWAP_LE_BE(src[i]);
+  }
+}
+
+void byteswap_copy_24(const guint8 * __restrict__ src, guint8 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[3*i] = src[3*i + 2];
+    dst[3*i + 1] = src[3*i + 1];
+    dst[3*i + 2] = src[3*i];
+  }
+}
+
+void byteswap_copy_32(const guint32 * __restrict__ src, guint32 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[i] = GUINT32_SWAP_LE_BE(src[i]);
+  }
+}
+
+void byteswap_copy_64(const guint64 * __restrict__ src, guint64 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[i] = GUINT64_SWAP_LE_BE(src[i]);
+  }
+}
+
+void unpack_s24le_to_s32(const guint8 * __restrict__ src, gint32 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    dst[i] = (gint32) (((guint32) src[3*i] << 8) | ((guint32) src[3*i + 1] << 16) | ((guint32) src[3*i + 2] << 24));
+  }
+}
+
+void unpack_s24le_to_s24_32(const guint8 * __restrict__ src, gint32 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    // assemble at the top of the word, the arithmetic shift brings the sign down with it
+    gint32 s = (gint32) (((guint32) src[3*i] << 8) | ((guint32) src[3*i + 1] << 16) | ((guint32) src[3*i + 2] << 24));
+    dst[i] = s >> 8;
+  }
+}
+
+void pack_s24_32_to_s24le(const gint32 * __restrict__ src, guint8 * __restrict__ dst, gsize n)
+{
+  for(gsize i = 0; i < n; i++)
+  {
+    guint32 s = (guint32) src[i];
+    dst[3*i] = (guint8) s;
+    dst[3*i + 1] = (guint8) (s >> 8);
+    dst[3*i + 2] = (guint8) (s >> 16);
+  }
+}
+
+/*
+ * One channel at a time, so each inner loop streams through a plane
+ * and the interleaved side moves with a constant stride the vectorizer can gather or scatter
+ */
+template<typename T>
+static void interleave(const T * const * src, T * __restrict__ dst, guint channels, gsize frames)
+{
+  for(guint c = 0; c < channels; c++)
+  {
+    const T * __restrict__ plane = src[c];
+    for(gsize i = 0; i < frames; i++)
+    {
+      dst[i*channels + c] = plane[i];
+    }
+  }
+}
+
+template<typename T>
+static void deinterleave(const T * __restrict__ src, T * const * dst, guint channels, gsize frames)
+{
+  for(guint c = 0; c < channels; c++)
+  {
+    T * __restrict__ plane = dst[c];
+    for(gsize i = 0; i < frames; i++)
+    {
+      plane[i] = src[i*channels + c];
+    }
+  }
+}
+
+void interleave_8(const guint8 * const * src, guint8 * __restrict__ dst, guint channels, gsize frames)
+{
+  interleave(src, dst, channels, frames);
+}
+
+void interleave_16(const guint16 * const * src, guint16 * __restrict__ dst, guint channels, gsize frames)
+{
+  interleave(src, dst, channels, frames);
+}
+
+void interleave_32(const guint32 * const * src, guint32 * __restrict__ dst, guint channels, gsize frames)
+{
+  interleave(src, dst, channels, frames);
+}
+
+void interleave_64(const guint64 * const * src, guint64 * __restrict__ dst, guint channels, gsize frames)
+{
+  interleave(src, dst, channels, frames);
+}
+
+void deinterleave_8(const guint8 * __restrict__ src, guint8 * const * dst, guint channels, gsize frames)
+{
+  deinterleave(src, dst, channels, frames);
+}
+
+void deinterleave_16(const guint16 * __restrict__ src, guint16 * const * dst, guint channels, gsize frames)
+{
+  deinterleave(src, dst, channels, frames);
+}
+
+void deinterleave_32(const guint32 * __restrict__ src, guint32 * const * dst, guint channels, gsize frames)
+{
+  deinterleave(src, dst, channels, frames);
+}
+
+void deinterleave_64(const guint64 * __restrict__ src, guint64 * const * dst, guint channels, gsize frames)
+{
+  deinterleave(src, dst, channels, frames);
+}
+
+void interleave_bytes(const guint8 * const * src, guint8 * __restrict__ dst, guint bps, guint channels, gsize frames)
+{
+  for(guint c = 0; c < channels; c++)
+  {
+    const guint8 * __restrict__ plane = src[c];
+    for(gsize i = 0; i < frames; i++)
+    {
+      memcpy(dst + (i*channels + c)*bps, plane + i*bps, bps);
+    }
+  }
+}
+
+void deinterleave_bytes(const guint8 * __restrict__ src, guint8 * const * dst, guint bps, guint channels, gsize frames)
+{
+  for(guint c = 0; c < channels; c++)
+  {
+    guint8 * __restrict__ plane = dst[c];
+    for(gsize i = 0; i < frames; i++)
+    {
+      memcpy(plane + i*bps, src + (i*channels + c)*bps, bps);
+    }
+  }
+}
+
+/*
+ * Frames are walked in order so each source frame is read once while it's in cache,
+ * the per-channel output pointers advance by their own stride
+ */
+template<typename T>
+static void gather_channels(const T * src, guint src_channels, const guint * src_channel,
+  T * const * dst, const guint * dst_stride, guint n, gsize frames)
+{
+  for(gsize i = 0; i < frames; i++)
+  {
+    const T * frame = src + i*src_channels;
+    for(guint k = 0; k < n; k++)
+    {
+      dst[k][i*dst_stride[k]] = frame[src_channel[k]];
+    }
+  }
+}
+
+void gather_channels_8(const guint8 * src, guint src_channels, const guint * src_channel,
+  guint8 * const * dst, const guint * dst_stride, guint n, gsize frames)
+{
+  gather_channels(src, src_channels, src_channel, dst, dst_stride, n, frames);
+}
+
+void gather_channels_16(const guint16 * src, guint src_channels, const guint * src_channel,
+  guint16 * const * dst, const guint * dst_stride, guint n, gsize frames)
+{
+  gather_channels(src, src_channels, src_channel, dst, dst_stride, n, frames);
+}
+
+void gather_channels_32(const guint32 * src, guint src_channels, const guint * src_channel,
+  guint32 * const * dst, const guint * dst_stride, guint n, gsize frames)
+{
+  gather_channels(src, src_channels, src_channel, dst, dst_stride, n, frames);
+}
+
+void gather_channels_64(const guint64 * src, guint src_channels, const guint * src_channel,
+  guint64 * const * dst, const guint * dst_stride, guint n, gsize frames)
+{
+  gather_channels(src, src_channels, src_channel, dst, dst_stride, n, frames);
+}
+
+void gather_channels_bytes(const guint8 * src, guint bps, guint src_channels, const guint * src_channel,
+  guint8 * const * dst, const guint * dst_stride, guint n, gsize frames)
+{
+  for(gsize i = 0; i < frames; i++)
+  {
+    const guint8 * frame = src + i*src_channels*bps;
+    for(guint k = 0; k < n; k++)
+    {
+      memcpy(dst[k] + i*dst_stride[k]*bps, frame + src_channel[k]*bps, bps);
+    }
+  }
+}
+
+}  // namespace gst_bridge
@@ -50,6 +50,11 @@ static gboolean rosaudiosink_close (RosBaseSink * ros_base_sink);
 static gboolean rosaudiosink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps);
 
 static GstFlowReturn rosaudiosink_render (RosBaseSink * sink, GstBuffer * buffer, rclcpp::Time msg_time);
+static GstFlowReturn rosaudiosink_render_channel_groups (Rosaudiosink * sink, GstBuffer * buf, rclcpp::Time msg_time);
+static gboolean rosaudiosink_parse_channel_topics (Rosaudiosink * sink);
+static gboolean rosaudiosink_fill_msg_data (Rosaudiosink * sink, GstBuffer * buf, std::vector<uint8_t> & data, uint32_t * frames);
+static gboolean rosaudiosink_prepare_msgs (Rosaudiosink * sink);
+static gboolean rosaudiosink_publish_info (Rosaudiosink * sink);
 
 enum
 {
@@ -57,6 +62,10 @@ enum
   PROP_ROS_TOPIC,
   PROP_ROS_FRAME_ID,
   PROP_ROS_ENCODING,
+  PROP_ROS_LAYOUT,
+  PROP_DITHER,
+  PROP_CHANNEL_TOPICS,
+  PROP_COMPACT,
 };
 
 
@@ -66,7 +75,7 @@ static GstStaticPadTemplate rosaudiosink_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (ROS_AUDIO_MSG_CAPS)
+    GST_STATIC_CAPS (ROS_AUDIO_MSG_ANY_LAYOUT_CAPS)
     );
 
 /* class initialization */
@@ -111,8 +120,34 @@ static void rosaudiosink_class_init (RosaudiosinkClass * klass)
   );
 
   g_object_class_install_property (object_class, PROP_ROS_ENCODING,
-      g_param_spec_string ("ros-encoding", "encoding-string", "A hack to flexibly set the encoding string",
-      "16SC1",
+      g_param_spec_string ("ros-encoding", "encoding-string", "Sample format to publish (eg S16LE), converted from the caps format, empty publishes the caps format",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_LAYOUT,
+      g_param_spec_string ("ros-layout", "layout-string", "Sample layout to publish (interleaved or non-interleaved), empty publishes the caps layout",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_DITHER,
+      g_param_spec_enum ("dither", "dither", "Dither applied when converting to ros-encoding drops bits",
+      GST_TYPE_AUDIO_DITHER_METHOD, GST_AUDIO_DITHER_NONE,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_CHANNEL_TOPICS,
+      g_param_spec_string ("channel-topics", "channel-topics",
+      "Publish groups of channels on their own topics instead of ros-topic, as topic:channels[:best-effort] separated by ';' (eg left:0;right:1;rear:2-3:best-effort)",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_COMPACT,
+      g_param_spec_boolean ("compact", "compact",
+      "Publish audio_msgs/CompactAudio, and describe the stream once with audio_msgs/AudioInfo on ros-topic/info",
+      false,
       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
   );
 
@@ -131,7 +166,18 @@ static void rosaudiosink_init (Rosaudiosink * sink)
   ros_base_sink->node_name = g_strdup("gst_audio_sink_node");
   sink->pub_topic = g_strdup("gst_audio_pub");
   sink->frame_id = g_strdup("audio_frame");
-  sink->encoding = g_strdup("16SC1");
+  sink->encoding = g_strdup("");
+  sink->layout = g_strdup("");
+  sink->channel_topics = g_strdup("");
+  sink->channel_groups = std::vector<RosaudiosinkChannelTopic>();
+  sink->dither = GST_AUDIO_DITHER_NONE;
+  sink->converter = NULL;
+  sink->compact = false;
+  sink->msg_planes = std::vector<gpointer>();
+  sink->in_planes = std::vector<gpointer>();
+  sink->gather_channels = std::vector<guint>();
+  sink->gather_dst = std::vector<guint8 *>();
+  sink->gather_stride = std::vector<guint>();
 }
 
 void rosaudiosink_set_property (GObject * object, guint property_id,
@@ -166,6 +212,38 @@ void rosaudiosink_set_property (GObject * object, guint property_id,
       sink->encoding = g_value_dup_string(value);
       break;
 
+    case PROP_ROS_LAYOUT:
+      g_free(sink->layout);
+      sink->layout = g_value_dup_string(value);
+      break;
+
+    case PROP_DITHER:
+      sink->dither = (GstAudioDitherMethod) g_value_get_enum(value);
+      break;
+
+    case PROP_CHANNEL_TOPICS:
+      if(ros_base_sink->node)
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "can't change channel topics once opened");
+      }
+      else
+      {
+        g_free(sink->channel_topics);
+        sink->channel_topics = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_COMPACT:
+      if(ros_base_sink->node)
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "can't change message type once opened");
+      }
+      else
+      {
+        sink->compact = g_value_get_boolean(value);
+      }
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -191,6 +269,22 @@ void rosaudiosink_get_property (GObject * object, guint property_id,
       g_value_set_string(value, sink->encoding);
       break;
 
+    case PROP_ROS_LAYOUT:
+      g_value_set_string(value, sink->layout);
+      break;
+
+    case PROP_DITHER:
+      g_value_set_enum(value, sink->dither);
+      break;
+
+    case PROP_CHANNEL_TOPICS:
+      g_value_set_string(value, sink->channel_topics);
+      break;
+
+    case PROP_COMPACT:
+      g_value_set_boolean(value, sink->compact);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -204,11 +298,78 @@ static gboolean rosaudiosink_open (RosBaseSink * ros_base_sink)
   Rosaudiosink *sink = GST_ROSAUDIOSINK (ros_base_sink);
   GST_DEBUG_OBJECT (sink, "open");
   rclcpp::QoS qos = rclcpp::SensorDataQoS().reliable();  //XXX add a parameter for overrides
+
+  if(!rosaudiosink_parse_channel_topics(sink))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "can't parse channel-topics '%s'", sink->channel_topics);
+    return FALSE;
+  }
+  if(sink->compact)
+  {
+    if(!sink->channel_groups.empty())
+    {
+      RCLCPP_ERROR(ros_base_sink->logger, "channel-topics can't publish compact messages");
+      return FALSE;
+    }
+    // the description is latched, so subscribers joining later still receive it
+    sink->compact_pub = ros_base_sink->node->create_publisher<audio_msgs::msg::CompactAudio>(sink->pub_topic, qos);
+    sink->info_pub = ros_base_sink->node->create_publisher<audio_msgs::msg::AudioInfo>(
+        std::string(sink->pub_topic) + "/info", rclcpp::QoS(1).reliable().transient_local());
+    return TRUE;
+  }
+  if(!sink->channel_groups.empty())
+  {
+    // every group publishes from this node, each at its own QoS
+    for(auto & group : sink->channel_groups)
+    {
+      rclcpp::QoS group_qos = group.best_effort ? rclcpp::SensorDataQoS() : qos;
+      group.pub = ros_base_sink->node->create_publisher<audio_msgs::msg::Audio>(group.topic, group_qos);
+    }
+    return TRUE;
+  }
+
   sink->pub = ros_base_sink->node->create_publisher<audio_msgs::msg::Audio>(sink->pub_topic, qos);
 
   return TRUE;
 }
 
+/*
+ * Split channel-topics into groups, "topic:channels[:best-effort]" separated by ';'
+ */
+static gboolean rosaudiosink_parse_channel_topics (Rosaudiosink * sink)
+{
+  gchar ** entries = g_strsplit(sink->channel_topics, ";", -1);
+  gboolean ok = TRUE;
+
+  sink->channel_groups.clear();
+  for(gchar ** entry = entries; ok && *entry; entry++)
+  {
+    gchar ** fields;
+    guint n_fields;
+    RosaudiosinkChannelTopic group;
+
+    if(**entry == '\0')
+      continue;
+    fields = g_strsplit(*entry, ":", -1);
+    n_fields = g_strv_length(fields);
+    ok = (n_fields == 2) || ((n_fields == 3) && (0 == g_strcmp0(fields[2], "best-effort")));
+    if(ok)
+    {
+      group.topic = fields[0];
+      group.best_effort = (n_fields == 3);
+      ok = !group.topic.empty() && gst_bridge::parse_channel_list(fields[1], &(group.channels));
+    }
+    if(ok)
+      sink->channel_groups.push_back(group);
+    g_strfreev(fields);
+  }
+  g_strfreev(entries);
+
+  if(!ok)
+    sink->channel_groups.clear();
+  return ok;
+}
+
 /* close the device */
 static gboolean rosaudiosink_close (RosBaseSink * ros_base_sink)
 {
@@ -216,6 +377,16 @@ static gboolean rosaudiosink_close (RosBaseSink * ros_base_sink)
   GST_DEBUG_OBJECT (sink, "close");
 
   sink->pub.reset();
+  sink->compact_pub.reset();
+  sink->info_pub.reset();
+  sink->msg.reset();
+  sink->compact_msg.reset();
+  sink->channel_groups.clear();
+  if(sink->converter)
+  {
+    gst_audio_converter_free(sink->converter);
+    sink->converter = NULL;
+  }
 
   return TRUE;
 }
@@ -228,6 +399,8 @@ static gboolean rosaudiosink_setcaps (GstBaseSink * gst_base_sink, GstCaps * cap
   Rosaudiosink *sink = GST_ROSAUDIOSINK (ros_base_sink);
 
   GstAudioInfo audio_info;
+  GstAudioFormat format;
+  GstAudioLayout layout;
 
   GST_DEBUG_OBJECT (sink, "setcaps");
 
@@ -241,21 +414,106 @@ static gboolean rosaudiosink_setcaps (GstBaseSink * gst_base_sink, GstCaps * cap
       RCLCPP_INFO(ros_base_sink->logger, "preparing audio with caps '%s'",
           gst_caps_to_string(caps));
 
-  if(gst_audio_info_from_caps(&audio_info , caps))
+  if(!gst_audio_info_from_caps(&audio_info , caps))
+    return false;
+  sink->audio_info = audio_info;
+
+  if(sink->converter)
+  {
+    gst_audio_converter_free(sink->converter);
+    sink->converter = NULL;
+  }
+
+  // publish in the ros-encoding sample format and ros-layout, converting on the way into the message
+  format = gst_bridge::getGstAudioFormat(sink->encoding);
+  if(format == GST_AUDIO_FORMAT_UNKNOWN)
+    format = GST_AUDIO_INFO_FORMAT(&audio_info);
+  if(!gst_bridge::getGstAudioLayout(sink->layout, &layout))
+    layout = GST_AUDIO_INFO_LAYOUT(&audio_info);
+
+  // channel groups keep the caps sample format, and are published in ros-layout
+  for(auto & group : sink->channel_groups)
   {
-    sink->audio_info = audio_info;
+    for(guint c : group.channels)
+    {
+      if(c >= (guint) GST_AUDIO_INFO_CHANNELS(&audio_info))
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "topic %s takes channel %u of %d",
+            group.topic.c_str(), c, GST_AUDIO_INFO_CHANNELS(&audio_info));
+        return false;
+      }
+    }
+    gst_bridge::audio_info_with_channels(&audio_info, group.channels, &(group.in_info));
+    gst_bridge::audio_info_with_format(&(group.in_info), GST_AUDIO_INFO_FORMAT(&audio_info), layout, &(group.msg_info));
+  }
+  if(!sink->channel_groups.empty() && (format != GST_AUDIO_INFO_FORMAT(&audio_info)))
+    RCLCPP_WARN(ros_base_sink->logger, "channel-topics publish the caps format, ignoring ros-encoding");
+
+  if(!sink->channel_groups.empty() ||
+    ((format == GST_AUDIO_INFO_FORMAT(&audio_info)) && (layout == GST_AUDIO_INFO_LAYOUT(&audio_info))))
+  {
+    sink->msg_info = audio_info;
+    return rosaudiosink_prepare_msgs(sink);
+  }
+
+  gst_bridge::audio_info_with_format(&audio_info, format, layout, &(sink->msg_info));
+  sink->converter = gst_bridge::audio_converter_new(&audio_info, &(sink->msg_info), sink->dither);
+  if(!sink->converter)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "can't convert %s to %s",
+        GST_AUDIO_INFO_NAME(&audio_info), GST_AUDIO_INFO_NAME(&(sink->msg_info)));
+    return false;
+  }
+  return rosaudiosink_prepare_msgs(sink);
+}
+
+/*
+ * Fill in everything that only changes with the caps,
+ * the messages are reused for every buffer so their data keeps the storage of the last one
+ */
+static gboolean rosaudiosink_prepare_msgs (Rosaudiosink * sink)
+{
+  if(sink->compact)
+  {
+    sink->compact_msg = std::make_shared<audio_msgs::msg::CompactAudio>(
+        gst_bridge::gst_audio_info_to_compact_audio_msg(&(sink->msg_info)));
+  }
+  else
+  {
+    sink->msg = std::make_shared<audio_msgs::msg::Audio>(gst_bridge::gst_audio_info_to_audio_msg(&(sink->msg_info)));
+    sink->msg->header.frame_id = sink->frame_id;
+  }
+  for(auto & group : sink->channel_groups)
+  {
+    group.msg = gst_bridge::gst_audio_info_to_audio_msg(&(group.msg_info));
+    group.msg.header.frame_id = sink->frame_id;
+  }
+  return rosaudiosink_publish_info(sink);
+}
+
+/* describe the published stream once, when the caps are set or change */
+static gboolean rosaudiosink_publish_info (Rosaudiosink * sink)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (sink);
+
+  if(!sink->info_pub)
     return true;
+  if(gst_bridge::getCompactAudioFormat(GST_AUDIO_INFO_FORMAT(&(sink->msg_info))) == audio_msgs::msg::CompactAudio::FORMAT_UNKNOWN)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "CompactAudio can't carry %s", GST_AUDIO_INFO_NAME(&(sink->msg_info)));
+    return false;
   }
 
-  return false;
+  audio_msgs::msg::AudioInfo info = gst_bridge::gst_audio_info_to_audio_info_msg(&(sink->msg_info));
+  info.header.stamp = ros_base_sink->clock->now();
+  info.header.frame_id = sink->frame_id;
+  sink->info_pub->publish(info);
+  return true;
 }
 
 
 static GstFlowReturn rosaudiosink_render (RosBaseSink * ros_base_sink, GstBuffer * buf, rclcpp::Time msg_time)
 {
-  GstMapInfo info;
-  audio_msgs::msg::Audio msg;
-
   // XXX use borrowed messages, can buf be extended into the middleware?
   //    auto msg = sink->pub->borrow_loaned_message();
   //    msg.get().frames = ...
@@ -263,33 +521,142 @@ static GstFlowReturn rosaudiosink_render (RosBaseSink * ros_base_sink, GstBuffer
   Rosaudiosink *sink = GST_ROSAUDIOSINK (ros_base_sink);
   GST_DEBUG_OBJECT (sink, "render");
 
-  msg = gst_bridge::gst_audio_info_to_audio_msg(&(sink->audio_info));
+  if(!sink->channel_groups.empty())
+    return rosaudiosink_render_channel_groups(sink, buf, msg_time);
+
+  if(sink->compact)
+  {
+    // no strings to fill, the format is a number and frame_id went out with the AudioInfo
+    audio_msgs::msg::CompactAudio & compact_msg = *(sink->compact_msg);
+    compact_msg.stamp = msg_time;
+    if(!rosaudiosink_fill_msg_data(sink, buf, compact_msg.data, &(compact_msg.frames)))
+      return GST_FLOW_ERROR;
+    gst_bridge::set_audio_msg_seq_num(compact_msg, buf, &(sink->msg_seq_num));
+    sink->compact_pub->publish(compact_msg);
+    return GST_FLOW_OK;
+  }
+
+  // the rest was filled in from the caps
+  audio_msgs::msg::Audio & msg = *(sink->msg);
   msg.header.stamp = msg_time;
-  msg.header.frame_id = sink->frame_id;
+  if(msg.header.frame_id != sink->frame_id)  //ros-frame-id can change while playing
+    msg.header.frame_id = sink->frame_id;
+
+  if(!rosaudiosink_fill_msg_data(sink, buf, msg.data, &(msg.frames)))
+    return GST_FLOW_ERROR;
+  gst_bridge::set_audio_msg_seq_num(msg, buf, &(sink->msg_seq_num));
 
-  gst_buffer_map (buf, &info, GST_MAP_READ);
-  msg.data.assign(info.data, info.data+info.size);
-  msg.frames = info.size/GST_AUDIO_INFO_BPF(&(sink->audio_info));
+  //publish
+  sink->pub->publish(msg);
 
-  if(GST_BUFFER_OFFSET_IS_VALID(buf))
+  return GST_FLOW_OK;
+}
+
+/* convert or copy the buffer straight into the message data, in the published format and layout */
+static gboolean rosaudiosink_fill_msg_data (Rosaudiosink * sink, GstBuffer * buf, std::vector<uint8_t> & data, uint32_t * frames)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (sink);
+  GstAudioBuffer audio_buf;
+  gboolean converted;
+
+  // planar buffers are mapped through their GstAudioMeta plane offsets
+  if(!gst_audio_buffer_map (&audio_buf, &(sink->audio_info), buf, GST_MAP_READ))
   {
-    msg.seq_num = GST_BUFFER_OFFSET(buf);
-    if(GST_BUFFER_OFFSET_END_IS_VALID(buf))
-      sink->msg_seq_num = GST_BUFFER_OFFSET_END(buf);
-    else
-      sink->msg_seq_num = GST_BUFFER_OFFSET(buf) + msg.frames;
+    RCLCPP_ERROR(ros_base_sink->logger, "failed to map audio buffer");
+    return FALSE;
   }
-  else
+  *frames = audio_buf.n_samples;
+  converted = gst_bridge::audio_buffer_to_msg_data(sink->converter, &(sink->audio_info), &(sink->msg_info),
+      &audio_buf, data, &(sink->msg_planes));
+  gst_audio_buffer_unmap (&audio_buf);
+  if(!converted)
   {
-    msg.seq_num = sink->msg_seq_num;
-    sink->msg_seq_num += msg.frames;
+    RCLCPP_ERROR(ros_base_sink->logger, "sample conversion failed");
+    return FALSE;
   }
+  return TRUE;
+}
 
-  gst_buffer_unmap (buf, &info);
 
-  //publish
-  sink->pub->publish(msg);
+/*
+ * Publish each channel group on its own topic.
+ * Interleaved buffers are split in a single pass over the frames, filling every group's message at once,
+ * planar buffers hand each group its planes.
+ */
+static GstFlowReturn rosaudiosink_render_channel_groups (Rosaudiosink * sink, GstBuffer * buf, rclcpp::Time msg_time)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (sink);
+
+  GstAudioBuffer audio_buf;
+  gboolean converted = TRUE;
+  uint64_t msg_seq_num = sink->msg_seq_num;
+  gsize frames;
+
+  if(!gst_audio_buffer_map (&audio_buf, &(sink->audio_info), buf, GST_MAP_READ))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "failed to map audio buffer");
+    return GST_FLOW_ERROR;
+  }
+  frames = audio_buf.n_samples;
+
+  // each group's message was filled in from the caps
+  for(auto & group : sink->channel_groups)
+  {
+    group.msg.header.stamp = msg_time;
+    if(group.msg.header.frame_id != sink->frame_id)
+      group.msg.header.frame_id = sink->frame_id;
+    group.msg.frames = frames;
+    group.msg.data.resize(frames * group.msg.step);
+  }
+
+  if(GST_AUDIO_INFO_LAYOUT(&(sink->audio_info)) == GST_AUDIO_LAYOUT_INTERLEAVED)
+  {
+    gint bps = GST_AUDIO_INFO_BPS(&(sink->audio_info));
+
+    sink->gather_channels.clear();
+    sink->gather_dst.clear();
+    sink->gather_stride.clear();
+    for(auto & group : sink->channel_groups)
+    {
+      gboolean planar = (GST_AUDIO_INFO_LAYOUT(&(group.msg_info)) == GST_AUDIO_LAYOUT_NON_INTERLEAVED);
+      for(guint k = 0; k < group.channels.size(); k++)
+      {
+        sink->gather_channels.push_back(group.channels[k]);
+        sink->gather_dst.push_back(group.msg.data.data() + k * bps * (planar ? frames : 1));
+        sink->gather_stride.push_back(planar ? 1 : group.channels.size());
+      }
+    }
+    gst_bridge::audio_gather_channels(&(sink->audio_info), (const guint8 *) audio_buf.planes[0], sink->gather_channels,
+        sink->gather_dst.data(), sink->gather_stride.data(), frames);
+  }
+  else
+  {
+    for(size_t g = 0; converted && (g < sink->channel_groups.size()); g++)
+    {
+      auto & group = sink->channel_groups[g];
+      sink->in_planes.clear();
+      for(guint c : group.channels)
+        sink->in_planes.push_back(audio_buf.planes[c]);
+      gst_bridge::audio_msg_planes(&(group.msg_info), group.msg.data.data(), frames, &(sink->msg_planes));
+      converted = gst_bridge::audio_convert_samples(NULL, &(group.in_info), &(group.msg_info),
+          sink->in_planes.data(), sink->msg_planes.data(), frames);
+    }
+  }
+  gst_audio_buffer_unmap (&audio_buf);
+  if(!converted)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "sample conversion failed");
+    return GST_FLOW_ERROR;
+  }
+
+  // every group carries the same stretch of the stream
+  for(auto & group : sink->channel_groups)
+  {
+    msg_seq_num = sink->msg_seq_num;
+    gst_bridge::set_audio_msg_seq_num(group.msg, buf, &msg_seq_num);
+    group.pub->publish(group.msg);
+  }
+  sink->msg_seq_num = msg_seq_num;
 
   return GST_FLOW_OK;
 }
-
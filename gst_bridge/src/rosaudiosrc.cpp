@@ -51,16 +51,19 @@ static GstFlowReturn rosaudiosrc_create (GstBaseSrc * gst_base_src, guint64 offs
 //static gboolean rosaudiosrc_negotiate (GstBaseSrc * gst_base_src);
 //static GstCaps* rosaudiosrc_setcaps (GstBaseSrc * gst_base_src, GstCaps * caps);  //upstream returns any remaining caps preferences
 static GstCaps* rosaudiosrc_getcaps (GstBaseSrc * gst_base_src, GstCaps * filter);  //set our caps preferences
-static gboolean rosaudiosrc_query (GstBaseSrc * gst_base_src, GstQuery * query);
 static GstCaps * rosaudiosrc_fixate (GstBaseSrc * gst_base_src, GstCaps * caps);
 
 
 static void rosaudiosrc_sub_cb(Rosaudiosrc * src, audio_msgs::msg::Audio::ConstSharedPtr msg);
-static audio_msgs::msg::Audio::ConstSharedPtr rosaudiosrc_wait_for_msg(Rosaudiosrc * src);
+static void rosaudiosrc_compact_sub_cb(Rosaudiosrc * src, audio_msgs::msg::CompactAudio::ConstSharedPtr msg);
+static void rosaudiosrc_info_sub_cb(Rosaudiosrc * src, audio_msgs::msg::AudioInfo::ConstSharedPtr msg);
+static void rosaudiosrc_queue_msg(Rosaudiosrc * src, const RosaudiosrcMsg & msg);
 
 
 static void rosaudiosrc_set_msg_props_from_caps_string(Rosaudiosrc * src, gchar * caps_string);
-static void rosaudiosrc_set_msg_props_from_msg(Rosaudiosrc * src, audio_msgs::msg::Audio::ConstSharedPtr msg);
+static void rosaudiosrc_set_msg_props_from_msg(Rosaudiosrc * src, const RosaudiosrcMsg & msg);
+static gboolean rosaudiosrc_set_output_format(Rosaudiosrc * src);
+static gboolean rosaudiosrc_channels_in_range(Rosaudiosrc * src);
 
 
 
@@ -71,6 +74,10 @@ enum
   PROP_ROS_FRAME_ID,
   PROP_ROS_ENCODING,
   PROP_INIT_CAPS,
+  PROP_ROS_LAYOUT,
+  PROP_DITHER,
+  PROP_CHANNEL_LIST,
+  PROP_COMPACT,
 };
 
 /* pad templates */
@@ -79,7 +86,7 @@ static GstStaticPadTemplate rosaudiosrc_src_template =
 GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (ROS_AUDIO_MSG_CAPS)
+    GST_STATIC_CAPS (ROS_AUDIO_MSG_ANY_LAYOUT_CAPS)
     );
 
 
@@ -124,9 +131,21 @@ static void rosaudiosrc_class_init (RosaudiosrcClass * klass)
   );
 
   g_object_class_install_property (object_class, PROP_ROS_ENCODING,
-      g_param_spec_string ("ros-encoding", "encoding-string", "ROS message encoding string",
+      g_param_spec_string ("ros-encoding", "encoding-string", "Sample format to produce (eg F32LE), converted from the message encoding, empty produces the message format",
       "",
-      (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS))
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_LAYOUT,
+      g_param_spec_string ("ros-layout", "layout-string", "Sample layout to produce (interleaved or non-interleaved), empty produces the message layout",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_DITHER,
+      g_param_spec_enum ("dither", "dither", "Dither applied when converting to ros-encoding drops bits",
+      GST_TYPE_AUDIO_DITHER_METHOD, GST_AUDIO_DITHER_NONE,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
   );
 
   g_object_class_install_property (object_class, PROP_INIT_CAPS,
@@ -136,12 +155,26 @@ static void rosaudiosrc_class_init (RosaudiosrcClass * klass)
   );
 
 
+  g_object_class_install_property (object_class, PROP_CHANNEL_LIST,
+      g_param_spec_string ("channel-list", "channel-list", "Message channels to produce, comma separated numbers or ranges (eg 0,1,8-11), empty produces all of them",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+
+  g_object_class_install_property (object_class, PROP_COMPACT,
+      g_param_spec_boolean ("compact", "compact",
+      "Subscribe to audio_msgs/CompactAudio, with the stream description from audio_msgs/AudioInfo on ros-topic/info",
+      false,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+
   ros_base_src_class->open = GST_DEBUG_FUNCPTR (rosaudiosrc_open);  //let the base sink know how we register publishers
   ros_base_src_class->close = GST_DEBUG_FUNCPTR (rosaudiosrc_close);  //let the base sink know how we destroy publishers
   basesrc_class->create = GST_DEBUG_FUNCPTR(rosaudiosrc_create); // allocate and fill a buffer
 
 
-  basesrc_class->query = GST_DEBUG_FUNCPTR(rosaudiosrc_query);  //set the scheduling modes
   basesrc_class->get_caps = GST_DEBUG_FUNCPTR (rosaudiosrc_getcaps);  //return caps within the filter
   basesrc_class->fixate = GST_DEBUG_FUNCPTR (rosaudiosrc_fixate); //set caps fields to our preferred values (if possible)
   //basesrc_class->negotiate = GST_DEBUG_FUNCPTR (rosaudiosrc_negotiate);  //start figuring out caps and allocators
@@ -157,11 +190,16 @@ static void rosaudiosrc_init (Rosaudiosrc * src)
   src->frame_id = g_strdup("");
   src->encoding = g_strdup("");
   src->init_caps = g_strdup("");
+  src->layout = g_strdup("");
+  src->channel_list = g_strdup("");
+  src->channels = std::vector<guint>();
+  src->gather_buf = std::vector<guint8>();
+  src->dither = GST_AUDIO_DITHER_NONE;
+  src->converter = NULL;
+  src->compact = false;
 
   src->msg_init = true;
-  src->msg_queue_max = 1;
-  // XXX why does queue segfault without expicit construction?
-  src->msg_queue = std::queue<audio_msgs::msg::Audio::ConstSharedPtr>();
+  new (&(src->msg_queue)) RosBaseSrcMsgQueue<RosaudiosrcMsg>(1);
 
   /* configure basesrc to be a live source */
   gst_base_src_set_live (GST_BASE_SRC (src), TRUE); // XXX revise this
@@ -195,6 +233,56 @@ void rosaudiosrc_set_property (GObject * object, guint property_id,
       }
       break;
 
+    case PROP_ROS_ENCODING:
+      if(ros_base_src->node)
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change encoding once opened");
+      }
+      else
+      {
+        g_free(src->encoding);
+        src->encoding = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_ROS_LAYOUT:
+      if(ros_base_src->node)
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change layout once opened");
+      }
+      else
+      {
+        g_free(src->layout);
+        src->layout = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_DITHER:
+      src->dither = (GstAudioDitherMethod) g_value_get_enum(value);
+      break;
+
+    case PROP_CHANNEL_LIST:
+      if(ros_base_src->node)
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change channel list once opened");
+      }
+      else
+      {
+        std::vector<guint> channels;
+        if(!gst_bridge::parse_channel_list(g_value_get_string(value), &channels))
+        {
+          GST_WARNING_OBJECT (src, "channel-list '%s' does not parse, keeping '%s'",
+              g_value_get_string(value), src->channel_list);
+        }
+        else
+        {
+          g_free(src->channel_list);
+          src->channel_list = g_value_dup_string(value);
+          src->channels = channels;
+        }
+      }
+      break;
+
     case PROP_INIT_CAPS:
       if(src->msg_init)
       {
@@ -208,6 +296,17 @@ void rosaudiosrc_set_property (GObject * object, guint property_id,
       }
       break;
 
+    case PROP_COMPACT:
+      if(ros_base_src->node)
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change message type once opened");
+      }
+      else
+      {
+        src->compact = g_value_get_boolean(value);
+      }
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -238,6 +337,22 @@ void rosaudiosrc_get_property (GObject * object, guint property_id,
       g_value_set_string(value, src->init_caps);
       break;
 
+    case PROP_ROS_LAYOUT:
+      g_value_set_string(value, src->layout);
+      break;
+
+    case PROP_DITHER:
+      g_value_set_enum(value, src->dither);
+      break;
+
+    case PROP_CHANNEL_LIST:
+      g_value_set_string(value, src->channel_list);
+      break;
+
+    case PROP_COMPACT:
+      g_value_set_boolean(value, src->compact);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -251,40 +366,81 @@ static void rosaudiosrc_set_msg_props_from_caps_string(Rosaudiosrc * src, gchar
   GstCaps * caps = gst_caps_from_string(caps_string);
   if(gst_audio_info_from_caps(&audio_info , caps))
   {
+    src->msg_info = audio_info;
     src->audio_info = audio_info;
   }
+  gst_caps_unref(caps);
+  src->msg_init = false;
+}
+
+static void rosaudiosrc_set_msg_props_from_msg(Rosaudiosrc * src, const RosaudiosrcMsg & msg)
+{
+  src->msg_info = msg.info;
+
+  rosaudiosrc_set_output_format(src);
+
+  size_t frames = msg.data->size() / GST_AUDIO_INFO_BPF(&(src->msg_info));
+  size_t blocksize = GST_AUDIO_INFO_BPF(&(src->audio_info)) * frames;
+  gst_base_src_set_blocksize(GST_BASE_SRC (src), blocksize);
+
   src->msg_init = false;
 }
 
-static void rosaudiosrc_set_msg_props_from_msg(Rosaudiosrc * src, audio_msgs::msg::Audio::ConstSharedPtr msg)
+/*
+ * Narrow the message to the channel-list, pick the pad format from ros-encoding and ros-layout,
+ * and prepare a converter from the selected channels when the formats differ
+ */
+static gboolean rosaudiosrc_set_output_format(Rosaudiosrc * src)
 {
   RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
 
-  GstAudioFormat fmt;
+  GstAudioFormat format = gst_bridge::getGstAudioFormat(src->encoding);
+  GstAudioLayout layout;
 
-  if(0 == g_strcmp0(src->encoding, "")) fmt = gst_bridge::getGstAudioFormat(msg->encoding);
-  else fmt = gst_bridge::getGstAudioFormat(src->encoding);
+  if(src->converter)
+  {
+    gst_audio_converter_free(src->converter);
+    src->converter = NULL;
+  }
 
-  gst_audio_info_set_format(&(src->audio_info),
-    fmt,
-    msg->sample_rate,
-    msg->channels,
-    NULL);
+  src->sel_info = src->msg_info;
+  if(!rosaudiosrc_channels_in_range(src))
+    return FALSE;  // getcaps fails negotiation
+  if(!src->channels.empty())
+    gst_bridge::audio_info_with_channels(&(src->msg_info), src->channels, &(src->sel_info));
+
+  if(format == GST_AUDIO_FORMAT_UNKNOWN)
+    format = GST_AUDIO_INFO_FORMAT(&(src->sel_info));
+  if(!gst_bridge::getGstAudioLayout(src->layout, &layout))
+    layout = GST_AUDIO_INFO_LAYOUT(&(src->sel_info));
+  if((format == GST_AUDIO_INFO_FORMAT(&(src->sel_info))) && (layout == GST_AUDIO_INFO_LAYOUT(&(src->sel_info))))
+  {
+    src->audio_info = src->sel_info;
+    return TRUE;
+  }
 
-  if((uint32_t)GST_AUDIO_INFO_BPF(&(src->audio_info)) != msg->step)
-      RCLCPP_ERROR(ros_base_src->logger, "audio format misunderstood, step %d != %d",
-      GST_AUDIO_INFO_BPF(&(src->audio_info)), msg->step);
-  if(GST_AUDIO_INFO_ENDIANNESS(&(src->audio_info)) != ((msg->is_bigendian == 1) ? G_BIG_ENDIAN : G_LITTLE_ENDIAN))
-      RCLCPP_ERROR(ros_base_src->logger, "audio format misunderstood, endianness %d != %d",
-      GST_AUDIO_INFO_ENDIANNESS(&(src->audio_info)), ((msg->is_bigendian == 1) ? G_BIG_ENDIAN : G_LITTLE_ENDIAN));
-  if(GST_AUDIO_INFO_LAYOUT(&(src->audio_info)) != ((msg->layout == audio_msgs::msg::Audio::LAYOUT_INTERLEAVED) ? GST_AUDIO_LAYOUT_INTERLEAVED : GST_AUDIO_LAYOUT_NON_INTERLEAVED))
-      RCLCPP_ERROR(ros_base_src->logger, "audio format misunderstood, layout %d != %d",
-      GST_AUDIO_INFO_LAYOUT(&(src->audio_info)), ((msg->layout == audio_msgs::msg::Audio::LAYOUT_INTERLEAVED) ? GST_AUDIO_LAYOUT_INTERLEAVED : GST_AUDIO_LAYOUT_NON_INTERLEAVED));
+  gst_bridge::audio_info_with_format(&(src->sel_info), format, layout, &(src->audio_info));
+  src->converter = gst_bridge::audio_converter_new(&(src->sel_info), &(src->audio_info), src->dither);
+  if(!src->converter)
+  {
+    RCLCPP_ERROR(ros_base_src->logger, "can't convert %s to %s",
+        GST_AUDIO_INFO_NAME(&(src->sel_info)), GST_AUDIO_INFO_NAME(&(src->audio_info)));
+    src->audio_info = src->sel_info;
+    return FALSE;
+  }
+  return TRUE;
+}
 
-  size_t blocksize = msg->step * msg->frames;
-  gst_base_src_set_blocksize(GST_BASE_SRC (src), blocksize);
 
-  src->msg_init = false;
+/* every channel-list entry has to name a channel of the messages */
+static gboolean rosaudiosrc_channels_in_range(Rosaudiosrc * src)
+{
+  for(guint c : src->channels)
+  {
+    if(c >= (guint) GST_AUDIO_INFO_CHANNELS(&(src->msg_info)))
+      return FALSE;
+  }
+  return TRUE;
 }
 
 
@@ -300,7 +456,18 @@ static gboolean rosaudiosrc_open (RosBaseSrc * ros_base_src)
   // ROS can't cope with some forms of std::bind being passed as subscriber callbacks,
   // lambdas seem to be the preferred case for these instances
   auto cb = [src] (audio_msgs::msg::Audio::ConstSharedPtr msg){rosaudiosrc_sub_cb(src, msg);};
-  rclcpp::QoS qos = rclcpp::SensorDataQoS();  //XXX add a parameter for overrides
+  rclcpp::QoS qos = rosbasesrc_sub_qos(ros_base_src);
+  rosbasesrc_queue_open(&(src->msg_queue));
+  if(src->compact)
+  {
+    auto compact_cb = [src] (audio_msgs::msg::CompactAudio::ConstSharedPtr msg){rosaudiosrc_compact_sub_cb(src, msg);};
+    auto info_cb = [src] (audio_msgs::msg::AudioInfo::ConstSharedPtr msg){rosaudiosrc_info_sub_cb(src, msg);};
+    src->compact_sub = ros_base_src->node->create_subscription<audio_msgs::msg::CompactAudio>(src->sub_topic, qos, compact_cb);
+    // the description is latched by the publisher, this picks it up even when joining late
+    src->info_sub = ros_base_src->node->create_subscription<audio_msgs::msg::AudioInfo>(
+        std::string(src->sub_topic) + "/info", rclcpp::QoS(1).reliable().transient_local(), info_cb);
+    return TRUE;
+  }
   src->sub = ros_base_src->node->create_subscription<audio_msgs::msg::Audio>(src->sub_topic, qos, cb);
 
   return TRUE;
@@ -314,10 +481,14 @@ static gboolean rosaudiosrc_close (RosBaseSrc * ros_base_src)
   GST_DEBUG_OBJECT (src, "close");
 
   src->sub.reset();
-  std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-  while(src->msg_queue.size() > 0)
+  src->compact_sub.reset();
+  src->info_sub.reset();
+  rosbasesrc_queue_close(&(src->msg_queue));
+
+  if(src->converter)
   {
-    src->msg_queue.pop();
+    gst_audio_converter_free(src->converter);
+    src->converter = NULL;
   }
 
   return TRUE;
@@ -391,7 +562,7 @@ static GstCaps* rosaudiosrc_getcaps (GstBaseSrc * gst_base_src, GstCaps * filter
   RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (gst_base_src);
   Rosaudiosrc *src = GST_ROSAUDIOSRC (gst_base_src);
 
-  static audio_msgs::msg::Audio::ConstSharedPtr msg;
+  RosaudiosrcMsg msg;
   GstCaps * caps;
 
   GST_DEBUG_OBJECT (src, "getcaps");
@@ -417,9 +588,16 @@ static GstCaps* rosaudiosrc_getcaps (GstBaseSrc * gst_base_src, GstCaps * filter
     }
     GST_DEBUG_OBJECT (src, "getcaps with node ready, waiting for message");
     RCLCPP_INFO(ros_base_src->logger, "waiting for first message");
-    msg = rosaudiosrc_wait_for_msg(src);
+    msg = rosbasesrc_queue_peek(&(src->msg_queue));
 
     rosaudiosrc_set_msg_props_from_msg(src, msg); //XXX generalise this to return audio_info instead of relying on side-effects
+    if(!rosaudiosrc_channels_in_range(src))
+    {
+      GST_ELEMENT_ERROR (src, CORE, NEGOTIATION,
+          ("channel-list '%s' selects channels the messages don't have", src->channel_list),
+          ("the messages carry %d channels", GST_AUDIO_INFO_CHANNELS(&(src->msg_info))));
+      return gst_caps_new_empty();
+    }
 
     caps = gst_audio_info_to_caps(&(src->audio_info));
     GST_DEBUG_OBJECT (src, "getcaps returning %s from first msg", gst_caps_to_string(caps));
@@ -429,8 +607,19 @@ static GstCaps* rosaudiosrc_getcaps (GstBaseSrc * gst_base_src, GstCaps * filter
   else
   {
     caps = gst_caps_from_string(src->init_caps);
-    if(gst_audio_info_from_caps(&(src->audio_info) , caps))
+    if(gst_audio_info_from_caps(&(src->msg_info) , caps))
     {
+      // init_caps describes the messages, the pad may carry another sample format
+      rosaudiosrc_set_output_format(src);
+      gst_caps_unref(caps);
+      if(!rosaudiosrc_channels_in_range(src))
+      {
+        GST_ELEMENT_ERROR (src, CORE, NEGOTIATION,
+            ("channel-list '%s' selects channels init-caps doesn't have", src->channel_list),
+            ("init-caps carries %d channels", GST_AUDIO_INFO_CHANNELS(&(src->msg_info))));
+        return gst_caps_new_empty();
+      }
+      caps = gst_audio_info_to_caps(&(src->audio_info));
       GST_DEBUG_OBJECT (src, "getcaps returning %s from init_caps", gst_caps_to_string(caps));
       src->msg_init = false;  //start checking message consistency
       return caps;
@@ -442,33 +631,6 @@ static GstCaps* rosaudiosrc_getcaps (GstBaseSrc * gst_base_src, GstCaps * filter
 }
 
 
-static gboolean rosaudiosrc_query (GstBaseSrc * gst_base_src, GstQuery * query)
-{
-  gboolean ret;
-
-  Rosaudiosrc *src = GST_ROSAUDIOSRC (gst_base_src);
-  GST_DEBUG_OBJECT (src, "query");
-
-  switch (GST_QUERY_TYPE (query)) {
-    case GST_QUERY_SCHEDULING:
-    {
-      /* a pushsrc can by default never operate in pull mode override
-       * if you want something different. */
-      gst_query_set_scheduling (query, GST_SCHEDULING_FLAG_SEQUENTIAL, 1, -1,
-          0);
-      gst_query_add_scheduling_mode (query, GST_PAD_MODE_PUSH);
-
-      ret = TRUE;
-      break;
-    }
-    default:
-      ret = GST_BASE_SRC_CLASS (rosaudiosrc_parent_class)->query (gst_base_src, query);
-      break;
-  }
-  return ret;
-}
-
-
 
 /*
  * Wait for a message to be published, then load the contents into buf
@@ -477,9 +639,10 @@ static gboolean rosaudiosrc_query (GstBaseSrc * gst_base_src, GstQuery * query)
  */
 static GstFlowReturn rosaudiosrc_create (GstBaseSrc * gst_base_src, guint64 offset, guint size, GstBuffer **buf)
 {
-  GstMapInfo info;
-  GstClockTimeDiff base_time;
+  GstAudioBuffer audio_buf;
+  gsize frames;
   size_t length;
+  gboolean converted;
   GstFlowReturn ret = GST_FLOW_OK;
   GstBuffer *res_buf;
 
@@ -497,14 +660,11 @@ static GstFlowReturn rosaudiosrc_create (GstBaseSrc * gst_base_src, guint64 offs
     GST_DEBUG_OBJECT (src, "ros audio creating buffer before receiving first message");
   }
 
-  auto msg = rosaudiosrc_wait_for_msg(src);
-  { //scope the mutex lock
-    std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-    src->msg_queue.pop();
-  }
+  auto msg = rosbasesrc_queue_pop(&(src->msg_queue));
   // XXX check sequence number and pad the buffer
 
-  length = msg->data.size();
+  frames = msg.data->size() / GST_AUDIO_INFO_BPF(&(src->msg_info));
+  length = frames * GST_AUDIO_INFO_BPF(&(src->audio_info));
   if (*buf == NULL) {
     /* downstream did not provide us with a buffer to fill, allocate one
      * ourselves 
@@ -523,13 +683,64 @@ static GstFlowReturn rosaudiosrc_create (GstBaseSrc * gst_base_src, guint64 offs
   if(length != size)
     GST_DEBUG_OBJECT (src, "size mismatch, %ld, %d", length, size);
 
-  gst_buffer_map (*buf, &info, GST_MAP_READ);
-  info.size = length;
-  memcpy(info.data, msg->data.data(), length);
-  gst_buffer_unmap (*buf, &info);
+  // planar buffers carry their plane offsets in GstAudioMeta
+  if((GST_AUDIO_INFO_LAYOUT(&(src->audio_info)) == GST_AUDIO_LAYOUT_NON_INTERLEAVED) && !gst_buffer_get_audio_meta(*buf))
+    gst_buffer_add_audio_meta(*buf, &(src->audio_info), frames, NULL);
 
-  base_time = gst_element_get_base_time(GST_ELEMENT(src));
-  GST_BUFFER_PTS (*buf) = rclcpp::Time(msg->header.stamp).nanoseconds() - ros_base_src->ros_clock_offset - base_time;   // XXX +basetime?
+  if(!gst_audio_buffer_map (&audio_buf, &(src->audio_info), *buf, GST_MAP_WRITE))
+  {
+    RCLCPP_ERROR(ros_base_src->logger, "failed to map audio buffer");
+    return GST_FLOW_ERROR;
+  }
+  // convert or copy straight out of the message into the buffer
+  std::vector<gpointer> planes = gst_bridge::audio_msg_planes(&(src->msg_info), msg.data->data(), frames);
+  converted = FALSE;
+  if(!src->channels.empty())
+  {
+    guint n = src->channels.size();
+    gint bps = GST_AUDIO_INFO_BPS(&(src->sel_info));
+
+    if(GST_AUDIO_INFO_LAYOUT(&(src->msg_info)) == GST_AUDIO_LAYOUT_NON_INTERLEAVED)
+    {
+      // planar messages only need the selected planes
+      std::vector<gpointer> all_planes = planes;
+      planes.clear();
+      for(guint c : src->channels)
+        planes.push_back(all_planes[c]);
+    }
+    else
+    {
+      // gather straight into the buffer when the format is kept, otherwise into the conversion input
+      gboolean into_buffer = (GST_AUDIO_INFO_FORMAT(&(src->sel_info)) == GST_AUDIO_INFO_FORMAT(&(src->audio_info)));
+      gboolean planar_out = into_buffer && (GST_AUDIO_INFO_LAYOUT(&(src->audio_info)) == GST_AUDIO_LAYOUT_NON_INTERLEAVED);
+      std::vector<guint8 *> dst(n);
+      std::vector<guint> dst_stride(n, planar_out ? 1 : n);
+
+      if(!into_buffer)
+        src->gather_buf.resize(frames * GST_AUDIO_INFO_BPF(&(src->sel_info)));
+      for(guint k = 0; k < n; k++)
+      {
+        if(planar_out)
+          dst[k] = (guint8 *) audio_buf.planes[k];
+        else
+          dst[k] = (into_buffer ? (guint8 *) audio_buf.planes[0] : src->gather_buf.data()) + k * bps;
+      }
+      gst_bridge::audio_gather_channels(&(src->msg_info), msg.data->data(), src->channels, dst.data(), dst_stride.data(), frames);
+      converted = into_buffer;
+      planes.assign(1, (gpointer) src->gather_buf.data());
+    }
+  }
+  if(!converted)
+    converted = gst_bridge::audio_convert_samples(src->converter, &(src->sel_info), &(src->audio_info),
+        planes.data(), audio_buf.planes, frames);
+  gst_audio_buffer_unmap (&audio_buf);
+  if(!converted)
+  {
+    RCLCPP_ERROR(ros_base_src->logger, "sample conversion failed");
+    return GST_FLOW_ERROR;
+  }
+
+  GST_BUFFER_PTS (*buf) = rosbasesrc_msg_stamp_to_pts(ros_base_src, rclcpp::Time(msg.stamp).nanoseconds());
 
   return GST_FLOW_OK;
 }
@@ -539,57 +750,71 @@ static GstFlowReturn rosaudiosrc_create (GstBaseSrc * gst_base_src, guint64 offs
 static void rosaudiosrc_sub_cb(Rosaudiosrc * src, audio_msgs::msg::Audio::ConstSharedPtr msg)
 {
   RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
+  RosaudiosrcMsg entry;
 
   //GST_DEBUG_OBJECT (src, "ros cb called");
   //RCLCPP_DEBUG(ros_base_src->logger, "ros cb called");
 
-  //fetch caps from the first msg, check on subsequent
-  if(!(src->msg_init))
-    {
-    if((uint32_t) GST_AUDIO_INFO_BPF(&(src->audio_info)) != msg->step)
-      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, step %d != %d",
-        GST_AUDIO_INFO_BPF(&(src->audio_info)), msg->step);
-    if((uint32_t) GST_AUDIO_INFO_CHANNELS(&(src->audio_info)) != msg->channels)
-      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, channels %d != %d",
-        GST_AUDIO_INFO_CHANNELS(&(src->audio_info)), msg->channels);
-    if(GST_AUDIO_INFO_RATE(&(src->audio_info)) != msg->sample_rate)
-      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, sample_rate %d != %d",
-        GST_AUDIO_INFO_RATE(&(src->audio_info)), msg->sample_rate);
-    if(gst_bridge::getRosEncoding(GST_AUDIO_INFO_FORMAT(&(src->audio_info))) != msg->encoding.c_str() )
-      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, encoding %s != %s",
-        gst_bridge::getRosEncoding(GST_AUDIO_INFO_FORMAT(&(src->audio_info))), msg->encoding.c_str()); // XXX account for the override
-    if(GST_AUDIO_INFO_ENDIANNESS(&(src->audio_info)) != (msg->is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN))
-      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, endianness %d != %d",
-        GST_AUDIO_INFO_ENDIANNESS(&(src->audio_info)), (msg->is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN));
-    if(GST_AUDIO_INFO_LAYOUT(&(src->audio_info)) != msg->layout)  // XXX really do need a converter beteen the enums
-      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, layout %d != %d",
-        GST_AUDIO_INFO_LAYOUT(&(src->audio_info)), msg->layout);
+  if(!gst_bridge::audio_msg_to_gst_audio_info(*msg, &(entry.info)))
+  {
+    RCLCPP_ERROR(ros_base_src->logger, "audio format misunderstood, encoding %s with step %d, dropping message",
+      msg->encoding.c_str(), msg->step);
+    return;
   }
+  entry.msg = msg;
+  entry.data = &(msg->data);
+  entry.stamp = msg->header.stamp;
+  rosaudiosrc_queue_msg(src, entry);
+}
+
+// the same as an Audio message, without the encoding string to parse
+static void rosaudiosrc_compact_sub_cb(Rosaudiosrc * src, audio_msgs::msg::CompactAudio::ConstSharedPtr msg)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
+  RosaudiosrcMsg entry;
 
-  std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-  src->msg_queue.push(msg);
-  while(src->msg_queue.size() > src->msg_queue_max)
+  if(!gst_bridge::compact_audio_msg_to_gst_audio_info(*msg, &(entry.info)))
   {
-    src->msg_queue.pop();
-    RCLCPP_WARN(ros_base_src->logger, "dropping message");
+    RCLCPP_ERROR(ros_base_src->logger, "audio format misunderstood, format %d, dropping message", msg->format);
+    return;
   }
-  src->msg_queue_cv.notify_one();
+  entry.msg = msg;
+  entry.data = &(msg->data);
+  entry.stamp = msg->stamp;
+  rosaudiosrc_queue_msg(src, entry);
 }
 
-
-static audio_msgs::msg::Audio::ConstSharedPtr rosaudiosrc_wait_for_msg(Rosaudiosrc * src)
+// the compact messages carry everything needed to play them, the description adds the frame_id
+static void rosaudiosrc_info_sub_cb(Rosaudiosrc * src, audio_msgs::msg::AudioInfo::ConstSharedPtr msg)
 {
-  //RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
+
+  RCLCPP_INFO(ros_base_src->logger, "stream described as %s, %d channels at %dHz, frame_id '%s'",
+    msg->encoding.c_str(), msg->channels, msg->sample_rate, msg->header.frame_id.c_str());
+  g_free(src->frame_id);
+  src->frame_id = g_strdup(msg->header.frame_id.c_str());
+}
 
-  GST_DEBUG_OBJECT (src, "wait for msg");
+static void rosaudiosrc_queue_msg(Rosaudiosrc * src, const RosaudiosrcMsg & msg)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
 
-  std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-  while(src->msg_queue.empty())
+  //fetch caps from the first msg, check on subsequent
+  if(!(src->msg_init))
   {
-    src->msg_queue_cv.wait(lck);
+    if(GST_AUDIO_INFO_CHANNELS(&(src->msg_info)) != GST_AUDIO_INFO_CHANNELS(&(msg.info)))
+      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, channels %d != %d",
+        GST_AUDIO_INFO_CHANNELS(&(src->msg_info)), GST_AUDIO_INFO_CHANNELS(&(msg.info)));
+    if(GST_AUDIO_INFO_RATE(&(src->msg_info)) != GST_AUDIO_INFO_RATE(&(msg.info)))
+      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, sample_rate %d != %d",
+        GST_AUDIO_INFO_RATE(&(src->msg_info)), GST_AUDIO_INFO_RATE(&(msg.info)));
+    if(GST_AUDIO_INFO_FORMAT(&(src->msg_info)) != GST_AUDIO_INFO_FORMAT(&(msg.info)))
+      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, encoding %s != %s",
+        GST_AUDIO_INFO_NAME(&(src->msg_info)), GST_AUDIO_INFO_NAME(&(msg.info)));
+    if(GST_AUDIO_INFO_LAYOUT(&(src->msg_info)) != GST_AUDIO_INFO_LAYOUT(&(msg.info)))
+      RCLCPP_ERROR(ros_base_src->logger, "audio format changed during playback, layout %d != %d",
+        GST_AUDIO_INFO_LAYOUT(&(src->msg_info)), GST_AUDIO_INFO_LAYOUT(&(msg.info)));
   }
-  auto msg = src->msg_queue.front();
-
-  return msg;
 
+  rosbasesrc_queue_push(ros_base_src, &(src->msg_queue), msg);
 }
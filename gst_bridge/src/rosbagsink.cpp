@@ -0,0 +1,546 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-rosbagsink
+ *
+ * The rosbagsink element, record image or audio data straight into a rosbag2 file.
+ * Messages are built exactly as rosimagesink and rosaudiosink would publish them,
+ * but are serialized and written by a dedicated I/O thread instead of going through DDS.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v v4l2src ! videoconvert ! rosbagsink bag-uri="my_bag" ros-topic="/image_raw"
+ * ]|
+ * records a camera into a bag without a ros2 bag record process.
+ * </refsect2>
+ */
+
+
+#include <gst_bridge/rosbagsink.h>
+
+#include <rosbag2_cpp/converter_options.hpp>
+#include <rosbag2_cpp/storage_options.hpp>
+#include <rosbag2_storage/serialized_bag_message.hpp>
+#include <rosbag2_storage/topic_metadata.hpp>
+#include <rmw/rmw.h>
+
+GST_DEBUG_CATEGORY_STATIC (rosbagsink_debug_category);
+#define GST_CAT_DEFAULT rosbagsink_debug_category
+
+#define ROSBAGSINK_IMAGE_TYPE "sensor_msgs/msg/Image"
+#define ROSBAGSINK_AUDIO_TYPE "audio_msgs/msg/Audio"
+
+/* prototypes */
+
+
+static void rosbagsink_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void rosbagsink_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+static void rosbagsink_finalize (GObject * object);
+
+static void rosbagsink_init (Rosbagsink * sink);
+
+static gboolean rosbagsink_open (RosBaseSink * ros_base_sink);
+static gboolean rosbagsink_close (RosBaseSink * ros_base_sink);
+static gboolean rosbagsink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps);
+
+static GstFlowReturn rosbagsink_render (RosBaseSink * sink, GstBuffer * buffer, rclcpp::Time msg_time);
+
+static void rosbagsink_io_loop (Rosbagsink * sink);
+static void rosbagsink_drain (Rosbagsink * sink);
+static gboolean rosbagsink_write (Rosbagsink * sink, GstBuffer * buf, rclcpp::Time stamp);
+
+enum
+{
+  PROP_0,
+  PROP_BAG_URI,
+  PROP_STORAGE_ID,
+  PROP_ROS_TOPIC,
+  PROP_ROS_FRAME_ID,
+  PROP_MAX_CACHE_SIZE,
+  PROP_MAX_QUEUE,
+};
+
+
+/* pad templates */
+
+// the pad template is generated from the image format table in class_init
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Rosbagsink, rosbagsink, GST_TYPE_ROS_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (rosbagsink_debug_category, "rosbagsink", 0,
+        "debug category for rosbagsink element"))
+
+static void rosbagsink_class_init (RosbagsinkClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+  RosBaseSinkClass *ros_base_sink_class = GST_ROS_BASE_SINK_CLASS (klass);
+  GstCaps *template_caps;
+
+  object_class->set_property = rosbagsink_set_property;
+  object_class->get_property = rosbagsink_get_property;
+  object_class->finalize = rosbagsink_finalize;
+
+  template_caps = gst_bridge::getImageMsgCaps();
+  gst_caps_append (template_caps, gst_caps_from_string (ROS_AUDIO_MSG_CAPS));
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS, template_caps));
+  gst_caps_unref (template_caps);
+
+  gst_element_class_set_static_metadata (element_class,
+      "rosbagsink",
+      "Sink/File",
+      "a gstreamer sink that records image or audio data into a rosbag2 file",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_BAG_URI,
+      g_param_spec_string ("bag-uri", "bag-uri", "path of the rosbag2 to write",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_STORAGE_ID,
+      g_param_spec_string ("storage-id", "storage-id", "rosbag2 storage plugin",
+      "sqlite3",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "topic", "topic name recorded in the bag",
+      "gst_bag_topic",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FRAME_ID,
+      g_param_spec_string ("ros-frame-id", "frame-id", "frame_id of the recorded messages",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_MAX_CACHE_SIZE,
+      g_param_spec_uint64 ("max-cache-size", "max-cache-size",
+      "bytes the rosbag2 writer caches before committing a batch to storage, 0 writes every message",
+      0, G_MAXUINT64, 100*1024*1024,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_MAX_QUEUE,
+      g_param_spec_uint ("max-queue", "max-queue",
+      "buffers held for the I/O thread before render blocks",
+      1, G_MAXUINT, 30,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  //access gstreamer base sink events here
+  basesink_class->set_caps = GST_DEBUG_FUNCPTR (rosbagsink_setcaps);  //gstreamer informs us what caps we're using.
+
+  //supply the calls ros base sink needs to manage the writer
+  ros_base_sink_class->open = GST_DEBUG_FUNCPTR (rosbagsink_open);  //open the bag and start the I/O thread
+  ros_base_sink_class->close = GST_DEBUG_FUNCPTR (rosbagsink_close);  //flush and close the bag
+  ros_base_sink_class->render = GST_DEBUG_FUNCPTR (rosbagsink_render); // gives us a buffer to queue
+}
+
+static void rosbagsink_init (Rosbagsink * sink)
+{
+  RosBaseSink *ros_base_sink GST_ROS_BASE_SINK(sink);
+  ros_base_sink->node_name = g_strdup("gst_bag_sink_node");
+  sink->bag_uri = g_strdup("");
+  sink->storage_id = g_strdup("sqlite3");
+  sink->topic = g_strdup("gst_bag_topic");
+  sink->frame_id = g_strdup("");
+  sink->max_cache_size = 100*1024*1024;
+  sink->max_queue = 30;
+
+  // GObject doesn't run C++ constructors
+  new (&(sink->writer)) std::unique_ptr<rosbag2_cpp::writers::SequentialWriter>();
+  new (&(sink->io_thread)) std::thread();
+  new (&(sink->queue_mtx)) std::mutex();
+  new (&(sink->queue_cv)) std::condition_variable();
+  new (&(sink->queue)) std::deque<rosbagsink_item>();
+
+  sink->topic_created = FALSE;
+  sink->is_audio = FALSE;
+  sink->encoding = NULL;
+  sink->msg_seq_num = 0;
+  sink->io_busy = false;
+  sink->io_running = false;
+  sink->io_flow = GST_FLOW_OK;
+}
+
+static void rosbagsink_finalize (GObject * object)
+{
+  Rosbagsink *sink = GST_ROSBAGSINK (object);
+
+  g_free(sink->bag_uri);
+  g_free(sink->storage_id);
+  g_free(sink->topic);
+  g_free(sink->frame_id);
+  g_free(sink->encoding);
+
+  sink->writer.~unique_ptr();
+  sink->io_thread.~thread();
+  sink->queue_mtx.~mutex();
+  sink->queue_cv.~condition_variable();
+  sink->queue.~deque();
+
+  G_OBJECT_CLASS (rosbagsink_parent_class)->finalize (object);
+}
+
+void rosbagsink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  Rosbagsink *sink = GST_ROSBAGSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "set_property");
+
+  switch (property_id) {
+    case PROP_MAX_QUEUE:
+    {
+      std::lock_guard<std::mutex> lock(sink->queue_mtx);
+      sink->max_queue = g_value_get_uint(value);
+      sink->queue_cv.notify_all();
+      return;
+    }
+
+    default:
+      break;
+  }
+
+  if(sink->writer)
+  {
+    GST_WARNING_OBJECT (sink, "can't change %s once the bag is open", pspec->name);
+    return;
+  }
+
+  switch (property_id) {
+    case PROP_BAG_URI:
+      g_free(sink->bag_uri);
+      sink->bag_uri = g_value_dup_string(value);
+      break;
+
+    case PROP_STORAGE_ID:
+      g_free(sink->storage_id);
+      sink->storage_id = g_value_dup_string(value);
+      break;
+
+    case PROP_ROS_TOPIC:
+      g_free(sink->topic);
+      sink->topic = g_value_dup_string(value);
+      break;
+
+    // the I/O thread reads it without a lock
+    case PROP_ROS_FRAME_ID:
+      g_free(sink->frame_id);
+      sink->frame_id = g_value_dup_string(value);
+      break;
+
+    case PROP_MAX_CACHE_SIZE:
+      sink->max_cache_size = g_value_get_uint64(value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void rosbagsink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Rosbagsink *sink = GST_ROSBAGSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "get_property");
+  switch (property_id) {
+    case PROP_BAG_URI:
+      g_value_set_string(value, sink->bag_uri);
+      break;
+
+    case PROP_STORAGE_ID:
+      g_value_set_string(value, sink->storage_id);
+      break;
+
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, sink->topic);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_value_set_string(value, sink->frame_id);
+      break;
+
+    case PROP_MAX_CACHE_SIZE:
+      g_value_set_uint64(value, sink->max_cache_size);
+      break;
+
+    case PROP_MAX_QUEUE:
+      g_value_set_uint(value, sink->max_queue);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+/* open the bag and start the I/O thread */
+static gboolean rosbagsink_open (RosBaseSink * ros_base_sink)
+{
+  Rosbagsink *sink = GST_ROSBAGSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "open");
+
+  rosbag2_cpp::StorageOptions storage_options;
+  storage_options.uri = sink->bag_uri;
+  storage_options.storage_id = sink->storage_id;
+  storage_options.max_cache_size = sink->max_cache_size;  // the writer commits the cache as one batch
+
+  rosbag2_cpp::ConverterOptions converter_options;
+  converter_options.input_serialization_format = rmw_get_serialization_format();
+  converter_options.output_serialization_format = rmw_get_serialization_format();
+
+  sink->writer = std::make_unique<rosbag2_cpp::writers::SequentialWriter>();
+  try
+  {
+    sink->writer->open(storage_options, converter_options);
+  }
+  catch (const std::exception & e)
+  {
+    RCLCPP_ERROR(ros_base_sink->node->get_logger(), "failed to open bag '%s': %s", sink->bag_uri, e.what());
+    sink->writer.reset();
+    return FALSE;
+  }
+
+  sink->topic_created = FALSE;
+  sink->msg_seq_num = 0;
+  sink->io_busy = false;
+  sink->io_running = true;
+  sink->io_flow = GST_FLOW_OK;
+  sink->io_thread = std::thread(rosbagsink_io_loop, sink);
+
+  return TRUE;
+}
+
+/* flush the queue and close the bag */
+static gboolean rosbagsink_close (RosBaseSink * ros_base_sink)
+{
+  Rosbagsink *sink = GST_ROSBAGSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "close");
+
+  {
+    std::lock_guard<std::mutex> lock(sink->queue_mtx);
+    sink->io_running = false;
+    sink->queue_cv.notify_all();
+  }
+  if(sink->io_thread.joinable())
+    sink->io_thread.join();
+
+  // the destructor commits whatever is left in the writer cache
+  sink->writer.reset();
+
+  return TRUE;
+}
+
+
+// gstreamer is changing the caps, try to adapt to it
+static gboolean rosbagsink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (gst_base_sink);
+  Rosbagsink *sink = GST_ROSBAGSINK (ros_base_sink);
+
+  GstStructure *caps_struct;
+  gboolean is_audio;
+  rosbag2_storage::TopicMetadata topic_meta;
+
+  GST_DEBUG_OBJECT (sink, "setcaps");
+
+  if(!gst_caps_is_fixed(caps))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "caps is not fixed");
+    return false;
+  }
+
+  if(ros_base_sink->node)
+      RCLCPP_INFO(ros_base_sink->logger, "recording with caps '%s'",
+          gst_caps_to_string(caps));
+
+  caps_struct = gst_caps_get_structure (caps, 0);
+  is_audio = gst_structure_has_name(caps_struct, "audio/x-raw");
+
+  if(sink->topic_created && (is_audio != sink->is_audio))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "can't change media type of a recorded topic");
+    return false;
+  }
+
+  // queued buffers were negotiated with the old caps
+  rosbagsink_drain(sink);
+
+  if(is_audio)
+  {
+    if(!gst_audio_info_from_caps(&(sink->audio_info), caps))
+      return false;
+  }
+  else
+  {
+    std::string encoding;
+    if(!gst_bridge::video_info_from_caps(&(sink->video_info), &encoding, caps))
+      return false;
+    g_free(sink->encoding);
+    sink->encoding = g_strdup(encoding.c_str());
+  }
+  sink->is_audio = is_audio;
+
+  if(!sink->topic_created)
+  {
+    topic_meta.name = sink->topic;
+    topic_meta.type = is_audio ? ROSBAGSINK_AUDIO_TYPE : ROSBAGSINK_IMAGE_TYPE;
+    topic_meta.serialization_format = rmw_get_serialization_format();
+    topic_meta.offered_qos_profiles = "";
+    sink->writer->create_topic(topic_meta);
+    sink->topic_created = TRUE;
+  }
+
+  return true;
+}
+
+
+static GstFlowReturn rosbagsink_render (RosBaseSink * ros_base_sink, GstBuffer * buf, rclcpp::Time msg_time)
+{
+  Rosbagsink *sink = GST_ROSBAGSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "render");
+
+  std::unique_lock<std::mutex> lock(sink->queue_mtx);
+
+  // block the streaming thread rather than drop frames when the disk falls behind
+  sink->queue_cv.wait(lock, [sink]{
+    return (sink->queue.size() < sink->max_queue) || !sink->io_running;
+  });
+
+  if(!sink->io_running)
+    return GST_FLOW_FLUSHING;
+  // the I/O thread has already posted the error, stop the pipeline rather than lose every frame
+  if(sink->io_flow != GST_FLOW_OK)
+    return sink->io_flow;
+
+  sink->queue.push_back({gst_buffer_ref(buf), msg_time});
+  sink->queue_cv.notify_all();
+
+  return GST_FLOW_OK;
+}
+
+
+/* wait for the I/O thread to write everything queued so far */
+static void rosbagsink_drain (Rosbagsink * sink)
+{
+  std::unique_lock<std::mutex> lock(sink->queue_mtx);
+  sink->queue_cv.wait(lock, [sink]{
+    return (sink->queue.empty() && !sink->io_busy) || !sink->io_running;
+  });
+}
+
+
+/*
+ * take everything queued in one go, so the writer sees bursts rather than single frames
+ * the first failed write is latched, everything after it is dropped until the bag is reopened
+ */
+static void rosbagsink_io_loop (Rosbagsink * sink)
+{
+  std::deque<rosbagsink_item> batch;
+  gboolean failed = FALSE;
+
+  while(true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(sink->queue_mtx);
+      sink->io_busy = false;
+      sink->queue_cv.notify_all();
+      sink->queue_cv.wait(lock, [sink]{
+        return !sink->queue.empty() || !sink->io_running;
+      });
+      if(sink->queue.empty())
+        break;
+      batch.swap(sink->queue);
+      sink->io_busy = true;
+      sink->queue_cv.notify_all();  //render may be waiting for space
+    }
+
+    for(auto & item : batch)
+    {
+      if(!failed && !rosbagsink_write(sink, item.buf, item.stamp))
+      {
+        failed = TRUE;
+        GST_ELEMENT_ERROR (sink, RESOURCE, WRITE, ("failed to write to bag '%s'", sink->bag_uri), (NULL));
+        std::lock_guard<std::mutex> lock(sink->queue_mtx);
+        sink->io_flow = GST_FLOW_ERROR;
+      }
+      gst_buffer_unref(item.buf);
+    }
+    batch.clear();
+  }
+}
+
+
+/* build the message rosimagesink or rosaudiosink would publish, serialize it and hand it to the writer */
+static gboolean rosbagsink_write (Rosbagsink * sink, GstBuffer * buf, rclcpp::Time stamp)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (sink);
+  std::shared_ptr<rcutils_uint8_array_t> serialized;
+
+  if(sink->is_audio)
+  {
+    audio_msgs::msg::Audio msg = gst_bridge::gst_audio_info_to_audio_msg(&(sink->audio_info));
+    msg.header.stamp = stamp;
+    msg.header.frame_id = sink->frame_id;
+    gst_bridge::fill_audio_msg_data(msg, buf, &(sink->msg_seq_num));
+    serialized = gst_bridge::serialize_msg(msg);
+  }
+  else
+  {
+    sensor_msgs::msg::Image msg = gst_bridge::gst_video_info_to_image_msg(&(sink->video_info));
+    msg.encoding = sink->encoding;
+    msg.header.stamp = stamp;
+    msg.header.frame_id = sink->frame_id;
+    gst_bridge::fill_image_msg_data(msg, &(sink->video_info), buf);
+    serialized = gst_bridge::serialize_msg(msg);
+  }
+
+  if(!serialized)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "failed to serialize message for the bag");
+    return FALSE;
+  }
+
+  auto bag_msg = std::make_shared<rosbag2_storage::SerializedBagMessage>();
+  bag_msg->serialized_data = serialized;
+  bag_msg->topic_name = sink->topic;
+  bag_msg->time_stamp = stamp.nanoseconds();
+
+  try
+  {
+    sink->writer->write(bag_msg);
+  }
+  catch (const std::exception & e)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "failed to write to bag: %s", e.what());
+    return FALSE;
+  }
+  return TRUE;
+}
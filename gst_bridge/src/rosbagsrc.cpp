@@ -0,0 +1,714 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-rosbagsrc
+ *
+ * The rosbagsrc element, read image or audio messages straight out of a rosbag2 file.
+ * Buffers carry the same caps and timestamps as a non-live rosimagesrc or rosaudiosrc,
+ * without going through DDS. The source is seekable, and honours the segment rate.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v rosbagsrc bag-uri="my_bag" ros-topic="/image_raw" ! videoconvert ! x264enc ! mp4mux ! filesink location=out.mp4
+ * ]|
+ * transcodes a recorded image topic at disk speed.
+ * </refsect2>
+ */
+
+
+#include <gst_bridge/rosbagsrc.h>
+
+#include <rosbag2_cpp/converter_options.hpp>
+#include <rosbag2_cpp/storage_options.hpp>
+#include <rosbag2_storage/storage_filter.hpp>
+#include <rosidl_typesupport_cpp/message_type_support.hpp>
+#include <rmw/rmw.h>
+
+GST_DEBUG_CATEGORY_STATIC (rosbagsrc_debug_category);
+#define GST_CAT_DEFAULT rosbagsrc_debug_category
+
+#define ROSBAGSRC_IMAGE_TYPE "sensor_msgs/msg/Image"
+#define ROSBAGSRC_AUDIO_TYPE "audio_msgs/msg/Audio"
+
+/* prototypes */
+
+
+static void rosbagsrc_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void rosbagsrc_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+static void rosbagsrc_finalize (GObject * object);
+
+static void rosbagsrc_init (Rosbagsrc * src);
+
+static gboolean rosbagsrc_start (GstBaseSrc * base_src);
+static gboolean rosbagsrc_stop (GstBaseSrc * base_src);
+static GstCaps* rosbagsrc_getcaps (GstBaseSrc * base_src, GstCaps * filter);
+static gboolean rosbagsrc_is_seekable (GstBaseSrc * base_src);
+static gboolean rosbagsrc_do_seek (GstBaseSrc * base_src, GstSegment * segment);
+static gboolean rosbagsrc_query (GstBaseSrc * base_src, GstQuery * query);
+static GstFlowReturn rosbagsrc_create (GstBaseSrc * base_src, guint64 offset, guint size, GstBuffer **buf);
+
+static std::unique_ptr<rosbag2_cpp::readers::SequentialReader> rosbagsrc_reader_new (Rosbagsrc * src);
+static gboolean rosbagsrc_reader_open (Rosbagsrc * src);
+static gboolean rosbagsrc_set_pending (Rosbagsrc * src, std::shared_ptr<rosbag2_storage::SerializedBagMessage> bag_msg);
+static gboolean rosbagsrc_read_next (Rosbagsrc * src);
+static GstClockTime rosbagsrc_topic_duration (Rosbagsrc * src);
+
+
+enum
+{
+  PROP_0,
+  PROP_BAG_URI,
+  PROP_STORAGE_ID,
+  PROP_ROS_TOPIC,
+};
+
+/* pad templates */
+
+// the pad template is generated from the image format table in class_init
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Rosbagsrc, rosbagsrc, GST_TYPE_BASE_SRC,
+    GST_DEBUG_CATEGORY_INIT (rosbagsrc_debug_category, "rosbagsrc", 0,
+        "debug category for rosbagsrc element"))
+
+static void rosbagsrc_class_init (RosbagsrcClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  GstCaps *template_caps;
+
+  object_class->set_property = rosbagsrc_set_property;
+  object_class->get_property = rosbagsrc_get_property;
+  object_class->finalize = rosbagsrc_finalize;
+
+  template_caps = gst_bridge::getImageMsgCaps();
+  gst_caps_append (template_caps, gst_caps_from_string (ROS_AUDIO_MSG_CAPS));
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS, template_caps));
+  gst_caps_unref (template_caps);
+
+  gst_element_class_set_static_metadata (element_class,
+      "rosbagsrc",
+      "Source/File",
+      "a gstreamer source that reads image and audio messages from a rosbag2 file",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_BAG_URI,
+      g_param_spec_string ("bag-uri", "bag-uri", "path of the rosbag2 to read",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_STORAGE_ID,
+      g_param_spec_string ("storage-id", "storage-id", "rosbag2 storage plugin",
+      "sqlite3",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "topic", "recorded topic to play, sensor_msgs/Image or audio_msgs/Audio",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  basesrc_class->start = GST_DEBUG_FUNCPTR (rosbagsrc_start);  //open the bag and discover the caps
+  basesrc_class->stop = GST_DEBUG_FUNCPTR (rosbagsrc_stop);  //close the bag
+  basesrc_class->get_caps = GST_DEBUG_FUNCPTR (rosbagsrc_getcaps);  //caps of the recorded topic
+  basesrc_class->is_seekable = GST_DEBUG_FUNCPTR (rosbagsrc_is_seekable);
+  basesrc_class->do_seek = GST_DEBUG_FUNCPTR (rosbagsrc_do_seek);  //re-position the reader
+  basesrc_class->query = GST_DEBUG_FUNCPTR (rosbagsrc_query);  //duration and scheduling
+  basesrc_class->create = GST_DEBUG_FUNCPTR (rosbagsrc_create);  //wrap the next message in a buffer
+}
+
+static void rosbagsrc_init (Rosbagsrc * src)
+{
+  src->bag_uri = g_strdup("");
+  src->storage_id = g_strdup("sqlite3");
+  src->topic = g_strdup("");
+  src->topic_type = g_strdup("");
+
+  // GObject doesn't run C++ constructors
+  new (&(src->reader)) std::unique_ptr<rosbag2_cpp::readers::SequentialReader>();
+  new (&(src->pending_image)) sensor_msgs::msg::Image::SharedPtr();
+  new (&(src->pending_audio)) audio_msgs::msg::Audio::SharedPtr();
+
+  src->duration = GST_CLOCK_TIME_NONE;
+  src->duration_scanned = FALSE;
+  src->stamp_origin = 0;
+  src->bag_origin = 0;
+  src->caps = NULL;
+  src->trickmode_count = 0;
+
+  /* recorded data has no live clock, run as fast as downstream allows */
+  gst_base_src_set_live (GST_BASE_SRC (src), FALSE);
+  gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
+}
+
+static void rosbagsrc_finalize (GObject * object)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (object);
+
+  g_free(src->bag_uri);
+  g_free(src->storage_id);
+  g_free(src->topic);
+  g_free(src->topic_type);
+
+  src->reader.~unique_ptr();
+  src->pending_image.~shared_ptr();
+  src->pending_audio.~shared_ptr();
+
+  G_OBJECT_CLASS (rosbagsrc_parent_class)->finalize (object);
+}
+
+void rosbagsrc_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (object);
+
+  GST_DEBUG_OBJECT (src, "set_property");
+
+  if(src->reader)
+  {
+    GST_WARNING_OBJECT (src, "can't change %s once the bag is open", pspec->name);
+    return;
+  }
+
+  switch (property_id)
+  {
+    case PROP_BAG_URI:
+      g_free(src->bag_uri);
+      src->bag_uri = g_value_dup_string(value);
+      break;
+
+    case PROP_STORAGE_ID:
+      g_free(src->storage_id);
+      src->storage_id = g_value_dup_string(value);
+      break;
+
+    case PROP_ROS_TOPIC:
+      g_free(src->topic);
+      src->topic = g_value_dup_string(value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void rosbagsrc_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (object);
+
+  GST_DEBUG_OBJECT (src, "get_property");
+  switch (property_id)
+  {
+    case PROP_BAG_URI:
+      g_value_set_string(value, src->bag_uri);
+      break;
+
+    case PROP_STORAGE_ID:
+      g_value_set_string(value, src->storage_id);
+      break;
+
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, src->topic);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+/* a reader on the bag restricted to our topic, throws if the bag can't be opened */
+static std::unique_ptr<rosbag2_cpp::readers::SequentialReader> rosbagsrc_reader_new (Rosbagsrc * src)
+{
+  rosbag2_cpp::StorageOptions storage_options;
+  storage_options.uri = src->bag_uri;
+  storage_options.storage_id = src->storage_id;
+
+  rosbag2_cpp::ConverterOptions converter_options;
+  converter_options.input_serialization_format = rmw_get_serialization_format();
+  converter_options.output_serialization_format = rmw_get_serialization_format();
+
+  auto reader = std::make_unique<rosbag2_cpp::readers::SequentialReader>();
+  reader->open(storage_options, converter_options);
+
+  rosbag2_storage::StorageFilter storage_filter;
+  storage_filter.topics.push_back(src->topic);
+  reader->set_filter(storage_filter);
+
+  return reader;
+}
+
+/* open the playback reader */
+static gboolean rosbagsrc_reader_open (Rosbagsrc * src)
+{
+  try
+  {
+    src->reader = rosbagsrc_reader_new(src);
+  }
+  catch (const std::exception & e)
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, ("failed to open bag '%s'", src->bag_uri), ("%s", e.what()));
+    src->reader.reset();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/* deserialize a recorded message into the pending slot */
+static gboolean rosbagsrc_set_pending (Rosbagsrc * src, std::shared_ptr<rosbag2_storage::SerializedBagMessage> bag_msg)
+{
+  rmw_ret_t ret;
+
+  if(0 == g_strcmp0(src->topic_type, ROSBAGSRC_IMAGE_TYPE))
+  {
+    src->pending_image = std::make_shared<sensor_msgs::msg::Image>();
+    ret = rmw_deserialize(bag_msg->serialized_data.get(),
+        rosidl_typesupport_cpp::get_message_type_support_handle<sensor_msgs::msg::Image>(),
+        src->pending_image.get());
+    if(ret != RMW_RET_OK)
+      src->pending_image.reset();
+  }
+  else
+  {
+    src->pending_audio = std::make_shared<audio_msgs::msg::Audio>();
+    ret = rmw_deserialize(bag_msg->serialized_data.get(),
+        rosidl_typesupport_cpp::get_message_type_support_handle<audio_msgs::msg::Audio>(),
+        src->pending_audio.get());
+    if(ret != RMW_RET_OK)
+      src->pending_audio.reset();
+  }
+
+  if(ret != RMW_RET_OK)
+  {
+    GST_WARNING_OBJECT (src, "failed to deserialize message, skipping");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/* fill the pending slot with the next recorded message, false at the end of the bag */
+static gboolean rosbagsrc_read_next (Rosbagsrc * src)
+{
+  while(src->reader->has_next())
+  {
+    auto bag_msg = src->reader->read_next();
+    if(bag_msg->topic_name != src->topic)
+      continue;
+    if(rosbagsrc_set_pending(src, bag_msg))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+
+/*
+ * the time between the first and last messages on the topic
+ * the bag metadata covers every topic, so this reads ours through on a reader of its own,
+ * playback keeps its place
+ */
+static GstClockTime rosbagsrc_topic_duration (Rosbagsrc * src)
+{
+  rcl_time_point_value_t first = 0, last = 0;
+  gboolean found = FALSE;
+
+  try
+  {
+    auto reader = rosbagsrc_reader_new(src);
+    while(reader->has_next())
+    {
+      auto bag_msg = reader->read_next();
+      if(bag_msg->topic_name != src->topic)
+        continue;
+      if(!found)
+        first = bag_msg->time_stamp;
+      last = bag_msg->time_stamp;
+      found = TRUE;
+    }
+  }
+  catch (const std::exception & e)
+  {
+    GST_WARNING_OBJECT (src, "could not read '%s' for its duration: %s", src->bag_uri, e.what());
+    return GST_CLOCK_TIME_NONE;
+  }
+  return found ? (GstClockTime) (last - first) : GST_CLOCK_TIME_NONE;
+}
+
+
+/* open the bag and work out the caps from the first message on the topic */
+static gboolean rosbagsrc_start (GstBaseSrc * base_src)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (base_src);
+
+  GST_DEBUG_OBJECT (src, "start");
+
+  if(!rosbagsrc_reader_open(src))
+    return FALSE;
+
+  g_free(src->topic_type);
+  src->topic_type = g_strdup("");
+  for(const auto & topic : src->reader->get_all_topics_and_types())
+  {
+    if(topic.name == src->topic)
+    {
+      g_free(src->topic_type);
+      src->topic_type = g_strdup(topic.type.c_str());
+    }
+  }
+
+  if((0 != g_strcmp0(src->topic_type, ROSBAGSRC_IMAGE_TYPE)) && (0 != g_strcmp0(src->topic_type, ROSBAGSRC_AUDIO_TYPE)))
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, NOT_FOUND,
+        ("topic '%s' is not a recorded image or audio topic", src->topic),
+        ("found type '%s'", src->topic_type));
+    src->reader.reset();
+    return FALSE;
+  }
+
+  // the first message fixes the caps and the time origin
+  while(src->reader->has_next())
+  {
+    auto bag_msg = src->reader->read_next();
+    if((bag_msg->topic_name == src->topic) && rosbagsrc_set_pending(src, bag_msg))
+    {
+      src->bag_origin = bag_msg->time_stamp;
+      break;
+    }
+  }
+
+  if(src->pending_image)
+  {
+    src->stamp_origin = rclcpp::Time(src->pending_image->header.stamp).nanoseconds();
+    src->caps = gst_bridge::image_msg_to_caps(*(src->pending_image));
+  }
+  else if(src->pending_audio)
+  {
+    GstAudioInfo audio_info;
+    src->stamp_origin = rclcpp::Time(src->pending_audio->header.stamp).nanoseconds();
+    if(gst_bridge::audio_msg_to_gst_audio_info(*(src->pending_audio), &audio_info))
+      src->caps = gst_audio_info_to_caps(&audio_info);
+    else
+      src->caps = gst_caps_new_empty();
+  }
+  else
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, READ, ("no messages on topic '%s'", src->topic), (NULL));
+    src->reader.reset();
+    return FALSE;
+  }
+
+  gchar* caps_str = gst_caps_to_string(src->caps);
+  GST_DEBUG_OBJECT (src, "playing '%s' with caps %s", src->topic, caps_str);
+  g_free(caps_str);
+
+  src->trickmode_count = 0;
+  return TRUE;
+}
+
+static gboolean rosbagsrc_stop (GstBaseSrc * base_src)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (base_src);
+
+  GST_DEBUG_OBJECT (src, "stop");
+
+  src->reader.reset();
+  src->pending_image.reset();
+  src->pending_audio.reset();
+  gst_caps_replace(&(src->caps), NULL);
+  src->duration = GST_CLOCK_TIME_NONE;
+  src->duration_scanned = FALSE;
+
+  return TRUE;
+}
+
+
+static GstCaps* rosbagsrc_getcaps (GstBaseSrc * base_src, GstCaps * filter)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (base_src);
+  GstCaps * caps;
+
+  GST_DEBUG_OBJECT (src, "getcaps");
+
+  if(src->caps)
+    caps = gst_caps_ref(src->caps);
+  else
+    caps = gst_pad_get_pad_template_caps (GST_BASE_SRC_PAD (base_src));
+
+  if(filter)
+  {
+    GstCaps * intersection = gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (caps);
+    caps = intersection;
+  }
+  return caps;
+}
+
+
+static gboolean rosbagsrc_is_seekable (GstBaseSrc * base_src)
+{
+  return TRUE;
+}
+
+/*
+ * Re-open the bag and skip to the first message recorded at or after the segment start.
+ * Seeking follows the bag receive time, which tracks the header stamps closely;
+ * buffers stamped before the segment start are clipped downstream.
+ */
+static gboolean rosbagsrc_do_seek (GstBaseSrc * base_src, GstSegment * segment)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (base_src);
+  GstClockTime target = segment->start;
+
+  GST_DEBUG_OBJECT (src, "seek to %" GST_TIME_FORMAT " at rate %f", GST_TIME_ARGS(target), segment->rate);
+
+  if(segment->rate < 0.0)
+  {
+    GST_WARNING_OBJECT (src, "reverse playback is not supported");
+    return FALSE;
+  }
+
+  // nothing has been pushed yet, the reader is already in place
+  if((target == 0) && (src->pending_image || src->pending_audio) && (segment->position == 0))
+    return TRUE;
+
+  src->pending_image.reset();
+  src->pending_audio.reset();
+  src->trickmode_count = 0;
+
+  if(!rosbagsrc_reader_open(src))
+    return FALSE;
+
+  while(src->reader->has_next())
+  {
+    auto bag_msg = src->reader->read_next();
+    if(bag_msg->topic_name != src->topic)
+      continue;
+    if((bag_msg->time_stamp - src->bag_origin) < (rcl_time_point_value_t)target)
+      continue;
+    if(rosbagsrc_set_pending(src, bag_msg))
+      break;
+  }
+
+  segment->position = target;
+  segment->time = target;
+  return TRUE;
+}
+
+
+static gboolean rosbagsrc_query (GstBaseSrc * base_src, GstQuery * query)
+{
+  gboolean ret;
+
+  Rosbagsrc *src = GST_ROSBAGSRC (base_src);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_SCHEDULING:
+    {
+      /* the bag is indexed by time, not bytes, so basesrc can't run in pull mode;
+       * report that we're seekable and let downstream drive us with seek events */
+      gst_query_set_scheduling (query,
+          (GstSchedulingFlags) (GST_SCHEDULING_FLAG_SEQUENTIAL | GST_SCHEDULING_FLAG_SEEKABLE), 1, -1, 0);
+      gst_query_add_scheduling_mode (query, GST_PAD_MODE_PUSH);
+
+      ret = TRUE;
+      break;
+    }
+    case GST_QUERY_DURATION:
+    {
+      GstFormat format;
+      GstClockTime duration;
+      gboolean scan;
+
+      gst_query_parse_duration (query, &format, NULL);
+
+      // scanning the topic is a full pass over it, only pay for it when someone asks
+      GST_OBJECT_LOCK (src);
+      scan = (format == GST_FORMAT_TIME) && src->caps && !src->duration_scanned;
+      GST_OBJECT_UNLOCK (src);
+      if(scan)
+      {
+        duration = rosbagsrc_topic_duration(src);
+        GST_OBJECT_LOCK (src);
+        src->duration = duration;
+        src->duration_scanned = TRUE;
+        GST_OBJECT_UNLOCK (src);
+      }
+
+      GST_OBJECT_LOCK (src);
+      duration = src->duration;
+      GST_OBJECT_UNLOCK (src);
+      if((format == GST_FORMAT_TIME) && GST_CLOCK_TIME_IS_VALID(duration))
+      {
+        gst_query_set_duration (query, GST_FORMAT_TIME, duration);
+        ret = TRUE;
+      }
+      else
+      {
+        ret = GST_BASE_SRC_CLASS (rosbagsrc_parent_class)->query (base_src, query);
+      }
+      break;
+    }
+    default:
+      ret = GST_BASE_SRC_CLASS (rosbagsrc_parent_class)->query (base_src, query);
+      break;
+  }
+  return ret;
+}
+
+
+/* the buffer holds a reference to the message it wraps */
+static void rosbagsrc_release_image (gpointer data)
+{
+  delete static_cast<sensor_msgs::msg::Image::SharedPtr*>(data);
+}
+
+static void rosbagsrc_release_audio (gpointer data)
+{
+  delete static_cast<audio_msgs::msg::Audio::SharedPtr*>(data);
+}
+
+
+/*
+ * Wrap the next recorded message in a buffer without copying the payload
+ * In trick mode at rates above 1, only every n-th message is pushed
+ */
+static GstFlowReturn rosbagsrc_create (GstBaseSrc * base_src, guint64 offset, guint size, GstBuffer **buf)
+{
+  Rosbagsrc *src = GST_ROSBAGSRC (base_src);
+  GstSegment *segment = &(base_src->segment);
+  GstBuffer *res_buf;
+  rcl_time_point_value_t stamp;
+  guint64 skip = 1;
+  GstVideoInfo video_info;
+  const gst_bridge::image_row_conversion * row_conversion;
+  gsize plane_offset[GST_VIDEO_MAX_PLANES];
+  gint plane_stride[GST_VIDEO_MAX_PLANES];
+
+  GST_DEBUG_OBJECT (src, "create");
+
+  if((segment->flags & GST_SEGMENT_FLAG_TRICKMODE) && (segment->rate > 1.0))
+    skip = (guint64) segment->rate;
+
+  for(;;)
+  {
+    if(!src->pending_image && !src->pending_audio && !rosbagsrc_read_next(src))
+      return GST_FLOW_EOS;
+
+    if(((src->trickmode_count++) % skip) == 0)
+      break;
+
+    src->pending_image.reset();
+    src->pending_audio.reset();
+  }
+
+  if(src->pending_image)
+  {
+    auto msg = src->pending_image;
+    src->pending_image.reset();
+
+    stamp = rclcpp::Time(msg->header.stamp).nanoseconds();
+    // encodings without a video format were refused at negotiation, pass them through untouched
+    if(!gst_bridge::image_msg_to_video_info(msg->encoding, msg->width, msg->height, msg->is_bigendian, &video_info))
+    {
+      res_buf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+          (gpointer) msg->data.data(), msg->data.size(), 0, msg->data.size(),
+          new sensor_msgs::msg::Image::SharedPtr(msg), rosbagsrc_release_image);
+    }
+    else if((row_conversion = gst_bridge::getImageRowConversion(msg->encoding, GST_VIDEO_INFO_FORMAT(&video_info), msg->is_bigendian)))
+    {
+      // eg metres are converted to millimetres, there is nothing to share
+      if((msg->step < msg->width * row_conversion->msg_pixel_stride) || (msg->data.size() < (size_t) msg->step * msg->height))
+      {
+        GST_ELEMENT_ERROR (src, STREAM, DECODE, (NULL), ("image message is too short for its step"));
+        return GST_FLOW_ERROR;
+      }
+      res_buf = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE(&video_info), NULL);
+      gst_bridge::convert_msg_data_to_video_frame(row_conversion, &video_info, msg->data.data(), msg->step, res_buf);
+    }
+    else if(gst_bridge::image_msg_layout_matches(&video_info, msg->step))
+    {
+      res_buf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+          (gpointer) msg->data.data(), msg->data.size(), 0, msg->data.size(),
+          new sensor_msgs::msg::Image::SharedPtr(msg), rosbagsrc_release_image);
+    }
+    else
+    {
+      // rows or planes are padded differently, repack into the default layout
+      if(msg->data.size() < gst_bridge::image_msg_plane_layout(&video_info, msg->step, plane_offset, plane_stride))
+      {
+        GST_ELEMENT_ERROR (src, STREAM, DECODE, (NULL), ("image message is too short for its encoding and step"));
+        return GST_FLOW_ERROR;
+      }
+      res_buf = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE(&video_info), NULL);
+      gst_bridge::copy_msg_data_to_video_frame(&video_info, msg->data.data(), msg->step, res_buf);
+    }
+  }
+  else
+  {
+    auto msg = src->pending_audio;
+    src->pending_audio.reset();
+
+    stamp = rclcpp::Time(msg->header.stamp).nanoseconds();
+    res_buf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        (gpointer) msg->data.data(), msg->data.size(), 0, msg->data.size(),
+        new audio_msgs::msg::Audio::SharedPtr(msg), rosbagsrc_release_audio);
+
+    GST_BUFFER_OFFSET (res_buf) = msg->seq_num;
+    GST_BUFFER_OFFSET_END (res_buf) = msg->seq_num + msg->frames;
+    if(msg->sample_rate > 0)
+      GST_BUFFER_DURATION (res_buf) = gst_util_uint64_scale_int (msg->frames, GST_SECOND, msg->sample_rate);
+  }
+
+  // same time base as a non-live rosimagesrc, the first message is at zero
+  GST_BUFFER_PTS (res_buf) = (stamp > src->stamp_origin) ? (stamp - src->stamp_origin) : 0;
+
+  if(GST_CLOCK_TIME_IS_VALID(segment->stop) && (GST_BUFFER_PTS (res_buf) > segment->stop))
+  {
+    gst_buffer_unref (res_buf);
+    return GST_FLOW_EOS;
+  }
+
+  if(*buf == NULL)
+  {
+    *buf = res_buf;
+  }
+  else
+  {
+    /* downstream provided a buffer to fill */
+    GstMapInfo info;
+    gst_buffer_map (res_buf, &info, GST_MAP_READ);
+    gst_buffer_fill (*buf, 0, info.data, MIN(info.size, gst_buffer_get_size(*buf)));
+    gst_buffer_unmap (res_buf, &info);
+    gst_buffer_copy_into (*buf, res_buf, GST_BUFFER_COPY_METADATA, 0, -1);
+    gst_buffer_unref (res_buf);
+  }
+
+  return GST_FLOW_OK;
+}
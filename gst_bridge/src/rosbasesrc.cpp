@@ -47,6 +47,8 @@ static void rosbasesrc_get_property (GObject * object, guint property_id, GValue
 static GstStateChangeReturn rosbasesrc_change_state (GstElement * element, GstStateChange transition);
 static void rosbasesrc_init (RosBaseSrc * src);
 
+static gboolean rosbasesrc_query (GstBaseSrc * base_src, GstQuery * query);
+
 
 
 static gboolean rosbasesrc_open (RosBaseSrc * src);
@@ -65,6 +67,7 @@ enum
   PROP_ROS_NAME,
   PROP_ROS_NAMESPACE,
   PROP_ROS_START_TIME,
+  PROP_IS_LIVE,
 };
 
 /* class initialization */
@@ -77,7 +80,7 @@ static void rosbasesrc_class_init (RosBaseSrcClass * klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
-  //GstBaseSrcClass *basesrc_class = (GstBaseSrcClass *) klass;
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
 
   object_class->set_property = rosbasesrc_set_property;
   object_class->get_property = rosbasesrc_get_property;
@@ -106,7 +109,14 @@ static void rosbasesrc_class_init (RosBaseSrcClass * klass)
       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
   );
 
+  g_object_class_install_property (object_class, PROP_IS_LIVE,
+      g_param_spec_boolean ("is-live", "is-live", "pace output by message arrival, disable to process recorded topics as fast as possible without drops",
+      TRUE,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
   element_class->change_state = GST_DEBUG_FUNCPTR (rosbasesrc_change_state); //use state change events to open and close subscribers
+  basesrc_class->query = GST_DEBUG_FUNCPTR (rosbasesrc_query);  //set the scheduling modes
 
   //basesrc_class->create() // there's no reason for the base class to shim in here
 
@@ -118,6 +128,8 @@ static void rosbasesrc_init (RosBaseSrc * src)
   src->node_name = g_strdup("ros_base_src_node");
   src->node_namespace = g_strdup("");
   src->stream_start_prop = GST_CLOCK_TIME_NONE;
+  src->is_live = TRUE;
+  src->msg_stamp_origin = GST_CLOCK_TIME_NONE;
 }
 
 void rosbasesrc_set_property (GObject * object, guint property_id,
@@ -163,6 +175,20 @@ void rosbasesrc_set_property (GObject * object, guint property_id,
       }
       break;
 
+    case PROP_IS_LIVE:
+      if(src->node)
+      {
+        RCLCPP_ERROR(src->logger, "can't change liveness once opened");
+      }
+      else
+      {
+        // non-live sources take their timestamps purely from the message stamps
+        src->is_live = g_value_get_boolean(value);
+        gst_base_src_set_live (GST_BASE_SRC (src), src->is_live);
+        gst_base_src_set_do_timestamp (GST_BASE_SRC (src), src->is_live);
+      }
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -191,6 +217,10 @@ void rosbasesrc_get_property (GObject * object, guint property_id,
       //      but may cause confusion because it does not show the actual prop
       break;
 
+    case PROP_IS_LIVE:
+      g_value_set_boolean(value, src->is_live);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -232,6 +262,10 @@ static GstStateChangeReturn rosbasesrc_change_state (GstElement * element, GstSt
       break;
     }
     case GST_STATE_CHANGE_READY_TO_PAUSED:
+    {
+      src->msg_stamp_origin = GST_CLOCK_TIME_NONE;
+      break;
+    }
     //XXX stop the subscription
     case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
     case GST_STATE_CHANGE_PAUSED_TO_READY:
@@ -324,3 +358,76 @@ static void spin_wrapper(RosBaseSrc * src)
 }
 
 
+static gboolean rosbasesrc_query (GstBaseSrc * base_src, GstQuery * query)
+{
+  gboolean ret;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_SCHEDULING:
+    {
+      /* a pushsrc can by default never operate in pull mode override
+       * if you want something different. */
+      gst_query_set_scheduling (query, GST_SCHEDULING_FLAG_SEQUENTIAL, 1, -1,
+          0);
+      gst_query_add_scheduling_mode (query, GST_PAD_MODE_PUSH);
+
+      ret = TRUE;
+      break;
+    }
+    default:
+      ret = GST_BASE_SRC_CLASS (rosbasesrc_parent_class)->query (base_src, query);
+      break;
+  }
+  return ret;
+}
+
+
+rclcpp::QoS rosbasesrc_sub_qos (RosBaseSrc * src)
+{
+  if(!src->is_live)
+    return rclcpp::QoS(rclcpp::KeepAll()).reliable();
+  return rclcpp::SensorDataQoS();  //XXX add a parameter for overrides
+}
+
+
+GstFlowReturn rosbasesrc_fill_buffer (RosBaseSrc * src, const std::vector<uint8_t> & data, GstBuffer * buf)
+{
+  gsize maxsize;
+
+  gst_buffer_get_sizes (buf, NULL, &maxsize);
+  if(maxsize < data.size())
+  {
+    GST_ELEMENT_ERROR (src, STREAM, FAILED,
+        ("downstream buffer of %" G_GSIZE_FORMAT " bytes can't hold a %" G_GSIZE_FORMAT " byte message", maxsize, data.size()),
+        (NULL));
+    return GST_FLOW_ERROR;
+  }
+  gst_buffer_set_size (buf, data.size());
+  gst_buffer_fill (buf, 0, data.data(), data.size());
+  return GST_FLOW_OK;
+}
+
+
+
+GstClockTime rosbasesrc_msg_stamp_to_pts (RosBaseSrc * src, rcl_time_point_value_t stamp)
+{
+  GstClockTimeDiff base_time;
+
+  if(src->is_live)
+  {
+    base_time = gst_element_get_base_time(GST_ELEMENT(src));
+    return stamp - src->ros_clock_offset - base_time;
+  }
+
+  if(!GST_CLOCK_TIME_IS_VALID(src->msg_stamp_origin))
+  {
+    if(GST_CLOCK_TIME_IS_VALID(src->stream_start_prop))
+      src->msg_stamp_origin = src->stream_start_prop;
+    else
+      src->msg_stamp_origin = stamp;
+  }
+
+  if(stamp < src->msg_stamp_origin)
+    return 0;
+  return stamp - src->msg_stamp_origin;
+}
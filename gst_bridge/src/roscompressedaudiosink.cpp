@@ -0,0 +1,277 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstroscompressedaudiosink
+ *
+ * The roscompressedaudiosink element publishes Opus packets into ROS2 as audio_msgs/CompressedAudio.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v audiotestsrc ! opusenc ! roscompressedaudiosink ros-topic="audio/opus"
+ * ]|
+ * Streams Opus encoded test tones as ROS messages on topic.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst_bridge/roscompressedaudiosink.h>
+
+
+GST_DEBUG_CATEGORY_STATIC (roscompressedaudiosink_debug_category);
+#define GST_CAT_DEFAULT roscompressedaudiosink_debug_category
+
+/* prototypes */
+
+
+static void roscompressedaudiosink_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void roscompressedaudiosink_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+
+static void roscompressedaudiosink_init (Roscompressedaudiosink * sink);
+
+static gboolean roscompressedaudiosink_open (RosBaseSink * sink);
+static gboolean roscompressedaudiosink_close (RosBaseSink * sink);
+static gboolean roscompressedaudiosink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps);
+static GstFlowReturn roscompressedaudiosink_render (RosBaseSink * base_sink, GstBuffer * buffer, rclcpp::Time msg_time);
+
+enum
+{
+  PROP_0,
+  PROP_ROS_TOPIC,
+  PROP_ROS_FRAME_ID,
+};
+
+
+/* pad templates */
+
+static GstStaticPadTemplate roscompressedaudiosink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (ROS_COMPRESSED_AUDIO_MSG_CAPS)
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Roscompressedaudiosink, roscompressedaudiosink, GST_TYPE_ROS_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (roscompressedaudiosink_debug_category, "roscompressedaudiosink", 0,
+        "debug category for roscompressedaudiosink element"))
+
+static void roscompressedaudiosink_class_init (RoscompressedaudiosinkClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+  RosBaseSinkClass *ros_base_sink_class = GST_ROS_BASE_SINK_CLASS (klass);
+
+  object_class->set_property = roscompressedaudiosink_set_property;
+  object_class->get_property = roscompressedaudiosink_get_property;
+
+  /* Setting up pads and setting metadata should be moved to
+     base_class_init if you intend to subclass this class. */
+  gst_element_class_add_static_pad_template (element_class,
+      &roscompressedaudiosink_sink_template);
+
+
+  gst_element_class_set_static_metadata (element_class,
+      "roscompressedaudiosink",
+      "Sink",
+      "a gstreamer sink that publishes compressed audio into ROS",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "pub-topic", "ROS topic to be published on",
+      "gst_compressed_audio_pub",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FRAME_ID,
+      g_param_spec_string ("ros-frame-id", "frame-id", "frame_id of the audio message",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  //access gstreamer base sink events here
+  basesink_class->set_caps = GST_DEBUG_FUNCPTR (roscompressedaudiosink_setcaps);  //gstreamer informs us what caps we're using.
+
+  //supply the calls ros base sink needs to negotiate upstream formats and manage the publisher
+  ros_base_sink_class->open = GST_DEBUG_FUNCPTR (roscompressedaudiosink_open);  //let the base sink know how we register publishers
+  ros_base_sink_class->close = GST_DEBUG_FUNCPTR (roscompressedaudiosink_close);  //let the base sink know how we destroy publishers
+  ros_base_sink_class->render = GST_DEBUG_FUNCPTR (roscompressedaudiosink_render); // gives us a buffer to package
+}
+
+static void roscompressedaudiosink_init (Roscompressedaudiosink * sink)
+{
+  RosBaseSink *ros_base_sink GST_ROS_BASE_SINK(sink);
+  ros_base_sink->node_name = g_strdup("gst_compressed_audio_sink_node");
+  sink->pub_topic = g_strdup("gst_compressed_audio_pub");
+  sink->frame_id = g_strdup("audio_frame");
+  sink->caps = g_strdup("");
+  sink->rate = 48000;
+  sink->channels = 0;
+  sink->msg_seq_num = 0;
+  sink->sample_offset = 0;
+}
+
+void roscompressedaudiosink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK(object);
+  Roscompressedaudiosink *sink = GST_ROSCOMPRESSEDAUDIOSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "set_property");
+
+  switch (property_id) {
+    case PROP_ROS_TOPIC:
+      if(ros_base_sink->node)
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "can't change topic name once opened");
+      }
+      else
+      {
+        g_free(sink->pub_topic);
+        sink->pub_topic = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_free(sink->frame_id);
+      sink->frame_id = g_value_dup_string(value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void roscompressedaudiosink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Roscompressedaudiosink *sink = GST_ROSCOMPRESSEDAUDIOSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "get_property");
+  switch (property_id) {
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, sink->pub_topic);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_value_set_string(value, sink->frame_id);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+/* open the device with given specs */
+static gboolean roscompressedaudiosink_open (RosBaseSink * ros_base_sink)
+{
+  Roscompressedaudiosink *sink = GST_ROSCOMPRESSEDAUDIOSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "open");
+  rclcpp::QoS qos = rclcpp::SensorDataQoS().reliable();  //XXX add a parameter for overrides
+  sink->pub = ros_base_sink->node->create_publisher<audio_msgs::msg::CompressedAudio>(sink->pub_topic, qos);
+  sink->msg_seq_num = 0;
+  sink->sample_offset = 0;
+  return TRUE;
+}
+
+/* close the device */
+static gboolean roscompressedaudiosink_close (RosBaseSink * ros_base_sink)
+{
+  Roscompressedaudiosink *sink = GST_ROSCOMPRESSEDAUDIOSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "close");
+  sink->pub.reset();
+  return TRUE;
+}
+
+/* the caps carry the codec headers as streamheader, they go out in every message */
+static gboolean roscompressedaudiosink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (gst_base_sink);
+  Roscompressedaudiosink *sink = GST_ROSCOMPRESSEDAUDIOSINK (ros_base_sink);
+  GstStructure * structure = gst_caps_get_structure(caps, 0);
+
+  GST_DEBUG_OBJECT (sink, "setcaps");
+
+  g_free(sink->caps);
+  sink->caps = gst_caps_to_string(caps);
+
+  // Opus always decodes at 48kHz unless the caps say otherwise
+  if(!gst_structure_get_int(structure, "rate", &(sink->rate)))
+    sink->rate = 48000;
+  if(!gst_structure_get_int(structure, "channels", &(sink->channels)))
+    sink->channels = 0;
+
+  if(ros_base_sink->node)
+    RCLCPP_INFO(ros_base_sink->logger, "preparing audio with caps '%s'", sink->caps);
+
+  return true;
+}
+
+/*
+ * each buffer is one packet, the sample offset counts decoded samples so subscribers can place packets exactly,
+ * it is realigned to the buffer timestamp after a discontinuity
+ */
+static GstFlowReturn roscompressedaudiosink_render (RosBaseSink * ros_base_sink, GstBuffer * buf, rclcpp::Time msg_time)
+{
+  audio_msgs::msg::CompressedAudio msg;
+  GstMapInfo info;
+
+  Roscompressedaudiosink *sink = GST_ROSCOMPRESSEDAUDIOSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "render");
+
+  // the headers are already in the caps
+  if(GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_HEADER))
+    return GST_FLOW_OK;
+
+  if(GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DISCONT) && GST_BUFFER_PTS_IS_VALID(buf))
+    sink->sample_offset = gst_util_uint64_scale_round(GST_BUFFER_PTS(buf), sink->rate, GST_SECOND);
+
+  msg.header.stamp = msg_time;
+  msg.header.frame_id = sink->frame_id;
+  msg.seq_num = sink->msg_seq_num++;
+  msg.sample_offset = sink->sample_offset;
+  msg.frames = GST_BUFFER_DURATION_IS_VALID(buf) ?
+    gst_util_uint64_scale_round(GST_BUFFER_DURATION(buf), sink->rate, GST_SECOND) : 0;
+  msg.channels = sink->channels;
+  msg.sample_rate = sink->rate;
+  msg.caps = sink->caps;
+  sink->sample_offset += msg.frames;
+
+  if(!gst_buffer_map (buf, &info, GST_MAP_READ))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "could not map the buffer");
+    return GST_FLOW_ERROR;
+  }
+  msg.data.assign(info.data, info.data + info.size);
+  gst_buffer_unmap (buf, &info);
+
+  //publish
+  sink->pub->publish(msg);
+
+  return GST_FLOW_OK;
+}
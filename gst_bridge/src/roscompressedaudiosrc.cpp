@@ -0,0 +1,340 @@
+/* GStreamer
+ * Copyright (C) 2020 FIXME <fixme@example.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-roscompressedaudiosrc
+ *
+ * The roscompressedaudiosrc element, pipe Opus packets from ROS2 CompressedAudio topics.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v roscompressedaudiosrc ros-topic="audio/opus" ! opusdec ! queue ! autoaudiosink
+ * ]|
+ * decodes and plays a compressed audio topic.
+ * </refsect2>
+ */
+
+
+#include <gst_bridge/roscompressedaudiosrc.h>
+
+GST_DEBUG_CATEGORY_STATIC (roscompressedaudiosrc_debug_category);
+#define GST_CAT_DEFAULT roscompressedaudiosrc_debug_category
+
+/* prototypes */
+
+
+static void roscompressedaudiosrc_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void roscompressedaudiosrc_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+
+static void roscompressedaudiosrc_init (Roscompressedaudiosrc * src);
+
+static gboolean roscompressedaudiosrc_open (RosBaseSrc * ros_base_src);
+static gboolean roscompressedaudiosrc_close (RosBaseSrc * ros_base_src);
+static GstFlowReturn roscompressedaudiosrc_create (GstBaseSrc * base_src, guint64 offset, guint size, GstBuffer **buf);
+
+static GstCaps* roscompressedaudiosrc_getcaps (GstBaseSrc * base_src, GstCaps * filter);  //set our caps preferences
+
+static void roscompressedaudiosrc_sub_cb(Roscompressedaudiosrc * src, audio_msgs::msg::CompressedAudio::ConstSharedPtr msg);
+
+
+enum
+{
+  PROP_0,
+  PROP_ROS_TOPIC,
+  PROP_ROS_FRAME_ID,
+  PROP_INIT_CAPS,
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate roscompressedaudiosrc_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (ROS_COMPRESSED_AUDIO_MSG_CAPS)
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Roscompressedaudiosrc, roscompressedaudiosrc, GST_TYPE_ROS_BASE_SRC,
+    GST_DEBUG_CATEGORY_INIT (roscompressedaudiosrc_debug_category, "roscompressedaudiosrc", 0,
+        "debug category for roscompressedaudiosrc element"))
+
+static void roscompressedaudiosrc_class_init (RoscompressedaudiosrcClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  RosBaseSrcClass *ros_base_src_class = GST_ROS_BASE_SRC_CLASS (klass);
+
+  object_class->set_property = roscompressedaudiosrc_set_property;
+  object_class->get_property = roscompressedaudiosrc_get_property;
+
+  /* Setting up pads and setting metadata should be moved to
+     base_class_init if you intend to subclass this class. */
+  gst_element_class_add_static_pad_template (element_class,
+      &roscompressedaudiosrc_src_template);
+
+
+  gst_element_class_set_static_metadata (element_class,
+      "roscompressedaudiosrc",
+      "Source/Audio",
+      "a gstreamer source that transports ROS CompressedAudio messages over gstreamer",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "sub-topic", "ROS topic to subscribe to",
+      "gst_compressed_audio_sub",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FRAME_ID,
+      g_param_spec_string ("ros-frame-id", "frame-id", "frame_id of the audio message",
+      "",
+      (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_INIT_CAPS,
+      g_param_spec_string ("init-caps", "initial-caps", "optional caps filter to skip wait for first message",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+
+  ros_base_src_class->open = GST_DEBUG_FUNCPTR (roscompressedaudiosrc_open);  //let the base sink know how we register publishers
+  ros_base_src_class->close = GST_DEBUG_FUNCPTR (roscompressedaudiosrc_close);  //let the base sink know how we destroy publishers
+  basesrc_class->create = GST_DEBUG_FUNCPTR(roscompressedaudiosrc_create);
+
+  basesrc_class->get_caps = GST_DEBUG_FUNCPTR (roscompressedaudiosrc_getcaps);  //return caps within the filter
+}
+
+static void roscompressedaudiosrc_init (Roscompressedaudiosrc * src)
+{
+  RosBaseSrc *ros_base_src GST_ROS_BASE_SRC(src);
+  ros_base_src->node_name = g_strdup("gst_compressed_audio_src_node");
+  src->sub_topic = g_strdup("gst_compressed_audio_sub");
+  src->frame_id = g_strdup("");
+  src->caps = g_strdup("");
+  src->have_seq_num = FALSE;
+  src->last_seq_num = 0;
+  src->init_caps = g_strdup("");
+
+  src->msg_init = true;
+  new (&(src->msg_queue)) RosBaseSrcMsgQueue<audio_msgs::msg::CompressedAudio::ConstSharedPtr>(1);
+
+  /* configure basesrc to be a live source */
+  gst_base_src_set_live (GST_BASE_SRC (src), TRUE);
+  /* make basesrc output a segment in time */
+  gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
+  /* make basesrc set timestamps on outgoing buffers based on the running_time
+   * when they were captured */
+  gst_base_src_set_do_timestamp (GST_BASE_SRC (src), TRUE);
+}
+
+void roscompressedaudiosrc_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (object);
+  Roscompressedaudiosrc *src = GST_ROSCOMPRESSEDAUDIOSRC (object);
+
+  GST_DEBUG_OBJECT (src, "set_property");
+
+  switch (property_id)
+  {
+    case PROP_ROS_TOPIC:
+      if(ros_base_src->node)
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change topic name once opened");
+      }
+      else
+      {
+        g_free(src->sub_topic);
+        src->sub_topic = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_INIT_CAPS:
+      if(src->msg_init)
+      {
+        g_free(src->init_caps);
+        src->init_caps = g_value_dup_string(value);
+      }
+      else
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change initial caps after init");
+      }
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void roscompressedaudiosrc_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Roscompressedaudiosrc *src = GST_ROSCOMPRESSEDAUDIOSRC (object);
+
+  GST_DEBUG_OBJECT (src, "get_property");
+  switch (property_id)
+  {
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, src->sub_topic);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_value_set_string(value, src->frame_id);
+      break;
+
+    case PROP_INIT_CAPS:
+      g_value_set_string(value, src->init_caps);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+/* open the subscription with given specs */
+static gboolean roscompressedaudiosrc_open (RosBaseSrc * ros_base_src)
+{
+  Roscompressedaudiosrc *src = GST_ROSCOMPRESSEDAUDIOSRC (ros_base_src);
+
+  GST_DEBUG_OBJECT (src, "open");
+
+  auto cb = [src] (audio_msgs::msg::CompressedAudio::ConstSharedPtr msg){roscompressedaudiosrc_sub_cb(src, msg);};
+  rclcpp::QoS qos = rosbasesrc_sub_qos(ros_base_src);
+  rosbasesrc_queue_open(&(src->msg_queue));
+  src->have_seq_num = FALSE;
+  src->sub = ros_base_src->node->create_subscription<audio_msgs::msg::CompressedAudio>(src->sub_topic, qos, cb);
+
+  return TRUE;
+}
+
+/* close the device */
+static gboolean roscompressedaudiosrc_close (RosBaseSrc * ros_base_src)
+{
+  Roscompressedaudiosrc *src = GST_ROSCOMPRESSEDAUDIOSRC (ros_base_src);
+
+  GST_DEBUG_OBJECT (src, "close");
+
+  src->sub.reset();
+  rosbasesrc_queue_close(&(src->msg_queue));
+
+  return TRUE;
+}
+
+/* the caps, with the codec headers, come from the first message, or from init-caps */
+static GstCaps* roscompressedaudiosrc_getcaps (GstBaseSrc * base_src, GstCaps * filter)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (base_src);
+  Roscompressedaudiosrc *src = GST_ROSCOMPRESSEDAUDIOSRC (base_src);
+  GstCaps * caps;
+
+  GST_DEBUG_OBJECT (src, "getcaps");
+
+  if(0 != g_strcmp0(src->init_caps, ""))
+  {
+    caps = gst_caps_from_string(src->init_caps);
+  }
+  else if(!ros_base_src->node)
+  {
+    GST_DEBUG_OBJECT (src, "getcaps with node not ready, returning template");
+    return gst_pad_get_pad_template_caps (GST_BASE_SRC (src)->srcpad);
+  }
+  else
+  {
+    RCLCPP_INFO(ros_base_src->logger, "waiting for first message");
+    rosbasesrc_queue_peek(&(src->msg_queue));
+    caps = gst_caps_from_string(src->caps);
+    if(!caps)
+    {
+      RCLCPP_ERROR(ros_base_src->logger, "could not parse caps '%s'", src->caps);
+      caps = gst_caps_new_empty();
+    }
+  }
+
+  if(filter)
+  {
+    GstCaps * intersection = gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (caps);
+    caps = intersection;
+  }
+  return caps;
+}
+
+
+/*
+ * Wait for a message to be published, then hand its memory downstream
+ * the packet is passed on as it is, the sample offset and frame count place it on the timeline
+ */
+static GstFlowReturn roscompressedaudiosrc_create (GstBaseSrc * base_src, guint64 offset, guint size, GstBuffer **buf)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (base_src);
+  Roscompressedaudiosrc *src = GST_ROSCOMPRESSEDAUDIOSRC (base_src);
+  GstFlowReturn ret;
+  GstBuffer *res_buf;
+
+  GST_DEBUG_OBJECT (src, "create");
+
+  auto msg = rosbasesrc_queue_pop(&(src->msg_queue));
+  ret = rosbasesrc_msg_data_to_buffer(ros_base_src, msg, msg->data, buf);
+  if(ret != GST_FLOW_OK)
+    return ret;
+  res_buf = *buf;
+
+  GST_BUFFER_PTS (res_buf) = rosbasesrc_msg_stamp_to_pts(ros_base_src, rclcpp::Time(msg->header.stamp).nanoseconds());
+  if(msg->sample_rate > 0)
+    GST_BUFFER_DURATION (res_buf) = gst_util_uint64_scale_int (msg->frames, GST_SECOND, msg->sample_rate);
+  GST_BUFFER_OFFSET (res_buf) = msg->sample_offset;
+  GST_BUFFER_OFFSET_END (res_buf) = msg->sample_offset + msg->frames;
+
+  // a gap in the packet count means packets were lost, let the decoder conceal it
+  if(!src->have_seq_num || msg->seq_num != src->last_seq_num + 1)
+    GST_BUFFER_FLAG_SET (res_buf, GST_BUFFER_FLAG_DISCONT);
+  src->have_seq_num = TRUE;
+  src->last_seq_num = msg->seq_num;
+
+  return GST_FLOW_OK;
+}
+
+static void roscompressedaudiosrc_sub_cb(Roscompressedaudiosrc * src, audio_msgs::msg::CompressedAudio::ConstSharedPtr msg)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
+
+  //fetch the caps from the first msg, check on subsequent
+  if(src->msg_init)
+  {
+    g_free(src->caps);
+    src->caps = g_strdup(msg->caps.c_str());
+    g_free(src->frame_id);
+    src->frame_id = g_strdup(msg->header.frame_id.c_str());
+    src->msg_init = false;
+  }
+  else if(!(0 == g_strcmp0(src->caps, msg->caps.c_str())))
+  {
+    RCLCPP_ERROR(ros_base_src->logger, "audio caps changed during playback, caps %s != %s", src->caps, msg->caps.c_str());
+  }
+
+  rosbasesrc_queue_push(ros_base_src, &(src->msg_queue), msg);
+}
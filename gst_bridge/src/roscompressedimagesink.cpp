@@ -0,0 +1,271 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstroscompressedimagesink
+ *
+ * The roscompressedimagesink element publishes encoded frames into ROS2 as sensor_msgs/CompressedImage.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v v4l2src ! image/jpeg ! roscompressedimagesink ros-topic="image_raw/compressed"
+ * ]|
+ * Publishes a camera's MJPEG stream without decoding it.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst_bridge/roscompressedimagesink.h>
+
+
+GST_DEBUG_CATEGORY_STATIC (roscompressedimagesink_debug_category);
+#define GST_CAT_DEFAULT roscompressedimagesink_debug_category
+
+/* prototypes */
+
+
+static void roscompressedimagesink_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void roscompressedimagesink_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+
+static void roscompressedimagesink_init (Roscompressedimagesink * sink);
+
+static gboolean roscompressedimagesink_open (RosBaseSink * sink);
+static gboolean roscompressedimagesink_close (RosBaseSink * sink);
+static gboolean roscompressedimagesink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps);
+static GstFlowReturn roscompressedimagesink_render (RosBaseSink * base_sink, GstBuffer * buffer, rclcpp::Time msg_time);
+
+enum
+{
+  PROP_0,
+  PROP_ROS_TOPIC,
+  PROP_ROS_FRAME_ID,
+  PROP_ROS_FORMAT,
+};
+
+
+/* pad templates */
+
+static GstStaticPadTemplate roscompressedimagesink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (ROS_COMPRESSED_IMAGE_MSG_CAPS)
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Roscompressedimagesink, roscompressedimagesink, GST_TYPE_ROS_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (roscompressedimagesink_debug_category, "roscompressedimagesink", 0,
+        "debug category for roscompressedimagesink element"))
+
+static void roscompressedimagesink_class_init (RoscompressedimagesinkClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+  RosBaseSinkClass *ros_base_sink_class = GST_ROS_BASE_SINK_CLASS (klass);
+
+  object_class->set_property = roscompressedimagesink_set_property;
+  object_class->get_property = roscompressedimagesink_get_property;
+
+  /* Setting up pads and setting metadata should be moved to
+     base_class_init if you intend to subclass this class. */
+  gst_element_class_add_static_pad_template (element_class,
+      &roscompressedimagesink_sink_template);
+
+
+  gst_element_class_set_static_metadata (element_class,
+      "roscompressedimagesink",
+      "Sink",
+      "a gstreamer sink that publishes encoded images into ROS as CompressedImage",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "pub-topic", "ROS topic to be published on",
+      "gst_compressed_image_pub",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FRAME_ID,
+      g_param_spec_string ("ros-frame-id", "frame-id", "frame_id of the image message",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FORMAT,
+      g_param_spec_string ("ros-format", "format-string", "CompressedImage format string, \"jpeg\" or \"png\" from the caps if unset",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  //access gstreamer base sink events here
+  basesink_class->set_caps = GST_DEBUG_FUNCPTR (roscompressedimagesink_setcaps);  //gstreamer informs us what caps we're using.
+
+  //supply the calls ros base sink needs to negotiate upstream formats and manage the publisher
+  ros_base_sink_class->open = GST_DEBUG_FUNCPTR (roscompressedimagesink_open);  //let the base sink know how we register publishers
+  ros_base_sink_class->close = GST_DEBUG_FUNCPTR (roscompressedimagesink_close);  //let the base sink know how we destroy publishers
+  ros_base_sink_class->render = GST_DEBUG_FUNCPTR (roscompressedimagesink_render); // gives us a buffer to package
+}
+
+static void roscompressedimagesink_init (Roscompressedimagesink * sink)
+{
+  RosBaseSink *ros_base_sink GST_ROS_BASE_SINK(sink);
+  ros_base_sink->node_name = g_strdup("gst_compressed_image_sink_node");
+  sink->pub_topic = g_strdup("gst_compressed_image_pub");
+  sink->frame_id = g_strdup("image_frame");
+  sink->format = g_strdup("");
+}
+
+void roscompressedimagesink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK(object);
+  Roscompressedimagesink *sink = GST_ROSCOMPRESSEDIMAGESINK (object);
+
+  GST_DEBUG_OBJECT (sink, "set_property");
+
+  switch (property_id) {
+    case PROP_ROS_TOPIC:
+      if(ros_base_sink->node)
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "can't change topic name once opened");
+      }
+      else
+      {
+        g_free(sink->pub_topic);
+        sink->pub_topic = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_free(sink->frame_id);
+      sink->frame_id = g_value_dup_string(value);
+      break;
+
+    case PROP_ROS_FORMAT:
+      g_free(sink->format);
+      sink->format = g_value_dup_string(value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void roscompressedimagesink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Roscompressedimagesink *sink = GST_ROSCOMPRESSEDIMAGESINK (object);
+
+  GST_DEBUG_OBJECT (sink, "get_property");
+  switch (property_id) {
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, sink->pub_topic);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_value_set_string(value, sink->frame_id);
+      break;
+
+    case PROP_ROS_FORMAT:
+      g_value_set_string(value, sink->format);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+/* open the device with given specs */
+static gboolean roscompressedimagesink_open (RosBaseSink * ros_base_sink)
+{
+  Roscompressedimagesink *sink = GST_ROSCOMPRESSEDIMAGESINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "open");
+  rclcpp::QoS qos = rclcpp::SensorDataQoS().reliable();  //XXX add a parameter for overrides
+  sink->pub = ros_base_sink->node->create_publisher<sensor_msgs::msg::CompressedImage>(sink->pub_topic, qos);
+  return TRUE;
+}
+
+/* close the device */
+static gboolean roscompressedimagesink_close (RosBaseSink * ros_base_sink)
+{
+  Roscompressedimagesink *sink = GST_ROSCOMPRESSEDIMAGESINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "close");
+  sink->pub.reset();
+  return TRUE;
+}
+
+/* name the codec in the format string, unless ros-format overrides it */
+static gboolean roscompressedimagesink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (gst_base_sink);
+  Roscompressedimagesink *sink = GST_ROSCOMPRESSEDIMAGESINK (ros_base_sink);
+  std::string format;
+
+  GST_DEBUG_OBJECT (sink, "setcaps");
+
+  format = gst_bridge::getCompressedImageFormat(caps);
+  if(format.empty())
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "setcaps could not find a CompressedImage format for the caps");
+    return false;
+  }
+
+  if(0 == g_strcmp0(sink->format, ""))
+  {
+    g_free(sink->format);
+    sink->format = g_strdup(format.c_str());
+  }
+
+  return true;
+}
+
+/* each buffer is one encoded frame, it is published as it is */
+static GstFlowReturn roscompressedimagesink_render (RosBaseSink * ros_base_sink, GstBuffer * buf, rclcpp::Time msg_time)
+{
+  sensor_msgs::msg::CompressedImage msg;
+  GstMapInfo info;
+
+  Roscompressedimagesink *sink = GST_ROSCOMPRESSEDIMAGESINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "render");
+
+  msg.header.stamp = msg_time;
+  msg.header.frame_id = sink->frame_id;
+  msg.format = sink->format;
+
+  if(!gst_buffer_map (buf, &info, GST_MAP_READ))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "could not map the buffer");
+    return GST_FLOW_ERROR;
+  }
+  msg.data.assign(info.data, info.data + info.size);
+  gst_buffer_unmap (buf, &info);
+
+  //publish
+  sink->pub->publish(msg);
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,335 @@
+/* GStreamer
+ * Copyright (C) 2020 FIXME <fixme@example.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-roscompressedimagesrc
+ *
+ * The roscompressedimagesrc element, pipe encoded images from ROS2 CompressedImage topics.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v roscompressedimagesrc ros-topic="image_raw/compressed" ! jpegdec ! queue ! ximagesink
+ * ]|
+ * decodes and displays a compressed image topic.
+ * </refsect2>
+ */
+
+
+#include <gst_bridge/roscompressedimagesrc.h>
+
+GST_DEBUG_CATEGORY_STATIC (roscompressedimagesrc_debug_category);
+#define GST_CAT_DEFAULT roscompressedimagesrc_debug_category
+
+/* prototypes */
+
+
+static void roscompressedimagesrc_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void roscompressedimagesrc_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+
+static void roscompressedimagesrc_init (Roscompressedimagesrc * src);
+
+static gboolean roscompressedimagesrc_open (RosBaseSrc * ros_base_src);
+static gboolean roscompressedimagesrc_close (RosBaseSrc * ros_base_src);
+static GstFlowReturn roscompressedimagesrc_create (GstBaseSrc * base_src, guint64 offset, guint size, GstBuffer **buf);
+
+static GstCaps* roscompressedimagesrc_getcaps (GstBaseSrc * base_src, GstCaps * filter);  //set our caps preferences
+
+static void roscompressedimagesrc_sub_cb(Roscompressedimagesrc * src, sensor_msgs::msg::CompressedImage::ConstSharedPtr msg);
+
+
+enum
+{
+  PROP_0,
+  PROP_ROS_TOPIC,
+  PROP_ROS_FRAME_ID,
+  PROP_ROS_FORMAT,
+  PROP_INIT_CAPS,
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate roscompressedimagesrc_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (ROS_COMPRESSED_IMAGE_MSG_CAPS)
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Roscompressedimagesrc, roscompressedimagesrc, GST_TYPE_ROS_BASE_SRC,
+    GST_DEBUG_CATEGORY_INIT (roscompressedimagesrc_debug_category, "roscompressedimagesrc", 0,
+        "debug category for roscompressedimagesrc element"))
+
+static void roscompressedimagesrc_class_init (RoscompressedimagesrcClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
+  RosBaseSrcClass *ros_base_src_class = GST_ROS_BASE_SRC_CLASS (klass);
+
+  object_class->set_property = roscompressedimagesrc_set_property;
+  object_class->get_property = roscompressedimagesrc_get_property;
+
+  /* Setting up pads and setting metadata should be moved to
+     base_class_init if you intend to subclass this class. */
+  gst_element_class_add_static_pad_template (element_class,
+      &roscompressedimagesrc_src_template);
+
+
+  gst_element_class_set_static_metadata (element_class,
+      "roscompressedimagesrc",
+      "Source/Video",
+      "a gstreamer source that transports ROS CompressedImage messages over gstreamer",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "sub-topic", "ROS topic to subscribe to",
+      "gst_compressed_image_sub",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FRAME_ID,
+      g_param_spec_string ("ros-frame-id", "frame-id", "frame_id of the image message",
+      "",
+      (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FORMAT,
+      g_param_spec_string ("ros-format", "format-string", "CompressedImage format string",
+      "",
+      (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_INIT_CAPS,
+      g_param_spec_string ("init-caps", "initial-caps", "optional caps filter to skip wait for first message",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+
+  ros_base_src_class->open = GST_DEBUG_FUNCPTR (roscompressedimagesrc_open);  //let the base sink know how we register publishers
+  ros_base_src_class->close = GST_DEBUG_FUNCPTR (roscompressedimagesrc_close);  //let the base sink know how we destroy publishers
+  basesrc_class->create = GST_DEBUG_FUNCPTR(roscompressedimagesrc_create);
+
+  basesrc_class->get_caps = GST_DEBUG_FUNCPTR (roscompressedimagesrc_getcaps);  //return caps within the filter
+}
+
+static void roscompressedimagesrc_init (Roscompressedimagesrc * src)
+{
+  RosBaseSrc *ros_base_src GST_ROS_BASE_SRC(src);
+  ros_base_src->node_name = g_strdup("gst_compressed_image_src_node");
+  src->sub_topic = g_strdup("gst_compressed_image_sub");
+  src->frame_id = g_strdup("");
+  src->format = g_strdup("");
+  src->init_caps = g_strdup("");
+
+  src->msg_init = true;
+  new (&(src->msg_queue)) RosBaseSrcMsgQueue<sensor_msgs::msg::CompressedImage::ConstSharedPtr>(1);
+
+  /* configure basesrc to be a live source */
+  gst_base_src_set_live (GST_BASE_SRC (src), TRUE);
+  /* make basesrc output a segment in time */
+  gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
+  /* make basesrc set timestamps on outgoing buffers based on the running_time
+   * when they were captured */
+  gst_base_src_set_do_timestamp (GST_BASE_SRC (src), TRUE);
+}
+
+void roscompressedimagesrc_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (object);
+  Roscompressedimagesrc *src = GST_ROSCOMPRESSEDIMAGESRC (object);
+
+  GST_DEBUG_OBJECT (src, "set_property");
+
+  switch (property_id)
+  {
+    case PROP_ROS_TOPIC:
+      if(ros_base_src->node)
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change topic name once opened");
+      }
+      else
+      {
+        g_free(src->sub_topic);
+        src->sub_topic = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_INIT_CAPS:
+      if(src->msg_init)
+      {
+        g_free(src->init_caps);
+        src->init_caps = g_value_dup_string(value);
+      }
+      else
+      {
+        RCLCPP_ERROR(ros_base_src->logger, "can't change initial caps after init");
+      }
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void roscompressedimagesrc_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Roscompressedimagesrc *src = GST_ROSCOMPRESSEDIMAGESRC (object);
+
+  GST_DEBUG_OBJECT (src, "get_property");
+  switch (property_id)
+  {
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, src->sub_topic);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_value_set_string(value, src->frame_id);
+      break;
+
+    case PROP_ROS_FORMAT:
+      g_value_set_string(value, src->format);
+      break;
+
+    case PROP_INIT_CAPS:
+      g_value_set_string(value, src->init_caps);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+/* open the subscription with given specs */
+static gboolean roscompressedimagesrc_open (RosBaseSrc * ros_base_src)
+{
+  Roscompressedimagesrc *src = GST_ROSCOMPRESSEDIMAGESRC (ros_base_src);
+
+  GST_DEBUG_OBJECT (src, "open");
+
+  auto cb = [src] (sensor_msgs::msg::CompressedImage::ConstSharedPtr msg){roscompressedimagesrc_sub_cb(src, msg);};
+  rclcpp::QoS qos = rosbasesrc_sub_qos(ros_base_src);
+  rosbasesrc_queue_open(&(src->msg_queue));
+  src->sub = ros_base_src->node->create_subscription<sensor_msgs::msg::CompressedImage>(src->sub_topic, qos, cb);
+
+  return TRUE;
+}
+
+/* close the device */
+static gboolean roscompressedimagesrc_close (RosBaseSrc * ros_base_src)
+{
+  Roscompressedimagesrc *src = GST_ROSCOMPRESSEDIMAGESRC (ros_base_src);
+
+  GST_DEBUG_OBJECT (src, "close");
+
+  src->sub.reset();
+  rosbasesrc_queue_close(&(src->msg_queue));
+
+  return TRUE;
+}
+
+/* the codec comes from the format string of the first message, or from init-caps */
+static GstCaps* roscompressedimagesrc_getcaps (GstBaseSrc * base_src, GstCaps * filter)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (base_src);
+  Roscompressedimagesrc *src = GST_ROSCOMPRESSEDIMAGESRC (base_src);
+  GstCaps * caps;
+
+  GST_DEBUG_OBJECT (src, "getcaps");
+
+  if(0 != g_strcmp0(src->init_caps, ""))
+  {
+    caps = gst_caps_from_string(src->init_caps);
+  }
+  else if(!ros_base_src->node)
+  {
+    GST_DEBUG_OBJECT (src, "getcaps with node not ready, returning template");
+    return gst_pad_get_pad_template_caps (GST_BASE_SRC (src)->srcpad);
+  }
+  else
+  {
+    RCLCPP_INFO(ros_base_src->logger, "waiting for first message");
+    rosbasesrc_queue_peek(&(src->msg_queue));
+    caps = gst_bridge::compressed_image_format_to_caps(std::string(src->format));
+    if(gst_caps_is_empty(caps))
+      RCLCPP_ERROR(ros_base_src->logger, "no caps for CompressedImage format '%s'", src->format);
+  }
+
+  if(filter)
+  {
+    GstCaps * intersection = gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (caps);
+    caps = intersection;
+  }
+  return caps;
+}
+
+
+/*
+ * Wait for a message to be published, then hand its memory downstream
+ * the encoded frame is passed on as it is, downstream parses or decodes it
+ */
+static GstFlowReturn roscompressedimagesrc_create (GstBaseSrc * base_src, guint64 offset, guint size, GstBuffer **buf)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (base_src);
+  Roscompressedimagesrc *src = GST_ROSCOMPRESSEDIMAGESRC (base_src);
+  GstFlowReturn ret;
+  GstBuffer *res_buf;
+
+  GST_DEBUG_OBJECT (src, "create");
+
+  auto msg = rosbasesrc_queue_pop(&(src->msg_queue));
+  ret = rosbasesrc_msg_data_to_buffer(ros_base_src, msg, msg->data, buf);
+  if(ret != GST_FLOW_OK)
+    return ret;
+  res_buf = *buf;
+
+  GST_BUFFER_PTS (res_buf) = rosbasesrc_msg_stamp_to_pts(ros_base_src, rclcpp::Time(msg->header.stamp).nanoseconds());
+
+  return GST_FLOW_OK;
+}
+
+static void roscompressedimagesrc_sub_cb(Roscompressedimagesrc * src, sensor_msgs::msg::CompressedImage::ConstSharedPtr msg)
+{
+  RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
+
+  //fetch the format from the first msg, check on subsequent
+  if(src->msg_init)
+  {
+    g_free(src->format);
+    src->format = g_strdup(msg->format.c_str());
+    g_free(src->frame_id);
+    src->frame_id = g_strdup(msg->header.frame_id.c_str());
+    src->msg_init = false;
+  }
+  else if(!(0 == g_strcmp0(src->format, msg->format.c_str())))
+  {
+    RCLCPP_ERROR(ros_base_src->logger, "image format changed during playback, format %s != %s", src->format, msg->format.c_str());
+  }
+
+  rosbasesrc_queue_push(ros_base_src, &(src->msg_queue), msg);
+}
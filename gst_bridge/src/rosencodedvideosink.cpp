@@ -0,0 +1,357 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-gstrosencodedvideosink
+ *
+ * The rosencodedvideosink element publishes H.264 or H.265 access units into ROS2 as video_msgs/EncodedVideo.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v videotestsrc ! x264enc tune=zerolatency ! h264parse ! rosencodedvideosink ros-topic="video"
+ * ]|
+ * Streams encoded test video as ROS messages on topic.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video-event.h>
+#include <gst_bridge/rosencodedvideosink.h>
+
+
+GST_DEBUG_CATEGORY_STATIC (rosencodedvideosink_debug_category);
+#define GST_CAT_DEFAULT rosencodedvideosink_debug_category
+
+/* prototypes */
+
+
+static void rosencodedvideosink_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void rosencodedvideosink_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+
+static void rosencodedvideosink_init (Rosencodedvideosink * sink);
+
+static gboolean rosencodedvideosink_open (RosBaseSink * sink);
+static gboolean rosencodedvideosink_close (RosBaseSink * sink);
+static gboolean rosencodedvideosink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps);
+static void rosencodedvideosink_cache_keyframe (Rosencodedvideosink * sink, const video_msgs::msg::EncodedVideo & msg);
+static GstFlowReturn rosencodedvideosink_render (RosBaseSink * base_sink, GstBuffer * buffer, rclcpp::Time msg_time);
+
+enum
+{
+  PROP_0,
+  PROP_ROS_TOPIC,
+  PROP_ROS_FRAME_ID,
+  PROP_RESEND_KEYFRAME,
+  PROP_FORCE_KEYFRAME,
+};
+
+
+/* pad templates */
+
+static GstStaticPadTemplate rosencodedvideosink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (ROS_ENCODED_VIDEO_MSG_CAPS)
+    );
+
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Rosencodedvideosink, rosencodedvideosink, GST_TYPE_ROS_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (rosencodedvideosink_debug_category, "rosencodedvideosink", 0,
+        "debug category for rosencodedvideosink element"))
+
+static void rosencodedvideosink_class_init (RosencodedvideosinkClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+  RosBaseSinkClass *ros_base_sink_class = GST_ROS_BASE_SINK_CLASS (klass);
+
+  object_class->set_property = rosencodedvideosink_set_property;
+  object_class->get_property = rosencodedvideosink_get_property;
+
+  /* Setting up pads and setting metadata should be moved to
+     base_class_init if you intend to subclass this class. */
+  gst_element_class_add_static_pad_template (element_class,
+      &rosencodedvideosink_sink_template);
+
+
+  gst_element_class_set_static_metadata (element_class,
+      "rosencodedvideosink",
+      "Sink",
+      "a gstreamer sink that publishes encoded video into ROS",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "pub-topic", "ROS topic to be published on",
+      "gst_video_pub",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FRAME_ID,
+      g_param_spec_string ("ros-frame-id", "frame-id", "frame_id of the video message",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_RESEND_KEYFRAME,
+      g_param_spec_boolean ("resend-keyframe", "resend-keyframe",
+      "Latch the latest keyframe, with its parameter sets, on <ros-topic>/keyframe for late subscribers",
+      TRUE,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_FORCE_KEYFRAME,
+      g_param_spec_boolean ("force-keyframe", "force-keyframe",
+      "Ask the encoder for a new keyframe when a new subscriber matches",
+      TRUE,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  //access gstreamer base sink events here
+  basesink_class->set_caps = GST_DEBUG_FUNCPTR (rosencodedvideosink_setcaps);  //gstreamer informs us what caps we're using.
+
+  //supply the calls ros base sink needs to negotiate upstream formats and manage the publisher
+  ros_base_sink_class->open = GST_DEBUG_FUNCPTR (rosencodedvideosink_open);  //let the base sink know how we register publishers
+  ros_base_sink_class->close = GST_DEBUG_FUNCPTR (rosencodedvideosink_close);  //let the base sink know how we destroy publishers
+  ros_base_sink_class->render = GST_DEBUG_FUNCPTR (rosencodedvideosink_render); // gives us a buffer to package
+}
+
+static void rosencodedvideosink_init (Rosencodedvideosink * sink)
+{
+  RosBaseSink *ros_base_sink GST_ROS_BASE_SINK(sink);
+  ros_base_sink->node_name = g_strdup("gst_video_sink_node");
+  sink->pub_topic = g_strdup("gst_video_pub");
+  sink->frame_id = g_strdup("video_frame");
+  sink->caps = g_strdup("");
+  sink->h265 = FALSE;
+  sink->msg_seq_num = 0;
+  sink->resend_keyframe = TRUE;
+  sink->force_keyframe = TRUE;
+  sink->subscriber_count = 0;
+}
+
+void rosencodedvideosink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK(object);
+  Rosencodedvideosink *sink = GST_ROSENCODEDVIDEOSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "set_property");
+
+  switch (property_id) {
+    case PROP_ROS_TOPIC:
+      if(ros_base_sink->node)
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "can't change topic name once opened");
+      }
+      else
+      {
+        g_free(sink->pub_topic);
+        sink->pub_topic = g_value_dup_string(value);
+      }
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_free(sink->frame_id);
+      sink->frame_id = g_value_dup_string(value);
+      break;
+
+    case PROP_RESEND_KEYFRAME:
+      if(ros_base_sink->node)
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "can't change resend-keyframe once opened");
+      }
+      else
+      {
+        sink->resend_keyframe = g_value_get_boolean(value);
+      }
+      break;
+
+    case PROP_FORCE_KEYFRAME:
+      sink->force_keyframe = g_value_get_boolean(value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void rosencodedvideosink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Rosencodedvideosink *sink = GST_ROSENCODEDVIDEOSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "get_property");
+  switch (property_id) {
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, sink->pub_topic);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_value_set_string(value, sink->frame_id);
+      break;
+
+    case PROP_RESEND_KEYFRAME:
+      g_value_set_boolean(value, sink->resend_keyframe);
+      break;
+
+    case PROP_FORCE_KEYFRAME:
+      g_value_set_boolean(value, sink->force_keyframe);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+/* open the device with given specs */
+static gboolean rosencodedvideosink_open (RosBaseSink * ros_base_sink)
+{
+  Rosencodedvideosink *sink = GST_ROSENCODEDVIDEOSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "open");
+  rclcpp::QoS qos = rclcpp::SensorDataQoS().reliable();  //XXX add a parameter for overrides
+  sink->pub = ros_base_sink->node->create_publisher<video_msgs::msg::EncodedVideo>(sink->pub_topic, qos);
+  // a late subscriber can start decoding from the latched keyframe instead of waiting for the next one
+  if(sink->resend_keyframe)
+    sink->keyframe_pub = ros_base_sink->node->create_publisher<video_msgs::msg::EncodedVideo>(
+        std::string(sink->pub_topic) + "/keyframe", rclcpp::QoS(1).reliable().transient_local());
+  sink->subscriber_count = 0;
+  return TRUE;
+}
+
+/* close the device */
+static gboolean rosencodedvideosink_close (RosBaseSink * ros_base_sink)
+{
+  Rosencodedvideosink *sink = GST_ROSENCODEDVIDEOSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "close");
+  sink->pub.reset();
+  sink->keyframe_pub.reset();
+  for(auto & param_set : sink->param_sets)
+    param_set.clear();
+  sink->keyframe_msg.reset();
+  return TRUE;
+}
+
+/* the caps go out in every message, so a subscriber can configure its decoder from any of them */
+static gboolean rosencodedvideosink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (gst_base_sink);
+  Rosencodedvideosink *sink = GST_ROSENCODEDVIDEOSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "setcaps");
+
+  g_free(sink->caps);
+  sink->caps = gst_caps_to_string(caps);
+  sink->h265 = gst_structure_has_name(gst_caps_get_structure(caps, 0), "video/x-h265");
+
+  // parameter sets of the old stream don't describe the new one
+  for(auto & param_set : sink->param_sets)
+    param_set.clear();
+  sink->keyframe_msg.reset();
+
+  if(ros_base_sink->node)
+    RCLCPP_INFO(ros_base_sink->logger, "preparing video with caps '%s'", sink->caps);
+
+  return true;
+}
+
+/*
+ * Remember the parameter sets as they go past, and latch the latest keyframe for late subscribers.
+ * Encoders often send the parameter sets only once, so they are put in front of keyframes that lack them.
+ */
+static void rosencodedvideosink_cache_keyframe (Rosencodedvideosink * sink, const video_msgs::msg::EncodedVideo & msg)
+{
+  static const guint8 start_code[] = {0, 0, 0, 1};
+  gboolean has_param_sets = FALSE;
+
+  for(const auto & unit : gst_bridge::byte_stream_nal_units(msg.data.data(), msg.data.size()))
+  {
+    const guint8 * nal = msg.data.data() + unit.first;
+    guint type = gst_bridge::nal_unit_type(nal, sink->h265);
+    if(!gst_bridge::is_parameter_set_nal(type, sink->h265))
+      continue;
+    std::vector<guint8> & param_set = sink->param_sets[type - (sink->h265 ? 32 : 7)];
+    param_set.assign(start_code, start_code + sizeof(start_code));
+    param_set.insert(param_set.end(), nal, nal + unit.second);
+    has_param_sets = TRUE;
+  }
+
+  if(!msg.keyframe)
+    return;
+
+  sink->keyframe_msg = std::make_shared<video_msgs::msg::EncodedVideo>(msg);
+  if(!has_param_sets)
+  {
+    std::vector<guint8> param_sets;
+    for(const auto & param_set : sink->param_sets)
+      param_sets.insert(param_sets.end(), param_set.begin(), param_set.end());
+    sink->keyframe_msg->data.insert(sink->keyframe_msg->data.begin(), param_sets.begin(), param_sets.end());
+  }
+  if(sink->keyframe_pub)
+    sink->keyframe_pub->publish(*(sink->keyframe_msg));
+}
+
+static GstFlowReturn rosencodedvideosink_render (RosBaseSink * ros_base_sink, GstBuffer * buf, rclcpp::Time msg_time)
+{
+  video_msgs::msg::EncodedVideo msg;
+  GstMapInfo info;
+  size_t subscriber_count;
+
+  Rosencodedvideosink *sink = GST_ROSENCODEDVIDEOSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "render");
+
+  msg.header.stamp = msg_time;
+  msg.header.frame_id = sink->frame_id;
+  msg.seq_num = sink->msg_seq_num++;
+  msg.caps = sink->caps;
+  msg.keyframe = !GST_BUFFER_FLAG_IS_SET(buf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  if(!gst_buffer_map (buf, &info, GST_MAP_READ))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "could not map the buffer");
+    return GST_FLOW_ERROR;
+  }
+  msg.data.assign(info.data, info.data + info.size);
+  gst_buffer_unmap (buf, &info);
+
+  rosencodedvideosink_cache_keyframe(sink, msg);
+
+  // the latched keyframe is stale by the time a late subscriber sees it, ask for a fresh one
+  subscriber_count = sink->pub->get_subscription_count();
+  if((subscriber_count > sink->subscriber_count) && !msg.keyframe && sink->force_keyframe)
+  {
+    RCLCPP_INFO(ros_base_sink->logger, "new subscriber, requesting a keyframe");
+    gst_pad_push_event(GST_BASE_SINK_PAD(sink),
+        gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+  }
+  sink->subscriber_count = subscriber_count;
+
+  //publish
+  sink->pub->publish(msg);
+
+  return GST_FLOW_OK;
+}
@@ -0,0 +1,947 @@
+/* GStreamer
+ * Copyright (C) 2020-2021 Brett Downing <brettrd@brettrd.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+/**
+ * SECTION:element-rosflightrecsink
+ *
+ * The rosflightrecsink element, keep the last few seconds of image or audio data
+ * in a fixed size memory-mapped ring file, and dump it when a ROS service is called.
+ * render() only copies the buffer into the ring, it never allocates and never waits on the dump.
+ *
+ * Calling the std_srvs/Trigger service fixes the range of records to dump and holds them,
+ * a separate thread then copies them out of the ring while recording continues.
+ * Held records are never overwritten, so the dump is the ring as it was at the trigger.
+ * If the ring fills up before the dump finishes, new buffers are dropped (and counted) instead.
+ * The ring should hold the duration plus the time a dump takes, so nothing is dropped,
+ * records that had already been overwritten when the service was called are reported as lost.
+ *
+ * dump-format "bag" writes a rosbag2 with the messages rosimagesink or rosaudiosink would publish,
+ * "raw" writes the caps string and a newline, then for each record
+ * an int64 stamp (ns), a uint64 buffer offset, a uint64 size, and the buffer contents, in host byte order.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v v4l2src ! videoconvert ! rosflightrecsink ring-size=1073741824 duration=30000000000
+ * ros2 service call /gst_flightrec_sink_node/dump std_srvs/srv/Trigger
+ * ]|
+ * keeps the last 30 seconds of camera frames, and writes them to a bag on request.
+ * </refsect2>
+ */
+
+
+#include <gst_bridge/rosflightrecsink.h>
+
+#include <rosbag2_cpp/converter_options.hpp>
+#include <rosbag2_cpp/storage_options.hpp>
+#include <rosbag2_cpp/writers/sequential_writer.hpp>
+#include <rosbag2_storage/serialized_bag_message.hpp>
+#include <rosbag2_storage/topic_metadata.hpp>
+#include <rmw/rmw.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+GST_DEBUG_CATEGORY_STATIC (rosflightrecsink_debug_category);
+#define GST_CAT_DEFAULT rosflightrecsink_debug_category
+
+#define ROSFLIGHTRECSINK_IMAGE_TYPE "sensor_msgs/msg/Image"
+#define ROSFLIGHTRECSINK_AUDIO_TYPE "audio_msgs/msg/Audio"
+
+#define ROSFLIGHTRECSINK_RING_MAGIC 0x47465252  // "GFRR"
+#define ROSFLIGHTRECSINK_RING_VERSION 1
+#define ROSFLIGHTRECSINK_RING_ALIGN 64
+
+/* prototypes */
+
+
+static void rosflightrecsink_set_property (GObject * object, guint property_id, const GValue * value, GParamSpec * pspec);
+static void rosflightrecsink_get_property (GObject * object, guint property_id, GValue * value, GParamSpec * pspec);
+static void rosflightrecsink_finalize (GObject * object);
+
+static void rosflightrecsink_init (Rosflightrecsink * sink);
+
+static gboolean rosflightrecsink_open (RosBaseSink * ros_base_sink);
+static gboolean rosflightrecsink_close (RosBaseSink * ros_base_sink);
+static gboolean rosflightrecsink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps);
+
+static GstFlowReturn rosflightrecsink_render (RosBaseSink * sink, GstBuffer * buffer, rclcpp::Time msg_time);
+
+static gboolean rosflightrecsink_ring_open (Rosflightrecsink * sink);
+static void rosflightrecsink_ring_close (Rosflightrecsink * sink);
+static gboolean rosflightrecsink_ring_read (Rosflightrecsink * sink, uint64_t seq, rosflightrec_record * rec);
+
+static void rosflightrecsink_trigger (Rosflightrecsink * sink, std::shared_ptr<std_srvs::srv::Trigger::Response> res);
+static void rosflightrecsink_dump_loop (Rosflightrecsink * sink);
+static void rosflightrecsink_dump (Rosflightrecsink * sink, rosflightrec_snapshot * snap);
+
+enum
+{
+  PROP_0,
+  PROP_RING_LOCATION,
+  PROP_RING_SIZE,
+  PROP_INDEX_SLOTS,
+  PROP_DURATION,
+  PROP_SERVICE_NAME,
+  PROP_DUMP_LOCATION,
+  PROP_DUMP_FORMAT,
+  PROP_STORAGE_ID,
+  PROP_ROS_TOPIC,
+  PROP_ROS_FRAME_ID,
+};
+
+
+/* pad templates */
+
+// the pad template is generated from the image format table in class_init
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (Rosflightrecsink, rosflightrecsink, GST_TYPE_ROS_BASE_SINK,
+    GST_DEBUG_CATEGORY_INIT (rosflightrecsink_debug_category, "rosflightrecsink", 0,
+        "debug category for rosflightrecsink element"))
+
+static void rosflightrecsink_class_init (RosflightrecsinkClass * klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
+  RosBaseSinkClass *ros_base_sink_class = GST_ROS_BASE_SINK_CLASS (klass);
+  GstCaps *template_caps;
+
+  object_class->set_property = rosflightrecsink_set_property;
+  object_class->get_property = rosflightrecsink_get_property;
+  object_class->finalize = rosflightrecsink_finalize;
+
+  template_caps = gst_bridge::getImageMsgCaps();
+  gst_caps_append (template_caps, gst_caps_from_string (ROS_AUDIO_MSG_CAPS));
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS, template_caps));
+  gst_caps_unref (template_caps);
+
+  gst_element_class_set_static_metadata (element_class,
+      "rosflightrecsink",
+      "Sink/File",
+      "a gstreamer sink that keeps the last few seconds of image or audio data, and dumps them on a ROS service call",
+      "BrettRD <brettrd@brettrd.com>");
+
+  g_object_class_install_property (object_class, PROP_RING_LOCATION,
+      g_param_spec_string ("ring-location", "ring-location", "path of the memory-mapped ring file",
+      "gst_flight_recorder.ring",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_RING_SIZE,
+      g_param_spec_uint64 ("ring-size", "ring-size", "bytes of buffer data held in the ring",
+      1024, G_MAXUINT64, 512*1024*1024,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_INDEX_SLOTS,
+      g_param_spec_uint ("index-slots", "index-slots", "most buffers the ring can hold, regardless of their size",
+      16, G_MAXUINT, 16384,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_DURATION,
+      g_param_spec_uint64 ("duration", "duration", "history written by a dump (ns), limited by the ring size",
+      0, G_MAXUINT64, 30*GST_SECOND,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_SERVICE_NAME,
+      g_param_spec_string ("service-name", "service-name", "std_srvs/Trigger service that dumps the ring",
+      "~/dump",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_DUMP_LOCATION,
+      g_param_spec_string ("dump-location", "dump-location", "path prefix of dumps, the trigger time is appended",
+      "flight_recorder",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_DUMP_FORMAT,
+      g_param_spec_string ("dump-format", "dump-format", "write dumps as a rosbag2 \"bag\" or a \"raw\" record file",
+      "bag",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_STORAGE_ID,
+      g_param_spec_string ("storage-id", "storage-id", "rosbag2 storage plugin for bag dumps",
+      "sqlite3",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_TOPIC,
+      g_param_spec_string ("ros-topic", "topic", "topic name recorded in bag dumps",
+      "gst_flightrec_topic",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_ROS_FRAME_ID,
+      g_param_spec_string ("ros-frame-id", "frame-id", "frame_id of the messages in bag dumps",
+      "",
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  //access gstreamer base sink events here
+  basesink_class->set_caps = GST_DEBUG_FUNCPTR (rosflightrecsink_setcaps);  //gstreamer informs us what caps we're using.
+
+  //supply the calls ros base sink needs to manage the ring and the service
+  ros_base_sink_class->open = GST_DEBUG_FUNCPTR (rosflightrecsink_open);  //map the ring and offer the service
+  ros_base_sink_class->close = GST_DEBUG_FUNCPTR (rosflightrecsink_close);  //finish any dump and unmap the ring
+  ros_base_sink_class->render = GST_DEBUG_FUNCPTR (rosflightrecsink_render); // copies a buffer into the ring
+}
+
+static void rosflightrecsink_init (Rosflightrecsink * sink)
+{
+  RosBaseSink *ros_base_sink GST_ROS_BASE_SINK(sink);
+  ros_base_sink->node_name = g_strdup("gst_flightrec_sink_node");
+  sink->ring_location = g_strdup("gst_flight_recorder.ring");
+  sink->ring_size = 512*1024*1024;
+  sink->index_slots = 16384;
+  sink->duration = 30*GST_SECOND;
+  sink->service_name = g_strdup("~/dump");
+  sink->dump_location = g_strdup("flight_recorder");
+  sink->dump_format = g_strdup("bag");
+  sink->storage_id = g_strdup("sqlite3");
+  sink->topic = g_strdup("gst_flightrec_topic");
+  sink->frame_id = g_strdup("");
+
+  sink->ring_fd = -1;
+  sink->ring_map_size = 0;
+  sink->ring_map = NULL;
+  sink->ring = NULL;
+  sink->records = NULL;
+  sink->ring_data = NULL;
+
+  // GObject doesn't run C++ constructors
+  new (&(sink->info_mtx)) std::mutex();
+  new (&(sink->service)) rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr();
+  new (&(sink->dump_thread)) std::thread();
+  new (&(sink->dump_mtx)) std::mutex();
+  new (&(sink->dump_cv)) std::condition_variable();
+
+  sink->is_audio = FALSE;
+  sink->step = 0;
+  sink->encoding = NULL;
+  sink->caps_str = NULL;
+  sink->caps_first_seq = 0;
+  sink->snapshot.encoding = NULL;
+  sink->snapshot.caps_str = NULL;
+  sink->snapshot.location = NULL;
+  sink->dump_pending = false;
+  sink->dump_running = false;
+  sink->hold.store(false);
+  sink->hold_seq.store(0);
+  sink->held_drops.store(0);
+}
+
+static void rosflightrecsink_finalize (GObject * object)
+{
+  Rosflightrecsink *sink = GST_ROSFLIGHTRECSINK (object);
+
+  g_free(sink->ring_location);
+  g_free(sink->service_name);
+  g_free(sink->dump_location);
+  g_free(sink->dump_format);
+  g_free(sink->storage_id);
+  g_free(sink->topic);
+  g_free(sink->frame_id);
+  g_free(sink->encoding);
+  g_free(sink->caps_str);
+
+  sink->info_mtx.~mutex();
+  sink->service.~shared_ptr();
+  sink->dump_thread.~thread();
+  sink->dump_mtx.~mutex();
+  sink->dump_cv.~condition_variable();
+
+  G_OBJECT_CLASS (rosflightrecsink_parent_class)->finalize (object);
+}
+
+void rosflightrecsink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  Rosflightrecsink *sink = GST_ROSFLIGHTRECSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "set_property");
+
+  if(property_id == PROP_DURATION)
+  {
+    std::lock_guard<std::mutex> lock(sink->dump_mtx);
+    sink->duration = g_value_get_uint64(value);
+    return;
+  }
+
+  // everything else is read by the dump thread or sizes the ring
+  if(sink->ring)
+  {
+    GST_WARNING_OBJECT (sink, "can't change %s once the ring is open", pspec->name);
+    return;
+  }
+
+  switch (property_id) {
+    case PROP_RING_LOCATION:
+      g_free(sink->ring_location);
+      sink->ring_location = g_value_dup_string(value);
+      break;
+
+    case PROP_RING_SIZE:
+      sink->ring_size = g_value_get_uint64(value);
+      break;
+
+    case PROP_INDEX_SLOTS:
+      sink->index_slots = g_value_get_uint(value);
+      break;
+
+    case PROP_SERVICE_NAME:
+      g_free(sink->service_name);
+      sink->service_name = g_value_dup_string(value);
+      break;
+
+    case PROP_DUMP_LOCATION:
+      g_free(sink->dump_location);
+      sink->dump_location = g_value_dup_string(value);
+      break;
+
+    case PROP_DUMP_FORMAT:
+      if(g_strcmp0(g_value_get_string(value), "bag") && g_strcmp0(g_value_get_string(value), "raw"))
+      {
+        GST_WARNING_OBJECT (sink, "dump-format must be \"bag\" or \"raw\"");
+        break;
+      }
+      g_free(sink->dump_format);
+      sink->dump_format = g_value_dup_string(value);
+      break;
+
+    case PROP_STORAGE_ID:
+      g_free(sink->storage_id);
+      sink->storage_id = g_value_dup_string(value);
+      break;
+
+    case PROP_ROS_TOPIC:
+      g_free(sink->topic);
+      sink->topic = g_value_dup_string(value);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_free(sink->frame_id);
+      sink->frame_id = g_value_dup_string(value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+void rosflightrecsink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  Rosflightrecsink *sink = GST_ROSFLIGHTRECSINK (object);
+
+  GST_DEBUG_OBJECT (sink, "get_property");
+  switch (property_id) {
+    case PROP_RING_LOCATION:
+      g_value_set_string(value, sink->ring_location);
+      break;
+
+    case PROP_RING_SIZE:
+      g_value_set_uint64(value, sink->ring_size);
+      break;
+
+    case PROP_INDEX_SLOTS:
+      g_value_set_uint(value, sink->index_slots);
+      break;
+
+    case PROP_DURATION:
+      g_value_set_uint64(value, sink->duration);
+      break;
+
+    case PROP_SERVICE_NAME:
+      g_value_set_string(value, sink->service_name);
+      break;
+
+    case PROP_DUMP_LOCATION:
+      g_value_set_string(value, sink->dump_location);
+      break;
+
+    case PROP_DUMP_FORMAT:
+      g_value_set_string(value, sink->dump_format);
+      break;
+
+    case PROP_STORAGE_ID:
+      g_value_set_string(value, sink->storage_id);
+      break;
+
+    case PROP_ROS_TOPIC:
+      g_value_set_string(value, sink->topic);
+      break;
+
+    case PROP_ROS_FRAME_ID:
+      g_value_set_string(value, sink->frame_id);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+
+/* map the ring, offer the dump service, and start the dump thread */
+static gboolean rosflightrecsink_open (RosBaseSink * ros_base_sink)
+{
+  Rosflightrecsink *sink = GST_ROSFLIGHTRECSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "open");
+
+  if(!rosflightrecsink_ring_open(sink))
+  {
+    RCLCPP_ERROR(ros_base_sink->node->get_logger(), "could not map ring file '%s'", sink->ring_location);
+    return FALSE;
+  }
+
+  sink->service = ros_base_sink->node->create_service<std_srvs::srv::Trigger>(sink->service_name,
+    [sink](const std::shared_ptr<std_srvs::srv::Trigger::Request> req,
+      std::shared_ptr<std_srvs::srv::Trigger::Response> res)
+    {
+      (void) req;
+      rosflightrecsink_trigger(sink, res);
+    });
+
+  sink->dump_pending = false;
+  sink->dump_running = true;
+  sink->hold.store(false);
+  sink->dump_thread = std::thread(rosflightrecsink_dump_loop, sink);
+
+  return TRUE;
+}
+
+/* finish any dump in progress and unmap the ring */
+static gboolean rosflightrecsink_close (RosBaseSink * ros_base_sink)
+{
+  Rosflightrecsink *sink = GST_ROSFLIGHTRECSINK (ros_base_sink);
+  GST_DEBUG_OBJECT (sink, "close");
+
+  // the executor is still spinning, a trigger may already be running,
+  // it checks dump_running under dump_mtx so it can't touch the ring once this is cleared
+  sink->service.reset();
+
+  {
+    std::lock_guard<std::mutex> lock(sink->dump_mtx);
+    sink->dump_running = false;
+    sink->dump_cv.notify_all();
+  }
+  if(sink->dump_thread.joinable())
+    sink->dump_thread.join();
+
+  rosflightrecsink_ring_close(sink);
+
+  return TRUE;
+}
+
+
+// gstreamer is changing the caps, records from here on are dumped with the new caps
+static gboolean rosflightrecsink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (gst_base_sink);
+  Rosflightrecsink *sink = GST_ROSFLIGHTRECSINK (ros_base_sink);
+
+  GstVideoInfo video_info;
+  std::string encoding;
+  GstAudioInfo audio_info;
+  gboolean is_audio;
+
+  GST_DEBUG_OBJECT (sink, "setcaps");
+
+  if(!gst_caps_is_fixed(caps))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "caps is not fixed");
+    return false;
+  }
+
+  if(ros_base_sink->node)
+      RCLCPP_INFO(ros_base_sink->logger, "recording with caps '%s'",
+          gst_caps_to_string(caps));
+
+  is_audio = gst_structure_has_name(gst_caps_get_structure (caps, 0), "audio/x-raw");
+  if(is_audio ? !gst_audio_info_from_caps(&audio_info, caps) : !gst_bridge::video_info_from_caps(&video_info, &encoding, caps))
+    return false;
+
+  std::lock_guard<std::mutex> lock(sink->info_mtx);
+  sink->is_audio = is_audio;
+  if(is_audio)
+    sink->audio_info = audio_info;
+  else
+  {
+    sink->video_info = video_info;
+    g_free(sink->encoding);
+    sink->encoding = g_strdup(encoding.c_str());
+    sink->step = gst_bridge::gst_video_info_to_image_msg(&video_info).step;
+  }
+  g_free(sink->caps_str);
+  sink->caps_str = gst_caps_to_string(caps);
+  sink->caps_first_seq = sink->ring ? sink->ring->next_seq.load(std::memory_order_relaxed) : 0;
+
+  return true;
+}
+
+
+/*
+ * copy the buffer into the ring, this is the only writer
+ * the head is advanced before the payload is written,
+ * so a reader can tell if the bytes it copied were overwritten underneath it
+ */
+static GstFlowReturn rosflightrecsink_render (RosBaseSink * ros_base_sink, GstBuffer * buf, rclcpp::Time msg_time)
+{
+  Rosflightrecsink *sink = GST_ROSFLIGHTRECSINK (ros_base_sink);
+  rosflightrec_ring_header *ring = sink->ring;
+  rosflightrec_record *rec;
+  uint64_t size, pos, off, seq;
+  gsize plane_offset[GST_VIDEO_MAX_PLANES];
+  gint plane_stride[GST_VIDEO_MAX_PLANES];
+
+  GST_DEBUG_OBJECT (sink, "render");
+
+  // video is stored in the image message layout, so planes and strides are settled before the dump
+  if(sink->is_audio)
+    size = gst_buffer_get_size(buf);
+  else
+    size = gst_bridge::image_msg_plane_layout(&(sink->video_info), sink->step, plane_offset, plane_stride);
+
+  if(size > ring->data_size)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "buffer of %" G_GUINT64_FORMAT " bytes is larger than the ring", size);
+    return GST_FLOW_OK;
+  }
+
+  // records are never split across the end of the ring
+  pos = ring->head.load(std::memory_order_relaxed);
+  off = pos % ring->data_size;
+  if(off + size > ring->data_size)
+  {
+    pos += ring->data_size - off;
+    off = 0;
+  }
+
+  seq = ring->next_seq.load(std::memory_order_relaxed);
+
+  // a dump holds the records from hold_seq on, neither their slots nor their payload can be reused yet
+  if(sink->hold.load(std::memory_order_acquire))
+  {
+    uint64_t hold_seq = sink->hold_seq.load(std::memory_order_relaxed);
+    rosflightrec_record *held = &(sink->records[hold_seq % ring->index_slots]);
+    if((seq >= hold_seq + ring->index_slots) || (pos + size > held->pos + ring->data_size))
+    {
+      sink->held_drops.fetch_add(1, std::memory_order_relaxed);
+      return GST_FLOW_OK;
+    }
+  }
+
+  rec = &(sink->records[seq % ring->index_slots]);
+
+  rec->lock.store(2*seq + 1, std::memory_order_relaxed);
+  ring->head.store(pos + size, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if(sink->is_audio)
+    gst_buffer_extract(buf, 0, sink->ring_data + off, size);
+  else
+    gst_bridge::copy_video_frame_to_msg_data(&(sink->video_info), buf, sink->ring_data + off, sink->step);
+  rec->seq = seq;
+  rec->pos = pos;
+  rec->size = size;
+  rec->stamp = msg_time.nanoseconds();
+  rec->offset = GST_BUFFER_OFFSET(buf);
+
+  rec->lock.store(2*seq + 2, std::memory_order_release);
+  ring->next_seq.store(seq + 1, std::memory_order_release);
+
+  return GST_FLOW_OK;
+}
+
+
+/* create and map the ring file, the whole file is allocated up front so render never hits a full disk */
+static gboolean rosflightrecsink_ring_open (Rosflightrecsink * sink)
+{
+  size_t header_size = GST_ROUND_UP_N(sizeof(rosflightrec_ring_header), ROSFLIGHTRECSINK_RING_ALIGN);
+  size_t index_size = GST_ROUND_UP_N(sizeof(rosflightrec_record) * sink->index_slots, ROSFLIGHTRECSINK_RING_ALIGN);
+  void * map;
+
+  sink->ring_map_size = header_size + index_size + sink->ring_size;
+
+  sink->ring_fd = open(sink->ring_location, O_RDWR | O_CREAT, 0644);
+  if(sink->ring_fd < 0)
+    return FALSE;
+
+  if((0 != ftruncate(sink->ring_fd, sink->ring_map_size)) ||
+    (0 != posix_fallocate(sink->ring_fd, 0, sink->ring_map_size)))
+  {
+    close(sink->ring_fd);
+    sink->ring_fd = -1;
+    return FALSE;
+  }
+
+  map = mmap(NULL, sink->ring_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, sink->ring_fd, 0);
+  if(map == MAP_FAILED)
+  {
+    close(sink->ring_fd);
+    sink->ring_fd = -1;
+    return FALSE;
+  }
+  sink->ring_map = (guint8*) map;
+
+  // a fresh ring every time, stale records from a previous run are not dumped
+  sink->ring = new (sink->ring_map) rosflightrec_ring_header();
+  sink->ring->magic = ROSFLIGHTRECSINK_RING_MAGIC;
+  sink->ring->version = ROSFLIGHTRECSINK_RING_VERSION;
+  sink->ring->data_size = sink->ring_size;
+  sink->ring->index_slots = sink->index_slots;
+  sink->ring->head.store(0);
+  sink->ring->next_seq.store(0);
+
+  sink->records = (rosflightrec_record*) (sink->ring_map + header_size);
+  for(guint i = 0; i < sink->index_slots; i++)
+  {
+    new (&(sink->records[i])) rosflightrec_record();
+    sink->records[i].lock.store(0);
+  }
+
+  sink->ring_data = sink->ring_map + header_size + index_size;
+  sink->caps_first_seq = 0;
+
+  return TRUE;
+}
+
+static void rosflightrecsink_ring_close (Rosflightrecsink * sink)
+{
+  if(sink->ring_map)
+    munmap(sink->ring_map, sink->ring_map_size);
+  if(sink->ring_fd >= 0)
+    close(sink->ring_fd);
+
+  sink->ring_fd = -1;
+  sink->ring_map = NULL;
+  sink->ring = NULL;
+  sink->records = NULL;
+  sink->ring_data = NULL;
+}
+
+/* seqlock read of a record descriptor, fails if the slot has moved on to a newer record */
+static gboolean rosflightrecsink_ring_read (Rosflightrecsink * sink, uint64_t seq, rosflightrec_record * rec)
+{
+  rosflightrec_record *slot = &(sink->records[seq % sink->ring->index_slots]);
+  uint64_t lock_before, lock_after;
+
+  lock_before = slot->lock.load(std::memory_order_acquire);
+  if(lock_before != 2*seq + 2)
+    return FALSE;
+
+  rec->seq = slot->seq;
+  rec->pos = slot->pos;
+  rec->size = slot->size;
+  rec->stamp = slot->stamp;
+  rec->offset = slot->offset;
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  lock_after = slot->lock.load(std::memory_order_relaxed);
+
+  return lock_before == lock_after;
+}
+
+
+/*
+ * service callback, runs on the ros executor thread
+ * fixes the range of records to dump, holds them against render, and hands them to the dump thread
+ */
+static void rosflightrecsink_trigger (Rosflightrecsink * sink, std::shared_ptr<std_srvs::srv::Trigger::Response> res)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (sink);
+  rosflightrec_snapshot *snap = &(sink->snapshot);
+  rcl_time_point_value_t now;
+  uint64_t end_seq;
+
+  std::lock_guard<std::mutex> lock(sink->dump_mtx);
+
+  // close clears dump_running under dump_mtx before it unmaps the ring
+  if(!sink->dump_running || !sink->ring)
+  {
+    res->success = false;
+    res->message = "the recorder is closing";
+    return;
+  }
+  if(sink->dump_pending)
+  {
+    res->success = false;
+    res->message = "a dump is already in progress";
+    return;
+  }
+
+  // the base sink drops its clock before closing us, ask the node directly
+  end_seq = sink->ring->next_seq.load(std::memory_order_acquire);
+  now = ros_base_sink->node->now().nanoseconds();
+  snap->clock_type = ros_base_sink->node->get_clock()->get_clock_type();
+
+  {
+    std::lock_guard<std::mutex> info_lock(sink->info_mtx);
+    if(!sink->caps_str || (end_seq <= sink->caps_first_seq))
+    {
+      res->success = false;
+      res->message = "nothing has been recorded";
+      return;
+    }
+    snap->first_seq = sink->caps_first_seq;
+    snap->is_audio = sink->is_audio;
+    snap->video_info = sink->video_info;
+    snap->encoding = g_strdup(sink->encoding);
+    snap->audio_info = sink->audio_info;
+    snap->caps_str = g_strdup(sink->caps_str);
+  }
+
+  // the index can't describe more than index_slots records
+  if(end_seq - snap->first_seq > sink->ring->index_slots)
+    snap->first_seq = end_seq - sink->ring->index_slots;
+  snap->end_seq = end_seq;
+  snap->start_stamp = now - (rcl_time_point_value_t) sink->duration;
+
+  // hold from the first record still in the ring and inside the duration,
+  // render checks the hold before each write, so everything from here to end_seq stays put
+  for(; snap->first_seq < end_seq; snap->first_seq++)
+  {
+    rosflightrec_record rec;
+    if(rosflightrecsink_ring_read(sink, snap->first_seq, &rec) && (rec.stamp >= snap->start_stamp) &&
+      (sink->ring->head.load(std::memory_order_acquire) <= rec.pos + sink->ring->data_size))
+      break;
+  }
+  sink->hold_seq.store(snap->first_seq, std::memory_order_relaxed);
+  sink->held_drops.store(0, std::memory_order_relaxed);
+  sink->hold.store(snap->first_seq < end_seq, std::memory_order_release);
+  snap->location = g_strdup_printf("%s_%" G_GINT64_FORMAT "%s", sink->dump_location, now,
+    g_strcmp0(sink->dump_format, "raw") ? "" : ".raw");
+
+  sink->dump_pending = true;
+  sink->dump_cv.notify_all();
+
+  res->success = true;
+  res->message = snap->location;
+}
+
+static void rosflightrecsink_dump_loop (Rosflightrecsink * sink)
+{
+  std::unique_lock<std::mutex> lock(sink->dump_mtx);
+
+  while(true)
+  {
+    sink->dump_cv.wait(lock, [sink]{
+      return sink->dump_pending || !sink->dump_running;
+    });
+    if(!sink->dump_pending)
+      break;
+
+    // the snapshot is ours until dump_pending is cleared
+    lock.unlock();
+    rosflightrecsink_dump(sink, &(sink->snapshot));
+    sink->hold.store(false, std::memory_order_release);
+    lock.lock();
+
+    g_free(sink->snapshot.encoding);
+    g_free(sink->snapshot.caps_str);
+    g_free(sink->snapshot.location);
+    sink->snapshot.encoding = NULL;
+    sink->snapshot.caps_str = NULL;
+    sink->snapshot.location = NULL;
+    sink->dump_pending = false;
+  }
+}
+
+/*
+ * copy each record out of the ring, check it wasn't overwritten meanwhile, and write it out
+ * a write error abandons the dump, the caller releases the hold either way
+ */
+static void rosflightrecsink_dump (Rosflightrecsink * sink, rosflightrec_snapshot * snap)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (sink);
+  gboolean raw = (0 == g_strcmp0(sink->dump_format, "raw"));
+  std::unique_ptr<rosbag2_cpp::writers::SequentialWriter> writer;
+  FILE * raw_file = NULL;
+  std::vector<guint8> scratch;
+  rosflightrec_record rec;
+  uint64_t head, msg_seq_num = 0;
+  guint written = 0, lost = 0, unserialized = 0;
+  gboolean failed = FALSE;
+
+  if(raw)
+  {
+    raw_file = fopen(snap->location, "wb");
+    if(!raw_file)
+    {
+      RCLCPP_ERROR(ros_base_sink->logger, "could not open dump file '%s'", snap->location);
+      return;
+    }
+    if(fprintf(raw_file, "%s\n", snap->caps_str) < 0)
+    {
+      RCLCPP_ERROR(ros_base_sink->logger, "could not write dump file '%s': %s", snap->location, g_strerror(errno));
+      fclose(raw_file);
+      return;
+    }
+  }
+  else
+  {
+    rosbag2_cpp::StorageOptions storage_options;
+    storage_options.uri = snap->location;
+    storage_options.storage_id = sink->storage_id;
+
+    rosbag2_cpp::ConverterOptions converter_options;
+    converter_options.input_serialization_format = rmw_get_serialization_format();
+    converter_options.output_serialization_format = rmw_get_serialization_format();
+
+    rosbag2_storage::TopicMetadata topic_meta;
+    topic_meta.name = sink->topic;
+    topic_meta.type = snap->is_audio ? ROSFLIGHTRECSINK_AUDIO_TYPE : ROSFLIGHTRECSINK_IMAGE_TYPE;
+    topic_meta.serialization_format = rmw_get_serialization_format();
+    topic_meta.offered_qos_profiles = "";
+
+    writer = std::make_unique<rosbag2_cpp::writers::SequentialWriter>();
+    try
+    {
+      writer->open(storage_options, converter_options);
+      writer->create_topic(topic_meta);
+    }
+    catch (const std::exception & e)
+    {
+      RCLCPP_ERROR(ros_base_sink->logger, "could not open dump bag '%s': %s", snap->location, e.what());
+      return;
+    }
+  }
+
+  for(uint64_t seq = snap->first_seq; seq < snap->end_seq; seq++)
+  {
+    if(!rosflightrecsink_ring_read(sink, seq, &rec))
+    {
+      lost++;
+      continue;
+    }
+    if(rec.stamp < snap->start_stamp)
+      continue;
+
+    scratch.resize(rec.size);
+    memcpy(scratch.data(), sink->ring_data + (rec.pos % sink->ring->data_size), rec.size);
+
+    // render moves the head before it writes, so this catches a partial overwrite
+    std::atomic_thread_fence(std::memory_order_acquire);
+    head = sink->ring->head.load(std::memory_order_relaxed);
+    if(head > rec.pos + sink->ring->data_size)
+    {
+      lost++;
+      continue;
+    }
+
+    if(raw)
+    {
+      if((fwrite(&rec.stamp, sizeof(rec.stamp), 1, raw_file) != 1) ||
+        (fwrite(&rec.offset, sizeof(rec.offset), 1, raw_file) != 1) ||
+        (fwrite(&rec.size, sizeof(rec.size), 1, raw_file) != 1) ||
+        (fwrite(scratch.data(), 1, rec.size, raw_file) != rec.size))
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "could not write dump file '%s': %s", snap->location, g_strerror(errno));
+        failed = TRUE;
+        break;
+      }
+    }
+    else
+    {
+      std::shared_ptr<rcutils_uint8_array_t> serialized;
+      rclcpp::Time stamp(rec.stamp, snap->clock_type);
+
+      if(snap->is_audio)
+      {
+        // the message helpers take buffers, wrap the copy without another allocation
+        GstBuffer * buf = gst_buffer_new_wrapped_full((GstMemoryFlags) GST_MEMORY_FLAG_READONLY,
+          scratch.data(), rec.size, 0, rec.size, NULL, NULL);
+        GST_BUFFER_OFFSET(buf) = rec.offset;
+
+        audio_msgs::msg::Audio msg = gst_bridge::gst_audio_info_to_audio_msg(&(snap->audio_info));
+        msg.header.stamp = stamp;
+        msg.header.frame_id = sink->frame_id;
+        gst_bridge::fill_audio_msg_data(msg, buf, &msg_seq_num);
+        serialized = gst_bridge::serialize_msg(msg);
+        gst_buffer_unref(buf);
+      }
+      else
+      {
+        // already in the message layout
+        sensor_msgs::msg::Image msg = gst_bridge::gst_video_info_to_image_msg(&(snap->video_info));
+        msg.encoding = snap->encoding;
+        msg.header.stamp = stamp;
+        msg.header.frame_id = sink->frame_id;
+        msg.data.assign(scratch.begin(), scratch.end());
+        serialized = gst_bridge::serialize_msg(msg);
+      }
+
+      if(!serialized)
+      {
+        unserialized++;
+        continue;
+      }
+
+      auto bag_msg = std::make_shared<rosbag2_storage::SerializedBagMessage>();
+      bag_msg->serialized_data = serialized;
+      bag_msg->topic_name = sink->topic;
+      bag_msg->time_stamp = rec.stamp;
+      // this is our own thread, an exception escaping it would terminate the pipeline
+      try
+      {
+        writer->write(bag_msg);
+      }
+      catch (const std::exception & e)
+      {
+        RCLCPP_ERROR(ros_base_sink->logger, "could not write dump bag '%s': %s", snap->location, e.what());
+        failed = TRUE;
+        break;
+      }
+    }
+    written++;
+  }
+
+  if(raw_file && (0 != fclose(raw_file)) && !failed)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "could not write dump file '%s': %s", snap->location, g_strerror(errno));
+    failed = TRUE;
+  }
+  writer.reset();
+
+  if(failed)
+    RCLCPP_ERROR(ros_base_sink->logger, "dump to '%s' abandoned after %u records", snap->location, written);
+  else
+    RCLCPP_INFO(ros_base_sink->logger, "dumped %u records to '%s'", written, snap->location);
+  if(unserialized)
+    RCLCPP_WARN(ros_base_sink->logger, "%u records could not be serialized into messages", unserialized);
+  if(lost)
+    RCLCPP_WARN(ros_base_sink->logger, "%u records were overwritten before the dump was triggered, "
+      "increase ring-size or index-slots", lost);
+  if(sink->held_drops.load(std::memory_order_relaxed))
+    RCLCPP_WARN(ros_base_sink->logger, "%" G_GUINT64_FORMAT " buffers were dropped while the dump held a full ring, "
+      "the ring should hold the duration plus the time a dump takes", (guint64) sink->held_drops.load(std::memory_order_relaxed));
+}
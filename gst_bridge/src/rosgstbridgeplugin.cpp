@@ -50,6 +50,15 @@
 #include <gst_bridge/rosimagesink.h>
 #include <gst_bridge/rosaudiosrc.h>
 #include <gst_bridge/rosimagesrc.h>
+#include <gst_bridge/roscompressedimagesink.h>
+#include <gst_bridge/roscompressedimagesrc.h>
+#include <gst_bridge/rosencodedvideosink.h>
+#include <gst_bridge/rosencodedvideosrc.h>
+#include <gst_bridge/roscompressedaudiosink.h>
+#include <gst_bridge/roscompressedaudiosrc.h>
+#include <gst_bridge/rosbagsrc.h>
+#include <gst_bridge/rosbagsink.h>
+#include <gst_bridge/rosflightrecsink.h>
 
 
 static gboolean
@@ -71,6 +80,33 @@ plugin_init (GstPlugin * plugin)
   gst_element_register (plugin, "rosimagesrc", GST_RANK_NONE,
       GST_TYPE_ROSIMAGESRC);
 
+  gst_element_register (plugin, "roscompressedimagesink", GST_RANK_NONE,
+      GST_TYPE_ROSCOMPRESSEDIMAGESINK);
+
+  gst_element_register (plugin, "roscompressedimagesrc", GST_RANK_NONE,
+      GST_TYPE_ROSCOMPRESSEDIMAGESRC);
+
+  gst_element_register (plugin, "rosencodedvideosink", GST_RANK_NONE,
+      GST_TYPE_ROSENCODEDVIDEOSINK);
+
+  gst_element_register (plugin, "rosencodedvideosrc", GST_RANK_NONE,
+      GST_TYPE_ROSENCODEDVIDEOSRC);
+
+  gst_element_register (plugin, "roscompressedaudiosink", GST_RANK_NONE,
+      GST_TYPE_ROSCOMPRESSEDAUDIOSINK);
+
+  gst_element_register (plugin, "roscompressedaudiosrc", GST_RANK_NONE,
+      GST_TYPE_ROSCOMPRESSEDAUDIOSRC);
+
+  gst_element_register (plugin, "rosbagsrc", GST_RANK_NONE,
+      GST_TYPE_ROSBAGSRC);
+
+  gst_element_register (plugin, "rosbagsink", GST_RANK_NONE,
+      GST_TYPE_ROSBAGSINK);
+
+  gst_element_register (plugin, "rosflightrecsink", GST_RANK_NONE,
+      GST_TYPE_ROSFLIGHTRECSINK);
+
 
   return true;
 }
@@ -52,7 +52,10 @@ static void rosimagesink_init (Rosimagesink * sink);
 static gboolean rosimagesink_open (RosBaseSink * sink);
 static gboolean rosimagesink_close (RosBaseSink * sink);
 static gboolean rosimagesink_setcaps (GstBaseSink * gst_base_sink, GstCaps * caps);
+static gboolean rosimagesink_propose_allocation (GstBaseSink * gst_base_sink, GstQuery * query);
+static gboolean rosimagesink_setup_converter (Rosimagesink * sink, GstVideoInfo * video_info, GstCaps * caps);
 static GstFlowReturn rosimagesink_render (RosBaseSink * base_sink, GstBuffer * buffer, rclcpp::Time msg_time);
+static void rosimagesink_prepare_msg (Rosimagesink * sink);
 
 enum
 {
@@ -60,17 +63,14 @@ enum
   PROP_ROS_TOPIC,
   PROP_ROS_FRAME_ID,
   PROP_ROS_ENCODING,
+  PROP_KEEP_ROW_PADDING,
+  PROP_CONVERT_THREADS,
 };
 
 
 /* pad templates */
 
-static GstStaticPadTemplate rosimagesink_sink_template =
-GST_STATIC_PAD_TEMPLATE ("sink",
-    GST_PAD_SINK,
-    GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (ROS_IMAGE_MSG_CAPS)
-    );
+// the pad template is generated from the image format table in class_init
 
 /* class initialization */
 
@@ -84,14 +84,18 @@ static void rosimagesink_class_init (RosimagesinkClass * klass)
   GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
   GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
   RosBaseSinkClass *ros_base_sink_class = GST_ROS_BASE_SINK_CLASS (klass);
+  GstCaps *template_caps;
 
   object_class->set_property = rosimagesink_set_property;
   object_class->get_property = rosimagesink_get_property;
 
   /* Setting up pads and setting metadata should be moved to
      base_class_init if you intend to subclass this class. */
-  gst_element_class_add_static_pad_template (element_class,
-      &rosimagesink_sink_template);
+  template_caps = gst_bridge::getImageMsgCaps();
+  gst_caps_append (template_caps, gst_caps_from_string (ROS_IMAGE_CONVERT_CAPS));
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS, template_caps));
+  gst_caps_unref (template_caps);
 
 
   gst_element_class_set_static_metadata (element_class,
@@ -118,8 +122,23 @@ static void rosimagesink_class_init (RosimagesinkClass * klass)
       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
   );
 
+  g_object_class_install_property (object_class, PROP_KEEP_ROW_PADDING,
+      g_param_spec_boolean ("keep-row-padding", "keep-row-padding",
+      "Publish images with the row stride upstream allocated, instead of repacking rows to width * pixel size",
+      false,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_CONVERT_THREADS,
+      g_param_spec_uint ("convert-threads", "convert-threads",
+      "Threads converting formats ROS can't carry into ros-encoding, 0 uses one per core",
+      0, G_MAXUINT, 1,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
   //access gstreamer base sink events here
   basesink_class->set_caps = GST_DEBUG_FUNCPTR (rosimagesink_setcaps);  //gstreamer informs us what caps we're using.
+  basesink_class->propose_allocation = GST_DEBUG_FUNCPTR (rosimagesink_propose_allocation);  //accept padded strides from upstream
 
   //supply the calls ros base sink needs to negotiate upstream formats and manage the publisher
   ros_base_sink_class->open = GST_DEBUG_FUNCPTR (rosimagesink_open);  //let the base sink know how we register publishers
@@ -135,6 +154,11 @@ static void rosimagesink_init (Rosimagesink * sink)
   sink->frame_id = g_strdup("image_frame");
   sink->encoding = g_strdup("");
   sink->init_caps =  g_strdup("");
+  sink->row_conversion = nullptr;
+  sink->keep_row_padding = FALSE;
+  sink->convert_threads = 1;
+  sink->converter = NULL;
+  sink->convert_buf = NULL;
 }
 
 void rosimagesink_set_property (GObject * object, guint property_id,
@@ -168,6 +192,14 @@ void rosimagesink_set_property (GObject * object, guint property_id,
       sink->encoding = g_value_dup_string(value);
       break;
 
+    case PROP_KEEP_ROW_PADDING:
+      sink->keep_row_padding = g_value_get_boolean(value);
+      break;
+
+    case PROP_CONVERT_THREADS:
+      sink->convert_threads = g_value_get_uint(value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -193,6 +225,14 @@ void rosimagesink_get_property (GObject * object, guint property_id,
       g_value_set_string(value, sink->encoding);
       break;
 
+    case PROP_KEEP_ROW_PADDING:
+      g_value_set_boolean(value, sink->keep_row_padding);
+      break;
+
+    case PROP_CONVERT_THREADS:
+      g_value_set_uint(value, sink->convert_threads);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -215,6 +255,17 @@ static gboolean rosimagesink_close (RosBaseSink * ros_base_sink)
   Rosimagesink *sink = GST_ROSIMAGESINK (ros_base_sink);
   GST_DEBUG_OBJECT (sink, "close");
   sink->pub.reset();
+  if(sink->converter)
+  {
+    gst_video_converter_free(sink->converter);
+    sink->converter = NULL;
+  }
+  if(sink->convert_buf)
+  {
+    gst_buffer_unref(sink->convert_buf);
+    sink->convert_buf = NULL;
+  }
+  sink->msg.reset();
   return TRUE;
 }
 
@@ -224,11 +275,10 @@ static gboolean rosimagesink_setcaps (GstBaseSink * gst_base_sink, GstCaps * cap
   RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (gst_base_sink);
   Rosimagesink *sink = GST_ROSIMAGESINK (ros_base_sink);
 
-  GstStructure *caps_struct;
-  gint width, height, depth, endianness, rate_num, rate_den;
-  const gchar * format_str;
-  GstVideoFormat format_enum;
+  GstVideoInfo video_info;
+  std::string encoding;
   const GstVideoFormatInfo * format_info;
+  sensor_msgs::msg::Image msg_meta;
 
 
   GST_DEBUG_OBJECT (sink, "setcaps");
@@ -243,90 +293,185 @@ static gboolean rosimagesink_setcaps (GstBaseSink * gst_base_sink, GstCaps * cap
       RCLCPP_INFO(ros_base_sink->logger, "preparing video with caps '%s'",
           gst_caps_to_string(caps));
 
-  caps_struct = gst_caps_get_structure (caps, 0);
-  if(!gst_structure_get_int (caps_struct, "width", &width))
-      RCLCPP_ERROR(ros_base_sink->logger, "setcaps missing width");
-  if(!gst_structure_get_int (caps_struct, "height", &height))
-      RCLCPP_ERROR(ros_base_sink->logger, "setcaps missing height");
-  if(!gst_structure_get_fraction (caps_struct, "framerate", &rate_num, &rate_den))
-      RCLCPP_ERROR(ros_base_sink->logger, "setcaps missing framerate");
+  if(!gst_bridge::video_info_from_caps(&video_info, &encoding, caps))
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "setcaps could not parse video caps");
+    return false;
+  }
 
-  format_str = gst_structure_get_string(caps_struct, "format");
+  format_info = video_info.finfo;
 
-  if(format_str)
+  //allow the encoding to be overridden by parameters
+  //but update it if it's blank
+  if(0 == g_strcmp0(sink->init_caps, ""))
   {
-    format_enum = gst_video_format_from_string (format_str);
-    format_info = gst_video_format_get_info (format_enum);
-    depth = format_info->pixel_stride[0];
-
-    //allow the encoding to be overridden by parameters
-    //but update it if it's blank
-    if(0 == g_strcmp0(sink->init_caps, ""))
-    {
-      g_free(sink->init_caps);
-      sink->init_caps = gst_caps_to_string(caps);
-    }
-    if(0 == g_strcmp0(sink->encoding, ""))
-    {
-      g_free(sink->encoding);
-      sink->encoding = g_strdup(gst_bridge::getRosEncoding(format_enum).c_str());
-    }
-
-    RCLCPP_INFO(ros_base_sink->logger, "setcaps format string is %s ", format_str);
-    RCLCPP_INFO(ros_base_sink->logger, "setcaps n_components is %d", format_info->n_components);
-    RCLCPP_INFO(ros_base_sink->logger, "setcaps bits is %d", format_info->bits);
-    RCLCPP_INFO(ros_base_sink->logger, "setcaps pixel_stride is %d", depth);
-
-    if(format_info->bits < 8)
-    {
-      depth = depth/8;
-      RCLCPP_ERROR(ros_base_sink->logger, "low bits per pixel");
-    }
-    endianness = GST_VIDEO_FORMAT_INFO_IS_LE(format_info) ? G_LITTLE_ENDIAN : G_BIG_ENDIAN;
+    g_free(sink->init_caps);
+    sink->init_caps = gst_caps_to_string(caps);
   }
-  else
+  if(0 == g_strcmp0(sink->encoding, ""))
   {
-    RCLCPP_ERROR(ros_base_sink->logger, "setcaps missing format");
-    if(!gst_structure_get_int (caps_struct, "endianness", &endianness))
-      RCLCPP_ERROR(ros_base_sink->logger, "setcaps missing endianness");
-    return false;
+    g_free(sink->encoding);
+    sink->encoding = g_strdup(encoding.c_str());
   }
 
+  RCLCPP_INFO(ros_base_sink->logger, "setcaps format string is %s ", GST_VIDEO_INFO_NAME(&video_info));
+  RCLCPP_INFO(ros_base_sink->logger, "setcaps n_components is %d", format_info->n_components);
+  RCLCPP_INFO(ros_base_sink->logger, "setcaps bits is %d", format_info->bits);
+  RCLCPP_INFO(ros_base_sink->logger, "setcaps pixel_stride is %d", format_info->pixel_stride[0]);
+
+  if(format_info->bits < 8)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "low bits per pixel");
+  }
 
   //collect a bunch of parameters to shoehorn into a message format
-  sink->width = width;
-  sink->height = height;
-  sink->step = width * depth; //full row step size in bytes
-  sink->endianness = endianness;  // XXX used without init
-  //sink->sample_rate = rate;
+  sink->video_info = video_info;
+  msg_meta = gst_bridge::gst_video_info_to_image_msg(&video_info);
+  sink->width = msg_meta.width;
+  sink->height = msg_meta.height;
+  sink->step = msg_meta.step; //full row step size in bytes
+  sink->endianness = msg_meta.is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN;
+
+  // millimetre depth can be published as 32FC1 metres by setting ros-encoding,
+  // and formats like GRAY10_LE32 are unpacked into their encoding
+  sink->row_conversion = gst_bridge::getImageRowConversion(sink->encoding, GST_VIDEO_INFO_FORMAT(&video_info),
+    msg_meta.is_bigendian);
+  if(sink->row_conversion)
+  {
+    sink->step = sink->width * sink->row_conversion->msg_pixel_stride;
+    sink->endianness = sink->row_conversion->msg_endianness;
+  }
 
+  if(!rosimagesink_setup_converter(sink, &video_info, caps))
+    return false;
+  rosimagesink_prepare_msg(sink);
   return true;
 }
 
+/*
+ * Fill in everything that only changes with the caps,
+ * the message is reused for every frame so its data keeps the storage of the last one
+ */
+static void rosimagesink_prepare_msg (Rosimagesink * sink)
+{
+  if(sink->convert_buf)
+  {
+    gst_buffer_unref(sink->convert_buf);
+    sink->convert_buf = NULL;
+  }
+
+  sink->msg = std::make_shared<sensor_msgs::msg::Image>();
+  sink->msg->header.frame_id = sink->frame_id;
+  sink->msg->width = sink->width;
+  sink->msg->height = sink->height;
+  sink->msg->encoding = sink->encoding;
+  sink->msg->is_bigendian = (sink->endianness == G_BIG_ENDIAN);
+  sink->msg->step = sink->step;
+}
+
+/*
+ * Formats ROS can't carry are converted into the ros-encoding format,
+ * straight into the message layout so conversion and copy are one pass.
+ * The converter uses ORC kernels, and splits frames into row bands across convert-threads.
+ */
+static gboolean rosimagesink_setup_converter (Rosimagesink * sink, GstVideoInfo * video_info, GstCaps * caps)
+{
+  RosBaseSink *ros_base_sink = GST_ROS_BASE_SINK (sink);
+  GstVideoFormat in_format = GST_VIDEO_INFO_FORMAT(video_info);
+  GstVideoFormat out_format = gst_bridge::getGstVideoFormat(sink->encoding);
+  sensor_msgs::msg::Image msg_meta;
+
+  if(sink->converter)
+  {
+    gst_video_converter_free(sink->converter);
+    sink->converter = NULL;
+  }
+
+  // row conversions and bayer are handled without a converter
+  if(sink->row_conversion || gst_structure_has_name(gst_caps_get_structure(caps, 0), "video/x-bayer"))
+    return TRUE;
+  // formats with a ROS encoding go through as they are, unless ros-encoding names a different format,
+  // big endian twins like GRAY16_BE go through as their encoding with is_bigendian set
+  if(gst_bridge::getImageFormatInfo(in_format) && ((out_format == GST_VIDEO_FORMAT_UNKNOWN) || (out_format == in_format)
+      || (gst_bridge::getRosEncoding(in_format) == sink->encoding)))
+    return TRUE;
+
+  // ros-encoding was set, rather than taken from the caps, but has no format to convert into
+  if((out_format == GST_VIDEO_FORMAT_UNKNOWN) && (gst_bridge::getRosEncoding(in_format) != sink->encoding))
+  {
+    GST_ELEMENT_ERROR (sink, STREAM, FORMAT,
+        ("can't produce ros-encoding '%s' from %s", sink->encoding, GST_VIDEO_INFO_NAME(video_info)), (NULL));
+    return FALSE;
+  }
+
+  if(out_format == GST_VIDEO_FORMAT_UNKNOWN)
+  {
+    // nothing asked for, rgb8 is what image consumers handle best
+    RCLCPP_INFO(ros_base_sink->logger, "%s has no ROS encoding, converting to rgb8", GST_VIDEO_INFO_NAME(video_info));
+    g_free(sink->encoding);
+    sink->encoding = g_strdup(sensor_msgs::image_encodings::RGB8.c_str());
+    out_format = GST_VIDEO_FORMAT_RGB;
+  }
+
+  gst_video_info_set_format(&(sink->convert_info), out_format, GST_VIDEO_INFO_WIDTH(video_info), GST_VIDEO_INFO_HEIGHT(video_info));
+  msg_meta = gst_bridge::gst_video_info_to_image_msg(&(sink->convert_info));
+  gst_bridge::set_image_msg_layout(&(sink->convert_info), msg_meta.step);
+
+  sink->converter = gst_video_converter_new(video_info, &(sink->convert_info),
+      gst_structure_new ("GstVideoConverter",
+          GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT, sink->convert_threads,
+          NULL));
+  if(!sink->converter)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "can't convert %s to %s", GST_VIDEO_INFO_NAME(video_info), sink->encoding);
+    return FALSE;
+  }
+
+  RCLCPP_INFO(ros_base_sink->logger, "converting %s to %s", GST_VIDEO_INFO_NAME(video_info), sink->encoding);
+  sink->step = msg_meta.step;
+  sink->endianness = msg_meta.is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN;
+  return TRUE;
+}
+
+/*
+ * frames are read through GstVideoMeta, so upstream can hand over padded rows (decoders, v4l2)
+ * without first repacking them into the default layout for us
+ */
+static gboolean rosimagesink_propose_allocation (GstBaseSink * gst_base_sink, GstQuery * query)
+{
+  GST_DEBUG_OBJECT (gst_base_sink, "propose_allocation");
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+  return TRUE;
+}
+
 static GstFlowReturn rosimagesink_render (RosBaseSink * ros_base_sink, GstBuffer * buf, rclcpp::Time msg_time)
 {
-  GstMapInfo info;
-  sensor_msgs::msg::Image msg;
+  gboolean mapped;
 
   Rosimagesink *sink = GST_ROSIMAGESINK (ros_base_sink);
   GST_DEBUG_OBJECT (sink, "render");
 
-  msg.header.stamp = msg_time;
-  msg.header.frame_id = sink->frame_id;
-
   //auto msg = sink->pub->borrow_loaned_message();
   //msg.get().width = 
 
-  //fill the blanks
-  msg.width = sink->width;
-  msg.height = sink->height;
-  msg.encoding = sink->encoding;
-  msg.is_bigendian = (sink->endianness == G_BIG_ENDIAN);
+  // the rest was filled in from the caps
+  sensor_msgs::msg::Image & msg = *(sink->msg);
+  msg.header.stamp = msg_time;
+  if(msg.header.frame_id != sink->frame_id)  //ros-frame-id can change while playing
+    msg.header.frame_id = sink->frame_id;
   msg.step = sink->step;
-  
-  gst_buffer_map (buf, &info, GST_MAP_READ);
-  msg.data.assign(info.data, info.data+info.size);
-  gst_buffer_unmap (buf, &info);
+
+  // upstream's row padding can go out as it is, then plane 0 is copied as one block
+  if(sink->keep_row_padding && !sink->row_conversion && !sink->converter)
+    msg.step = MAX(msg.step, (guint32) gst_bridge::video_buffer_stride(&(sink->video_info), buf));
+
+  mapped = gst_bridge::image_buffer_to_msg_data(sink->converter, &(sink->convert_info), &(sink->convert_buf),
+      sink->row_conversion, &(sink->video_info), buf, msg);
+  if(!mapped)
+  {
+    RCLCPP_ERROR(ros_base_sink->logger, "could not map the buffer as a video frame");
+    return GST_FLOW_ERROR;
+  }
 
   //publish
   sink->pub->publish(msg);
@@ -50,13 +50,12 @@ static GstFlowReturn rosimagesrc_create (GstBaseSrc * base_src, guint64 offset,
 
 //static gboolean rosimagesrc_negotiate (GstBaseSrc * base_src);
 //static GstCaps* rosimagesrc_setcaps (GstBaseSrc * base_src, GstCaps * caps);  //upstream returns any remaining caps preferences
-static gboolean rosimagesrc_query (GstBaseSrc * base_src, GstQuery * query);
+static gboolean rosimagesrc_decide_allocation (GstBaseSrc * base_src, GstQuery * query);
 static GstCaps* rosimagesrc_getcaps (GstBaseSrc * base_src, GstCaps * filter);  //set our caps preferences
 static GstCaps * rosimagesrc_fixate (GstBaseSrc * base_src, GstCaps * caps);
 
 
 static void rosimagesrc_sub_cb(Rosimagesrc * src, sensor_msgs::msg::Image::ConstSharedPtr msg);
-static sensor_msgs::msg::Image::ConstSharedPtr rosimagesrc_wait_for_msg(Rosimagesrc * src);
 
 
 static void rosimagesrc_set_msg_props_from_caps_string(Rosimagesrc * src, gchar * caps_string);
@@ -71,16 +70,16 @@ enum
   PROP_ROS_FRAME_ID,
   PROP_ROS_ENCODING,
   PROP_INIT_CAPS,
+  PROP_SMOOTH_TIMESTAMPS,
+  PROP_MAX_TIMESTAMP_DEVIATION,
 };
 
+#define ROSIMAGESRC_TIMESTAMP_FILTER_GAIN 0.1
+#define ROSIMAGESRC_TIMESTAMP_FILTER_SETTLE 10
+
 /* pad templates */
 
-static GstStaticPadTemplate rosimagesrc_src_template =
-GST_STATIC_PAD_TEMPLATE ("src",
-    GST_PAD_SRC,
-    GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (ROS_IMAGE_MSG_CAPS)
-    );
+// the pad template is generated from the image format table in class_init
 
 
 /* class initialization */
@@ -95,14 +94,17 @@ static void rosimagesrc_class_init (RosimagesrcClass * klass)
   GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
   GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS (klass);
   RosBaseSrcClass *ros_base_src_class = GST_ROS_BASE_SRC_CLASS (klass);
+  GstCaps *template_caps;
 
   object_class->set_property = rosimagesrc_set_property;
   object_class->get_property = rosimagesrc_get_property;
 
   /* Setting up pads and setting metadata should be moved to
      base_class_init if you intend to subclass this class. */
-  gst_element_class_add_static_pad_template (element_class,
-      &rosimagesrc_src_template);
+  template_caps = gst_bridge::getImageMsgCaps();
+  gst_element_class_add_pad_template (element_class,
+      gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS, template_caps));
+  gst_caps_unref (template_caps);
 
 
   gst_element_class_set_static_metadata (element_class,
@@ -135,6 +137,18 @@ static void rosimagesrc_class_init (RosimagesrcClass * klass)
       (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
   );
 
+  g_object_class_install_property (object_class, PROP_SMOOTH_TIMESTAMPS,
+      g_param_spec_boolean ("smooth-timestamps", "smooth-timestamps", "remove arrival jitter from message stamps and estimate the framerate",
+      FALSE,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
+  g_object_class_install_property (object_class, PROP_MAX_TIMESTAMP_DEVIATION,
+      g_param_spec_uint64 ("max-timestamp-deviation", "max-timestamp-deviation", "largest correction (nanoseconds) applied to a message stamp when smoothing",
+      0, G_MAXUINT64, 5 * GST_MSECOND,
+      (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS))
+  );
+
 
   ros_base_src_class->open = GST_DEBUG_FUNCPTR (rosimagesrc_open);  //let the base sink know how we register publishers
   ros_base_src_class->close = GST_DEBUG_FUNCPTR (rosimagesrc_close);  //let the base sink know how we destroy publishers
@@ -142,8 +156,8 @@ static void rosimagesrc_class_init (RosimagesrcClass * klass)
 
 
   basesrc_class->get_caps = GST_DEBUG_FUNCPTR (rosimagesrc_getcaps);  //return caps within the filter
-  basesrc_class->query = GST_DEBUG_FUNCPTR(rosimagesrc_query);  //set the scheduling modes
   basesrc_class->fixate = GST_DEBUG_FUNCPTR (rosimagesrc_fixate); //set caps fields to our preferred values (if possible)
+  basesrc_class->decide_allocation = GST_DEBUG_FUNCPTR (rosimagesrc_decide_allocation);  //find out if downstream reads strides from GstVideoMeta
   //basesrc_class->negotiate = GST_DEBUG_FUNCPTR (rosimagesrc_negotiate);  //start figuring out caps and allocators
   //basesrc_class->event = GST_DEBUG_FUNCPTR (rosimagesrc_event);  //flush events can cause discontinuities (flags exist in buffers)
   //basesrc_class->get_times = GST_DEBUG_FUNCPTR (rosimagesrc_get_times); //asks us for start and stop times (?)
@@ -159,9 +173,13 @@ static void rosimagesrc_init (Rosimagesrc * src)
   src->init_caps = g_strdup("");
 
   src->msg_init = true;
-  src->msg_queue_max = 1;
-  // XXX why does queue segfault without expicit construction?
-  src->msg_queue = std::queue<sensor_msgs::msg::Image::ConstSharedPtr>();
+  new (&(src->msg_queue)) RosBaseSrcMsgQueue<sensor_msgs::msg::Image::ConstSharedPtr>(1);
+
+  src->smooth_timestamps = FALSE;
+  gst_bridge::timestamp_filter_init(&(src->ts_filter), 5 * GST_MSECOND,
+    ROSIMAGESRC_TIMESTAMP_FILTER_GAIN, ROSIMAGESRC_TIMESTAMP_FILTER_SETTLE);
+  src->ts_filter_settled = FALSE;
+  src->use_video_meta = FALSE;
 
   /* configure basesrc to be a live source */
   gst_base_src_set_live (GST_BASE_SRC (src), TRUE);
@@ -208,6 +226,14 @@ void rosimagesrc_set_property (GObject * object, guint property_id,
       }
       break;
 
+    case PROP_SMOOTH_TIMESTAMPS:
+      src->smooth_timestamps = g_value_get_boolean(value);
+      break;
+
+    case PROP_MAX_TIMESTAMP_DEVIATION:
+      src->ts_filter.max_deviation = g_value_get_uint64(value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -238,6 +264,14 @@ void rosimagesrc_get_property (GObject * object, guint property_id,
       g_value_set_string(value, src->init_caps);
       break;
 
+    case PROP_SMOOTH_TIMESTAMPS:
+      g_value_set_boolean(value, src->smooth_timestamps);
+      break;
+
+    case PROP_MAX_TIMESTAMP_DEVIATION:
+      g_value_set_uint64(value, src->ts_filter.max_deviation);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -261,19 +295,19 @@ static void rosimagesrc_set_msg_props_from_caps_string(Rosimagesrc * src, gchar
   if(!gst_structure_get_int (caps_struct, "height", &height))
     GST_DEBUG_OBJECT (src, "caps_init missing height");
 
-  const gchar * format_str = gst_structure_get_string(caps_struct, "format");
-  if(!format_str)
+  GstVideoInfo video_info;
+  std::string caps_encoding;
+  gst_video_info_init(&video_info);
+  if(!gst_bridge::video_info_from_caps(&video_info, &caps_encoding, caps))
     GST_DEBUG_OBJECT (src, "caps_init missing format");
 
-  GstVideoFormat format = gst_video_format_from_string (format_str);
-
-  step = gst_video_format_get_info(format)->pixel_stride[0];
-  endianness = G_LITTLE_ENDIAN;  // XXX pull this from somewhere
+  step = GST_VIDEO_INFO_COMP_PSTRIDE(&video_info, 0);
+  endianness = GST_VIDEO_FORMAT_INFO_IS_LE(video_info.finfo) ? G_LITTLE_ENDIAN : G_BIG_ENDIAN;
 
   // XXX this check is redundant right now, we should allow overrides by making ros-encoding READWRITE
   if(0 == g_strcmp0(src->encoding, ""))
   {
-    encoding = g_strdup(gst_bridge::getRosEncoding(format).c_str());
+    encoding = g_strdup(caps_encoding.c_str());
   }
   else
   {
@@ -326,7 +360,8 @@ static gboolean rosimagesrc_open (RosBaseSrc * ros_base_src)
   // ROS can't cope with some forms of std::bind being passed as subscriber callbacks,
   // lambdas seem to be the preferred case for these instances
   auto cb = [src] (sensor_msgs::msg::Image::ConstSharedPtr msg){rosimagesrc_sub_cb(src, msg);};
-  rclcpp::QoS qos = rclcpp::SensorDataQoS();  //XXX add a parameter for overrides
+  rclcpp::QoS qos = rosbasesrc_sub_qos(ros_base_src);
+  rosbasesrc_queue_open(&(src->msg_queue));
   src->sub = ros_base_src->node->create_subscription<sensor_msgs::msg::Image>(src->sub_topic, qos, cb);
 
   return TRUE;
@@ -341,12 +376,10 @@ static gboolean rosimagesrc_close (RosBaseSrc * ros_base_src)
 
   //XXX dereference is as close as foxy gets to unsubscribe
   src->sub.reset();
-  //empty the queue
-  std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-  while(src->msg_queue.size() > 0)
-  {
-    src->msg_queue.pop();
-  }
+  rosbasesrc_queue_close(&(src->msg_queue));
+
+  gst_bridge::timestamp_filter_reset(&(src->ts_filter));
+  src->ts_filter_settled = FALSE;
 
   return TRUE;
 }
@@ -393,10 +426,9 @@ static GstCaps* rosimagesrc_getcaps (GstBaseSrc * base_src, GstCaps * filter)
 {
   RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (base_src);
 
-  const gchar * format_str;
-  GstVideoFormat format_enum;
   static sensor_msgs::msg::Image::ConstSharedPtr msg;
   GstCaps * caps;
+  gint fps_n, fps_d;
 
   Rosimagesrc *src = GST_ROSIMAGESRC (base_src);
 
@@ -416,16 +448,14 @@ static GstCaps* rosimagesrc_getcaps (GstBaseSrc * base_src, GstCaps * filter)
     }
     GST_DEBUG_OBJECT (src, "getcaps with node ready, waiting for message");
     RCLCPP_INFO(ros_base_src->logger, "waiting for first message");
-    msg = rosimagesrc_wait_for_msg(src);  // XXX need to fix API, the action happens in a side-effect
+    msg = rosbasesrc_queue_peek(&(src->msg_queue));  // XXX need to fix API, the action happens in a side-effect
 
-    format_enum = gst_bridge::getGstVideoFormat(std::string(src->encoding));
-    format_str = gst_video_format_to_string(format_enum);
+    caps = gst_bridge::image_msg_to_caps(std::string(src->encoding), src->width, src->height,
+        src->endianness == G_BIG_ENDIAN);
 
-    caps = gst_caps_new_simple ("video/x-raw",
-        "format", G_TYPE_STRING, format_str,
-        "height", G_TYPE_INT, src->height,
-        "width", G_TYPE_INT, src->width,
-        NULL);
+    // the smoothed stamps describe a regular cadence, advertise it
+    if(src->smooth_timestamps && gst_bridge::timestamp_filter_get_framerate(&(src->ts_filter), &fps_n, &fps_d))
+      gst_caps_set_simple (caps, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
 
     gchar* caps_str = gst_caps_to_string(caps);
     GST_DEBUG_OBJECT (src, "getcaps after first message returning %s", caps_str);
@@ -442,33 +472,19 @@ static GstCaps* rosimagesrc_getcaps (GstBaseSrc * base_src, GstCaps * filter)
 }
 
 
-static gboolean rosimagesrc_query (GstBaseSrc * base_src, GstQuery * query)
+/*
+ * padded messages can only go downstream without a copy if downstream reads strides from GstVideoMeta
+ */
+static gboolean rosimagesrc_decide_allocation (GstBaseSrc * base_src, GstQuery * query)
 {
-  gboolean ret;
-
-  //Rosimagesrc *src = GST_ROSIMAGESRC (base_src);
+  Rosimagesrc *src = GST_ROSIMAGESRC (base_src);
 
-  switch (GST_QUERY_TYPE (query)) {
-    case GST_QUERY_SCHEDULING:
-    {
-      /* a pushsrc can by default never operate in pull mode override
-       * if you want something different. */
-      gst_query_set_scheduling (query, GST_SCHEDULING_FLAG_SEQUENTIAL, 1, -1,
-          0);
-      gst_query_add_scheduling_mode (query, GST_PAD_MODE_PUSH);
+  src->use_video_meta = gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+  GST_DEBUG_OBJECT (src, "downstream %s video meta", src->use_video_meta ? "supports" : "does not support");
 
-      ret = TRUE;
-      break;
-    }
-    default:
-      ret = GST_BASE_SRC_CLASS (rosimagesrc_parent_class)->query (base_src, query);
-      break;
-  }
-  return ret;
+  return GST_BASE_SRC_CLASS (rosimagesrc_parent_class)->decide_allocation (base_src, query);
 }
 
-
-
 /*
  * Wait for a message to be published, then load the contents into buf
  * Also update frame_id and encoding
@@ -479,9 +495,16 @@ static GstFlowReturn rosimagesrc_create (GstBaseSrc * base_src, guint64 offset,
   RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (base_src);
   Rosimagesrc *src = GST_ROSIMAGESRC (base_src);
 
-  GstMapInfo info;
-  GstClockTimeDiff base_time;
+  GstClockTime stamp;
+  gint fps_n, fps_d;
   size_t length;
+  gboolean known_format;
+  const gst_bridge::image_row_conversion * row_conversion;
+  gboolean byteswap;
+  gboolean wrapped = FALSE;
+  GstVideoInfo video_info;
+  gsize plane_offset[GST_VIDEO_MAX_PLANES];
+  gint plane_stride[GST_VIDEO_MAX_PLANES];
   GstFlowReturn ret = GST_FLOW_OK;
   GstBuffer *res_buf;
 
@@ -496,19 +519,44 @@ static GstFlowReturn rosimagesrc_create (GstBaseSrc * base_src, guint64 offset,
     GST_DEBUG_OBJECT (src, "ros image creating buffer before receiving first message");
   }
 
-  auto msg = rosimagesrc_wait_for_msg(src);
-  { //scope the mutex lock
-    std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-    src->msg_queue.pop();   // XXX we can stop dropping the first message during preroll now
-  }
+  auto msg = rosbasesrc_queue_pop(&(src->msg_queue));
 
   // XXX check message contains anything
 
-  length = msg->data.size();
-  if (*buf == NULL) {
+  // the default GstVideoInfo layout pads rows and planes that the message packs tightly
+  // frames keep the negotiated byte order, messages in the other one are swapped while copying
+  known_format = gst_bridge::image_msg_to_video_info(std::string(src->encoding), msg->width, msg->height,
+      src->endianness == G_BIG_ENDIAN, &video_info);
+  row_conversion = gst_bridge::getImageRowConversion(std::string(src->encoding), GST_VIDEO_INFO_FORMAT(&video_info),
+      msg->is_bigendian);
+  byteswap = known_format && !row_conversion && gst_bridge::image_msg_needs_byteswap(&video_info, msg->is_bigendian);
+  if(known_format)
+  {
+    if(row_conversion ?
+        (msg->step < msg->width * row_conversion->msg_pixel_stride) || (msg->data.size() < (size_t) msg->step * msg->height) :
+        (msg->data.size() < gst_bridge::image_msg_plane_layout(&video_info, msg->step, plane_offset, plane_stride)))
+    {
+      RCLCPP_ERROR(ros_base_src->logger, "image message is too short for its encoding and step");
+      return GST_FLOW_ERROR;
+    }
+    length = GST_VIDEO_INFO_SIZE(&video_info);
+  }
+  else
+  {
+    length = msg->data.size();
+  }
+  if ((*buf == NULL) && known_format && !row_conversion && !byteswap &&
+      (src->use_video_meta || gst_bridge::image_msg_layout_matches(&video_info, msg->step))) {
+    /* hand the message memory on directly,
+     * the video meta tells downstream where the rows and planes of the message are */
+    res_buf = rosbasesrc_wrap_msg_data(msg, msg->data);
+    gst_buffer_add_video_meta_full (res_buf, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_INFO_FORMAT(&video_info),
+        msg->width, msg->height, GST_VIDEO_INFO_N_PLANES(&video_info), plane_offset, plane_stride);
+    *buf = res_buf;
+    wrapped = TRUE;
+  } else if (*buf == NULL) {
     /* downstream did not provide us with a buffer to fill, allocate one
-     * ourselves 
-     * XXX pass the vector memory on directly */
+     * ourselves, rows are repacked into the default layout */
     ret = GST_BASE_SRC_CLASS (rosimagesrc_parent_class)->alloc (base_src, offset, length, &res_buf);
     if (G_UNLIKELY (ret != GST_FLOW_OK))
       GST_DEBUG_OBJECT (src, "Failed to allocate buffer of %lu bytes", length);
@@ -520,17 +568,46 @@ static GstFlowReturn rosimagesrc_create (GstBaseSrc * base_src, guint64 offset,
     res_buf = *buf;
   }
 
-  if(length != size)
+  if(!wrapped && (length != size))
     GST_DEBUG_OBJECT (src, "size mismatch, %ld, %d", length, size);
 
-  // XXX check the buffer exists, and check info.size > length
-  gst_buffer_map (*buf, &info, GST_MAP_READ);
-  info.size = length;
-  memcpy(info.data, msg->data.data(), length);
-  gst_buffer_unmap (*buf, &info);
+  if(wrapped)
+  {
+    GST_DEBUG_OBJECT (src, "wrapped the message without a copy");
+  }
+  else if(row_conversion)
+  {
+    gst_bridge::convert_msg_data_to_video_frame(row_conversion, &video_info, msg->data.data(), msg->step, *buf);
+  }
+  else if(byteswap)
+  {
+    gst_bridge::copy_msg_data_to_video_frame_swapped(&video_info, msg->data.data(), msg->step, *buf);
+  }
+  else if(known_format)
+  {
+    gst_bridge::copy_msg_data_to_video_frame(&video_info, msg->data.data(), msg->step, *buf);
+  }
+  else
+  {
+    ret = rosbasesrc_fill_buffer(ros_base_src, msg->data, *buf);
+    if(ret != GST_FLOW_OK)
+      return ret;
+  }
+
+  stamp = rclcpp::Time(msg->header.stamp).nanoseconds();
+  if(src->smooth_timestamps)
+  {
+    stamp = gst_bridge::timestamp_filter_update(&(src->ts_filter), stamp);
+    if(!src->ts_filter_settled && gst_bridge::timestamp_filter_get_framerate(&(src->ts_filter), &fps_n, &fps_d))
+    {
+      // renegotiate once so the caps carry the estimated framerate
+      src->ts_filter_settled = TRUE;
+      RCLCPP_INFO(ros_base_src->logger, "timestamp filter settled at %d/%d fps", fps_n, fps_d);
+      gst_pad_mark_reconfigure(GST_BASE_SRC_PAD(base_src));
+    }
+  }
 
-  base_time = gst_element_get_base_time(GST_ELEMENT(src));
-  GST_BUFFER_PTS (*buf) = rclcpp::Time(msg->header.stamp).nanoseconds() - ros_base_src->ros_clock_offset - base_time;
+  GST_BUFFER_PTS (*buf) = rosbasesrc_msg_stamp_to_pts(ros_base_src, stamp);
 
   return ret;
 }
@@ -555,33 +632,11 @@ static void rosimagesrc_sub_cb(Rosimagesrc * src, sensor_msgs::msg::Image::Const
     if(!(src->width == (int) msg->width))
       RCLCPP_ERROR(ros_base_src->logger, "image format changed during playback, width %d != %d", src->width, msg->width);
     if(!(src->endianness == (msg->is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN)))
-      RCLCPP_ERROR(ros_base_src->logger, "image format changed during playback, endianness %d != %d", src->endianness, (msg->is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN));
+      RCLCPP_DEBUG(ros_base_src->logger, "endianness changed during playback, %d != %d, swapping bytes", src->endianness, (msg->is_bigendian ? G_BIG_ENDIAN : G_LITTLE_ENDIAN));
     if(!(0 == g_strcmp0(src->encoding, msg->encoding.c_str())))
       RCLCPP_ERROR(ros_base_src->logger, "image format changed during playback, encoding %s != %s", src->encoding, msg->encoding.c_str());
     
   }
 
-  std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-  src->msg_queue.push(msg);
-  while(src->msg_queue.size() > src->msg_queue_max)
-  {
-    src->msg_queue.pop();
-    RCLCPP_WARN(ros_base_src->logger, "dropping message");
-  }
-  src->msg_queue_cv.notify_one();
-}
-
-
-static sensor_msgs::msg::Image::ConstSharedPtr rosimagesrc_wait_for_msg(Rosimagesrc * src)
-{
-  //RosBaseSrc *ros_base_src = GST_ROS_BASE_SRC (src);
-
-  std::unique_lock<std::mutex> lck(src->msg_queue_mtx);
-  while(src->msg_queue.empty())
-  {
-    src->msg_queue_cv.wait(lck);
-  }
-  auto msg = src->msg_queue.front();
-
-  return msg;
+  rosbasesrc_queue_push(ros_base_src, &(src->msg_queue), msg);
 }
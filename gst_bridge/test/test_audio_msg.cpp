@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <gst/gst.h>
+#include <gst_bridge/gst_bridge.h>
+#include <algorithm>
+#include <vector>
+
+/*
+ * Packed audio formats keep their packing in the message,
+ * step is the packed frame size and frames is the data size over step.
+ */
+
+struct packed_format
+{
+  GstAudioFormat format;
+  guint bps;  // packed bytes per sample
+};
+
+static const packed_format packed_formats[] =
+{
+  {GST_AUDIO_FORMAT_S24LE, 3},
+  {GST_AUDIO_FORMAT_S24BE, 3},
+  {GST_AUDIO_FORMAT_U24LE, 3},
+  {GST_AUDIO_FORMAT_U24BE, 3},
+  {GST_AUDIO_FORMAT_S24_32LE, 4},
+  {GST_AUDIO_FORMAT_S24_32BE, 4},
+  {GST_AUDIO_FORMAT_S20LE, 3},
+  {GST_AUDIO_FORMAT_S20BE, 3},
+  {GST_AUDIO_FORMAT_S18LE, 3},
+  {GST_AUDIO_FORMAT_S18BE, 3},
+};
+
+TEST(audio_msg, packed_step_and_frames)
+{
+  gst_init(nullptr, nullptr);
+
+  for(const packed_format & packed : packed_formats)
+  {
+    for(guint channels : {1u, 2u, 5u})
+    {
+      for(gsize frames : {1u, 7u, 441u})
+      {
+        GstAudioInfo info, msg_info;
+        uint64_t seq_num = 0;
+
+        gst_audio_info_set_format(&info, packed.format, 48000, channels, NULL);
+        audio_msgs::msg::Audio msg = gst_bridge::gst_audio_info_to_audio_msg(&info);
+        ASSERT_EQ(channels * packed.bps, msg.step) << gst_audio_format_to_string(packed.format);
+
+        std::vector<guint8> data(frames * msg.step);
+        for(gsize i = 0; i < data.size(); i++)
+          data[i] = (guint8) (i * 7 + 1);
+        GstBuffer * buf = gst_buffer_new_allocate(NULL, data.size(), NULL);
+        gst_buffer_fill(buf, 0, data.data(), data.size());
+
+        gst_bridge::fill_audio_msg_data(msg, buf, &seq_num);
+        gst_buffer_unref(buf);
+        EXPECT_EQ(frames, msg.frames) << gst_audio_format_to_string(packed.format);
+        EXPECT_EQ(data, msg.data) << gst_audio_format_to_string(packed.format);
+        EXPECT_EQ(frames, seq_num);
+
+        ASSERT_TRUE(gst_bridge::audio_msg_to_gst_audio_info(msg, &msg_info)) << gst_audio_format_to_string(packed.format);
+        EXPECT_EQ(packed.format, GST_AUDIO_INFO_FORMAT(&msg_info));
+        EXPECT_EQ((gint) channels, GST_AUDIO_INFO_CHANNELS(&msg_info));
+      }
+    }
+  }
+}
+
+// S24BE reaches S24LE and S32LE through the kernels, without a converter
+TEST(audio_msg, s24be_convert_samples)
+{
+  gst_init(nullptr, nullptr);
+
+  const guint channels = 3;
+  const gsize frames = 101;
+  GstAudioInfo be_info, le_info, s32_info;
+  std::vector<guint8> be(frames * channels * 3), le(be.size());
+  std::vector<gint32> s32(frames * channels);
+  gpointer in, out;
+
+  gst_audio_info_set_format(&be_info, GST_AUDIO_FORMAT_S24BE, 48000, channels, NULL);
+  gst_audio_info_set_format(&le_info, GST_AUDIO_FORMAT_S24LE, 48000, channels, NULL);
+  gst_audio_info_set_format(&s32_info, GST_AUDIO_FORMAT_S32LE, 48000, channels, NULL);
+
+  for(gsize i = 0; i < be.size(); i++)
+    be[i] = (guint8) (i * 13 + 5);
+
+  in = be.data();
+  out = le.data();
+  ASSERT_TRUE(gst_bridge::audio_convert_samples(nullptr, &be_info, &le_info, &in, &out, frames));
+  for(gsize i = 0; i < frames * channels; i++)
+  {
+    EXPECT_EQ(be[3*i], le[3*i + 2]);
+    EXPECT_EQ(be[3*i + 1], le[3*i + 1]);
+    EXPECT_EQ(be[3*i + 2], le[3*i]);
+  }
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+  in = le.data();
+  out = s32.data();
+  ASSERT_TRUE(gst_bridge::audio_convert_samples(nullptr, &le_info, &s32_info, &in, &out, frames));
+  for(gsize i = 0; i < frames * channels; i++)
+  {
+    guint32 expected = ((guint32) le[3*i] << 8) | ((guint32) le[3*i + 1] << 16) | ((guint32) le[3*i + 2] << 24);
+    EXPECT_EQ((gint32) expected, s32[i]);
+  }
+#endif
+}
+
+// every sample value of a 20 or 18 bit format, sign extended into its 3 little endian bytes
+static std::vector<guint8> all_packed_samples(guint depth)
+{
+  std::vector<guint8> packed(3u << depth);
+  for(guint32 i = 0; i < (1u << depth); i++)
+  {
+    gint32 v = ((gint32) (i << (32 - depth))) >> (32 - depth);
+    packed[3*i] = (guint8) v;
+    packed[3*i + 1] = (guint8) (v >> 8);
+    packed[3*i + 2] = (guint8) (v >> 16);
+  }
+  return packed;
+}
+
+// S20 and S18 carry 24 bit wide samples, they swap byte order through the kernels and widen through a converter
+TEST(audio_msg, s20_s18_convert_samples)
+{
+  gst_init(nullptr, nullptr);
+
+  const guint channels = 2;
+
+  for(GstAudioFormat format : {GST_AUDIO_FORMAT_S20LE, GST_AUDIO_FORMAT_S18LE})
+  {
+    GstAudioInfo le_info, be_info, s32_info;
+    gst_audio_info_set_format(&le_info, format, 48000, channels, NULL);
+    gst_audio_info_set_format(&be_info, gst_bridge::audio_format_with_endianness(format, G_BIG_ENDIAN), 48000, channels, NULL);
+    gst_audio_info_set_format(&s32_info, GST_AUDIO_FORMAT_S32LE, 48000, channels, NULL);
+
+    const guint depth = GST_AUDIO_INFO_DEPTH(&le_info);
+    std::vector<guint8> le = all_packed_samples(depth), be(le.size()), back(le.size(), 0);
+    std::vector<gint32> s32(le.size() / 3);
+    const gsize frames = s32.size() / channels;
+    gpointer in, out;
+
+    in = le.data();
+    out = be.data();
+    ASSERT_TRUE(gst_bridge::audio_convert_samples(nullptr, &le_info, &be_info, &in, &out, frames)) << gst_audio_format_to_string(format);
+    for(gsize i = 0; i < s32.size(); i++)
+    {
+      ASSERT_EQ(le[3*i], be[3*i + 2]);
+      ASSERT_EQ(le[3*i + 1], be[3*i + 1]);
+      ASSERT_EQ(le[3*i + 2], be[3*i]);
+    }
+    in = be.data();
+    out = back.data();
+    ASSERT_TRUE(gst_bridge::audio_convert_samples(nullptr, &be_info, &le_info, &in, &out, frames));
+    EXPECT_EQ(le, back) << gst_audio_format_to_string(format);
+
+    // widening is exact, so narrowing back without dither returns every sample
+    GstAudioConverter * widen = gst_bridge::audio_converter_new(&le_info, &s32_info, GST_AUDIO_DITHER_NONE);
+    GstAudioConverter * narrow = gst_bridge::audio_converter_new(&s32_info, &le_info, GST_AUDIO_DITHER_NONE);
+    ASSERT_TRUE(widen && narrow);
+
+    std::fill(back.begin(), back.end(), 0);
+    in = le.data();
+    out = s32.data();
+    ASSERT_TRUE(gst_bridge::audio_convert_samples(widen, &le_info, &s32_info, &in, &out, frames));
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+    for(gsize i = 0; i < s32.size(); i++)
+    {
+      guint32 v = (guint32) le[3*i] | ((guint32) le[3*i + 1] << 8) | ((guint32) le[3*i + 2] << 16);
+      ASSERT_EQ((gint32) (v << (32 - depth)), s32[i]) << gst_audio_format_to_string(format);
+    }
+#endif
+    in = s32.data();
+    out = back.data();
+    ASSERT_TRUE(gst_bridge::audio_convert_samples(narrow, &s32_info, &le_info, &in, &out, frames));
+    EXPECT_EQ(le, back) << gst_audio_format_to_string(format);
+
+    gst_audio_converter_free(widen);
+    gst_audio_converter_free(narrow);
+  }
+}
+
+// packed 3-byte samples change layout without a converter, as channel-topics does with planar caps
+TEST(audio_msg, packed_change_layout)
+{
+  gst_init(nullptr, nullptr);
+
+  const guint channels = 3;
+  const gsize frames = 67;
+
+  for(GstAudioFormat format : {GST_AUDIO_FORMAT_S24LE, GST_AUDIO_FORMAT_S20LE, GST_AUDIO_FORMAT_S18BE})
+  {
+    GstAudioInfo planar_info, interleaved_info;
+    std::vector<guint8> planar(frames * channels * 3), interleaved(planar.size()), back(planar.size(), 0);
+    std::vector<gpointer> planar_planes, back_planes;
+    gpointer interleaved_plane = interleaved.data();
+
+    gst_audio_info_set_format(&planar_info, format, 48000, channels, NULL);
+    GST_AUDIO_INFO_LAYOUT(&planar_info) = GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+    gst_audio_info_set_format(&interleaved_info, format, 48000, channels, NULL);
+
+    for(gsize i = 0; i < planar.size(); i++)
+      planar[i] = (guint8) (i * 11 + 3);
+    gst_bridge::audio_msg_planes(&planar_info, planar.data(), frames, &planar_planes);
+    gst_bridge::audio_msg_planes(&planar_info, back.data(), frames, &back_planes);
+
+    ASSERT_TRUE(gst_bridge::audio_convert_samples(nullptr, &planar_info, &interleaved_info,
+        planar_planes.data(), &interleaved_plane, frames)) << gst_audio_format_to_string(format);
+    for(guint c = 0; c < channels; c++)
+    {
+      for(gsize i = 0; i < frames; i++)
+      {
+        for(guint b = 0; b < 3; b++)
+          ASSERT_EQ(planar[(c * frames + i) * 3 + b], interleaved[(i * channels + c) * 3 + b]);
+      }
+    }
+
+    ASSERT_TRUE(gst_bridge::audio_convert_samples(nullptr, &interleaved_info, &planar_info,
+        &interleaved_plane, back_planes.data(), frames)) << gst_audio_format_to_string(format);
+    EXPECT_EQ(planar, back) << gst_audio_format_to_string(format);
+  }
+}
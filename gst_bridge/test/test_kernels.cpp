@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <gst_bridge/kernels.h>
+#include <vector>
+
+/*
+ * Round trips of S24 through the kernels, over every sample value,
+ * the big endian packing is the little endian one with the 3 bytes swapped.
+ * S20 and S18 reach the same kernels through audio_convert_samples, test_audio_msg covers them.
+ */
+
+// an odd chunk, so the vectorized loops always finish with a scalar tail
+static const gsize chunk = 4099;
+
+// every value of a signed sample of this many bits, sign extended into 32 bits
+static std::vector<gint32> all_samples(guint bits)
+{
+  std::vector<gint32> samples(1u << bits);
+  for(guint32 i = 0; i < samples.size(); i++)
+    samples[i] = ((gint32) (i << (32 - bits))) >> (32 - bits);
+  return samples;
+}
+
+static void packed_round_trip(guint bits, gboolean big_endian)
+{
+  std::vector<gint32> samples = all_samples(bits);
+  std::vector<guint8> packed(3*chunk), swapped(3*chunk);
+  std::vector<gint32> unpacked(chunk), shifted(chunk);
+
+  for(gsize start = 0; start < samples.size(); start += chunk)
+  {
+    gsize n = MIN(chunk, samples.size() - start);
+    const gint32 * src = samples.data() + start;
+
+    gst_bridge::pack_s24_32_to_s24le(src, packed.data(), n);
+    if(big_endian)
+    {
+      gst_bridge::byteswap_copy_24(packed.data(), swapped.data(), n);
+      for(gsize i = 0; i < n; i++)
+        ASSERT_EQ((guint8) (src[i] >> 16), swapped[3*i]) << "sample " << src[i];
+      gst_bridge::byteswap_copy_24(swapped.data(), packed.data(), n);
+    }
+    for(gsize i = 0; i < n; i++)
+      ASSERT_EQ((guint8) src[i], packed[3*i]) << "sample " << src[i];
+
+    gst_bridge::unpack_s24le_to_s24_32(packed.data(), unpacked.data(), n);
+    gst_bridge::unpack_s24le_to_s32(packed.data(), shifted.data(), n);
+    for(gsize i = 0; i < n; i++)
+    {
+      ASSERT_EQ(src[i], unpacked[i]);
+      ASSERT_EQ((gint32) ((guint32) src[i] << 8), shifted[i]);
+    }
+  }
+}
+
+TEST(kernels, s24le_round_trip)
+{
+  packed_round_trip(24, FALSE);
+}
+
+TEST(kernels, s24be_round_trip)
+{
+  packed_round_trip(24, TRUE);
+}
+
+// short and odd counts must not touch anything past the last sample
+TEST(kernels, s24_odd_counts)
+{
+  const guint8 guard = 0xa5;
+
+  for(gsize n = 1; n <= 37; n += 2)
+  {
+    std::vector<gint32> samples(n), unpacked(n + 1, 0x5a5a5a5a);
+    std::vector<guint8> packed(3*n + 3, guard), swapped(3*n + 3, guard);
+
+    for(gsize i = 0; i < n; i++)
+      samples[i] = (gint32) (i * 0x10203) - 0x400000;
+
+    gst_bridge::pack_s24_32_to_s24le(samples.data(), packed.data(), n);
+    gst_bridge::byteswap_copy_24(packed.data(), swapped.data(), n);
+    for(gsize i = 3*n; i < packed.size(); i++)
+    {
+      EXPECT_EQ(guard, packed[i]) << n << " samples";
+      EXPECT_EQ(guard, swapped[i]) << n << " samples";
+    }
+
+    gst_bridge::unpack_s24le_to_s24_32(packed.data(), unpacked.data(), n);
+    EXPECT_EQ(0x5a5a5a5a, unpacked[n]) << n << " samples";
+    for(gsize i = 0; i < n; i++)
+      EXPECT_EQ(samples[i], unpacked[i]) << n << " samples";
+  }
+}
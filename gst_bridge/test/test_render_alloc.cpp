@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/video/video.h>
+#include <gst_bridge/gst_bridge.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ * rosimagesink and rosaudiosink reuse one message per caps, so once the first buffer has sized its storage
+ * a buffer must be published without allocating. operator new is counted around the helpers render calls,
+ * in the order render calls them. glib and gstreamer allocate through g_malloc, which isn't counted.
+ */
+
+static std::atomic<size_t> allocations(0);
+
+void * operator new(std::size_t size)
+{
+  allocations++;
+  void * p = std::malloc(size ? size : 1);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+static const int buffers = 10;
+
+// longer than the small string buffer, so a reassignment would allocate
+static const std::string frame_id = "camera_optical_frame_with_a_long_name";
+
+struct image_case
+{
+  GstVideoFormat format;
+  const char * encoding;  // ros-encoding, nullptr publishes the format as it is
+};
+
+TEST(render_alloc, image)
+{
+  gst_init(nullptr, nullptr);
+
+  // plain copies, row conversions, and GstVideoConverter conversions,
+  // odd sizes so rows and planes have padding in the buffer that the message packs out
+  const image_case cases[] =
+  {
+    {GST_VIDEO_FORMAT_RGB,         nullptr},
+    {GST_VIDEO_FORMAT_GRAY16_LE,   nullptr},
+    {GST_VIDEO_FORMAT_I420,        nullptr},
+    {GST_VIDEO_FORMAT_NV12,        nullptr},
+    {GST_VIDEO_FORMAT_GRAY16_LE,   "32FC1"},
+    {GST_VIDEO_FORMAT_GRAY10_LE32, "mono16"},
+    {GST_VIDEO_FORMAT_I420,        "rgb8"},
+    {GST_VIDEO_FORMAT_YUY2,        "bgr8"},
+  };
+
+  for(const image_case & c : cases)
+  {
+    GstVideoInfo info, convert_info;
+    GstVideoConverter * converter = NULL;
+    GstBuffer * convert_buf = NULL;
+    const gst_bridge::image_row_conversion * conv = nullptr;
+    gboolean ok = TRUE;
+
+    // what rosimagesink_setcaps prepares
+    gst_video_info_set_format(&info, c.format, 321, 241);
+    sensor_msgs::msg::Image msg = gst_bridge::gst_video_info_to_image_msg(&info);
+    if(c.encoding)
+      conv = gst_bridge::getImageRowConversion(c.encoding, c.format, msg.is_bigendian);
+    if(conv)
+    {
+      msg.encoding = conv->encoding;
+      msg.step = msg.width * conv->msg_pixel_stride;
+      msg.is_bigendian = (conv->msg_endianness == G_BIG_ENDIAN);
+    }
+    else if(c.encoding)
+    {
+      gst_video_info_set_format(&convert_info, gst_bridge::getGstVideoFormat(c.encoding), msg.width, msg.height);
+      msg = gst_bridge::gst_video_info_to_image_msg(&convert_info);
+      gst_bridge::set_image_msg_layout(&convert_info, msg.step);
+      converter = gst_video_converter_new(&info, &convert_info, NULL);
+      ASSERT_TRUE(converter) << c.encoding;
+    }
+    msg.header.frame_id = frame_id;
+
+    GstBuffer * buf = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&info), NULL);
+
+    // what rosimagesink_render does per buffer, the first one sizes the storage
+    for(int i = 0; i <= buffers; i++)
+    {
+      size_t before = allocations.load();
+
+      msg.header.stamp.nanosec = i;
+      if(msg.header.frame_id != frame_id)
+        msg.header.frame_id = frame_id;
+      ok = gst_bridge::image_buffer_to_msg_data(converter, &convert_info, &convert_buf, conv, &info, buf, msg) && ok;
+
+      if((i > 0) && (allocations.load() != before))
+      {
+        ADD_FAILURE() << "buffer " << i << " allocated, " << gst_video_format_to_string(c.format)
+          << " to " << msg.encoding;
+        break;
+      }
+    }
+
+    EXPECT_TRUE(ok) << gst_video_format_to_string(c.format) << " to " << msg.encoding;
+    EXPECT_LE((size_t) msg.step * msg.height, msg.data.size());
+    EXPECT_TRUE(!conv || (msg.data.size() == (size_t) msg.step * msg.height));
+
+    gst_buffer_unref(buf);
+    if(convert_buf)
+      gst_buffer_unref(convert_buf);
+    if(converter)
+      gst_video_converter_free(converter);
+  }
+}
+
+struct audio_case
+{
+  GstAudioFormat in_format;
+  GstAudioLayout in_layout;
+  GstAudioFormat msg_format;
+  GstAudioLayout msg_layout;
+};
+
+TEST(render_alloc, audio)
+{
+  gst_init(nullptr, nullptr);
+
+  // a plain copy, a layout change, a kernel conversion, and a GstAudioConverter conversion
+  const audio_case cases[] =
+  {
+    {GST_AUDIO_FORMAT_S16LE, GST_AUDIO_LAYOUT_INTERLEAVED,     GST_AUDIO_FORMAT_S16LE, GST_AUDIO_LAYOUT_INTERLEAVED},
+    {GST_AUDIO_FORMAT_S16LE, GST_AUDIO_LAYOUT_NON_INTERLEAVED, GST_AUDIO_FORMAT_S16LE, GST_AUDIO_LAYOUT_INTERLEAVED},
+    {GST_AUDIO_FORMAT_S16LE, GST_AUDIO_LAYOUT_INTERLEAVED,     GST_AUDIO_FORMAT_S16LE, GST_AUDIO_LAYOUT_NON_INTERLEAVED},
+    {GST_AUDIO_FORMAT_S24LE, GST_AUDIO_LAYOUT_INTERLEAVED,     GST_AUDIO_FORMAT_S24BE, GST_AUDIO_LAYOUT_INTERLEAVED},
+    {GST_AUDIO_FORMAT_S16LE, GST_AUDIO_LAYOUT_INTERLEAVED,     GST_AUDIO_FORMAT_F32LE, GST_AUDIO_LAYOUT_INTERLEAVED},
+  };
+  const guint channels = 4;
+  const gsize frames = 480;
+
+  for(const audio_case & c : cases)
+  {
+    GstAudioInfo in_info, msg_info;
+    GstAudioConverter * converter = NULL;
+    std::vector<gpointer> msg_planes;
+    uint64_t msg_seq_num = 0;
+    gboolean ok = TRUE;
+
+    gst_audio_info_set_format(&in_info, c.in_format, 48000, channels, NULL);
+    in_info.layout = c.in_layout;
+    gst_bridge::audio_info_with_format(&in_info, c.msg_format, c.msg_layout, &msg_info);
+    if(c.in_format != c.msg_format)
+      converter = gst_bridge::audio_converter_new(&in_info, &msg_info, GST_AUDIO_DITHER_NONE);
+
+    GstBuffer * buf = gst_buffer_new_allocate(NULL, frames * GST_AUDIO_INFO_BPF(&in_info), NULL);
+    if(c.in_layout == GST_AUDIO_LAYOUT_NON_INTERLEAVED)
+      gst_buffer_add_audio_meta(buf, &in_info, frames, NULL);
+
+    audio_msgs::msg::Audio msg = gst_bridge::gst_audio_info_to_audio_msg(&msg_info);
+    msg.header.frame_id = frame_id;
+
+    // what rosaudiosink_render does per buffer, the first one sizes the storage
+    for(int i = 0; i <= buffers; i++)
+    {
+      GstAudioBuffer audio_buf;
+      size_t before = allocations.load();
+
+      if(!gst_audio_buffer_map(&audio_buf, &in_info, buf, GST_MAP_READ))
+      {
+        ok = FALSE;
+        break;
+      }
+      msg.header.stamp.nanosec = i;
+      if(msg.header.frame_id != frame_id)
+        msg.header.frame_id = frame_id;
+      msg.frames = audio_buf.n_samples;
+      ok = gst_bridge::audio_buffer_to_msg_data(converter, &in_info, &msg_info, &audio_buf, msg.data, &msg_planes) && ok;
+      gst_audio_buffer_unmap(&audio_buf);
+      gst_bridge::set_audio_msg_seq_num(msg, buf, &msg_seq_num);
+
+      if((i > 0) && (allocations.load() != before))
+      {
+        ADD_FAILURE() << "buffer " << i << " allocated, " << gst_audio_format_to_string(c.in_format)
+          << " to " << gst_audio_format_to_string(c.msg_format);
+        break;
+      }
+    }
+
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(frames * GST_AUDIO_INFO_BPF(&msg_info), msg.data.size());
+    EXPECT_EQ(frames * (buffers + 1), msg_seq_num);
+
+    gst_buffer_unref(buf);
+    if(converter)
+      gst_audio_converter_free(converter);
+  }
+}